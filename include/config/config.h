@@ -1,11 +1,139 @@
 #ifndef ZEUS_CONFIG_H
 #define ZEUS_CONFIG_H
 
+#include "../core/log.h"
+
 #include <stddef.h>
 
 #define DEFAULT_PORT 8443
 #define DEFAULT_WORKERS 4
 
+/**
+ * How the listening socket is shared among workers.
+ *
+ * SHARED: the master binds a single socket and every worker polls it.
+ * REUSEPORT: one SO_REUSEPORT socket per worker, the kernel balances
+ * incoming connections between them.
+ */
+
+typedef enum {
+    ZEUS_LISTEN_SHARED,
+    ZEUS_LISTEN_REUSEPORT
+} zeus_listen_mode_t;
+
+#define DEFAULT_LISTEN_MODE ZEUS_LISTEN_SHARED
+
+/**
+ * Event notification backend used by the workers. io_uring falls back
+ * to epoll at startup when the kernel does not support it.
+ */
+
+typedef enum {
+    ZEUS_BACKEND_EPOLL,
+    ZEUS_BACKEND_IO_URING
+} zeus_event_backend_t;
+
+#define DEFAULT_EVENT_BACKEND ZEUS_BACKEND_EPOLL
+
+/**
+ * Connection timeouts, in seconds (0 disables the timeout).
+ */
+
+#define DEFAULT_HANDSHAKE_TIMEOUT 10
+#define DEFAULT_HEADER_TIMEOUT 15
+#define DEFAULT_BODY_TIMEOUT 30
+#define DEFAULT_KEEPALIVE_TIMEOUT 75
+#define DEFAULT_WRITE_TIMEOUT 30
+
+/**
+ * Requests served on one HTTP/1.1 connection before it is closed
+ * (0 means unlimited).
+ */
+
+#define DEFAULT_MAX_KEEPALIVE_REQUESTS 1000
+
+/**
+ * Kernel TLS offload (ktls = on|off). When the kernel has TLS ULP
+ * support, record encryption moves into the kernel after the handshake
+ * and files are sent with SSL_sendfile; otherwise OpenSSL keeps
+ * encrypting in userspace.
+ */
+
+#define DEFAULT_KTLS 0
+
+/**
+ * Per-worker open-file cache: entries kept (0 disables it) and how
+ * often, in seconds, a cached file is checked for changes with stat.
+ */
+
+#define DEFAULT_FILE_CACHE_SIZE 1024
+#define DEFAULT_FILE_CACHE_TTL 5
+
+/**
+ * Cached files up to this many bytes are sent from a snapshot shared by
+ * all workers, headers and body in one write (0 sends every file as a
+ * range).
+ */
+
+#define DEFAULT_FILE_CACHE_MEMORY_MAX (16 * 1024)
+
+/**
+ * Serve precompressed siblings (foo.js.br / .zst / .gz) to clients that
+ * accept them (precompressed = on|off).
+ */
+
+#define DEFAULT_PRECOMPRESSED 1
+
+/**
+ * On-the-fly gzip of dynamic responses (gzip = on|off): bodies of at
+ * least gzip_min_length bytes with a compressible Content-Type, at
+ * zlib level gzip_level (1-9).
+ */
+
+#define DEFAULT_GZIP 0
+#define DEFAULT_GZIP_LEVEL 5
+#define DEFAULT_GZIP_MIN_LENGTH 1024
+
+/**
+ * Print the frozen route table to stderr at startup (dump_routes =
+ * on|off).
+ */
+
+#define DEFAULT_DUMP_ROUTES 0
+
+/**
+ * Least severe records written (log_level = debug|info|warn|error).
+ */
+
+#define DEFAULT_LOG_LEVEL LOG_LEVEL_INFO
+
+/**
+ * Prometheus endpoint (metrics = on|off, metrics_path). Off by default:
+ * the counters are always kept, but only served when asked for.
+ */
+
+#define DEFAULT_METRICS 0
+#define DEFAULT_METRICS_PATH "/metrics"
+
+/**
+ * Binary access log (access_log = <path>): each worker appends to
+ * <path>.<worker id>. Unset by default (no access log).
+ */
+
+/**
+ * Content types for file extensions (mime_type = <ext> <type>, one per
+ * line), on top of or replacing the built-in table.
+ */
+
+#define ZEUS_MAX_MIME_TYPES 64
+#define ZEUS_MIME_EXT_MAX 16
+#define ZEUS_MIME_TYPE_MAX 96
+
+typedef struct {
+    char ext[ZEUS_MIME_EXT_MAX];    /** Lower case, without the dot. */
+    char type[ZEUS_MIME_TYPE_MAX];
+} zeus_mime_override_t;
+
 /**
  * Structure that contains the global configuration for server.
  */
@@ -14,8 +142,33 @@ typedef struct {
     char bind_host[32];
     int bind_port;
     int num_workers;
+    zeus_listen_mode_t listen_mode;
+    zeus_event_backend_t event_backend;
+
+    int handshake_timeout;      /** TLS handshake must complete within this deadline. */
+    int header_timeout;         /** Whole request header section deadline. */
+    int body_timeout;           /** Max idle time between two body reads. */
+    int keepalive_timeout;      /** Max idle time between two requests. */
+    int write_timeout;          /** Max time without write progress. */
+    int max_keepalive_requests; /** Requests per keep-alive connection. */
+    int ktls;                   /** Request kernel TLS offload. */
+    int file_cache_size;        /** Open files cached per worker. */
+    int file_cache_ttl;         /** Revalidation interval of cached files. */
+    int file_cache_memory_max;  /** Size limit for files served from the shared snapshots. */
+    int precompressed;          /** Look for precompressed file variants. */
+    int gzip;                   /** Compress dynamic responses. */
+    int gzip_level;
+    int gzip_min_length;        /** Smaller bodies are sent as is. */
+    zeus_mime_override_t mime_types[ZEUS_MAX_MIME_TYPES];
+    int num_mime_types;
+    int dump_routes;            /** Print the route table after it is frozen. */
+
+    log_level_t log_level;
 
     char log_file[128];
+    char access_log[128];
+    int metrics;                /** Serve the counters on metrics_path. */
+    char metrics_path[64];
     char tls_cert_path[128];
     char tls_key_path[128];
 } zeus_config_t;
@@ -28,6 +181,28 @@ typedef enum {
     CONFIG_KEY_TLS_CERT_PATH,
     CONFIG_KEY_TLS_KEY_PATH,
     CONFIG_KEY_LOG_FILE,
+    CONFIG_KEY_LISTEN_MODE,
+    CONFIG_KEY_EVENT_BACKEND,
+    CONFIG_KEY_HANDSHAKE_TIMEOUT,
+    CONFIG_KEY_HEADER_TIMEOUT,
+    CONFIG_KEY_BODY_TIMEOUT,
+    CONFIG_KEY_KEEPALIVE_TIMEOUT,
+    CONFIG_KEY_WRITE_TIMEOUT,
+    CONFIG_KEY_MAX_KEEPALIVE_REQUESTS,
+    CONFIG_KEY_KTLS,
+    CONFIG_KEY_FILE_CACHE_SIZE,
+    CONFIG_KEY_FILE_CACHE_TTL,
+    CONFIG_KEY_FILE_CACHE_MEMORY_MAX,
+    CONFIG_KEY_PRECOMPRESSED,
+    CONFIG_KEY_GZIP,
+    CONFIG_KEY_GZIP_LEVEL,
+    CONFIG_KEY_GZIP_MIN_LENGTH,
+    CONFIG_KEY_MIME_TYPE,
+    CONFIG_KEY_DUMP_ROUTES,
+    CONFIG_KEY_LOG_LEVEL,
+    CONFIG_KEY_ACCESS_LOG,
+    CONFIG_KEY_METRICS,
+    CONFIG_KEY_METRICS_PATH,
 } config_key_t;
 
 /**
@@ -0,0 +1,147 @@
+/**
+ * include/core/access_log.h
+ * Binary access log: one fixed-layout record per response, appended to
+ * a per-worker buffer and written to that worker's file in the loop's
+ * idle phase. Nothing is formatted as text on the request path; the
+ * zeus-logcat tool decodes the files offline.
+ */
+
+#ifndef ZEUS_ACCESS_LOG_H
+#define ZEUS_ACCESS_LOG_H
+
+#include "../zeushttp.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * File layout: a zeus_access_file_t header, then records back to back.
+ * Fields are in host byte order; the header's byte_order lets the
+ * decoder refuse a file written on another architecture.
+ */
+
+#define ZEUS_ACCESS_MAGIC "ZACL"
+#define ZEUS_ACCESS_VERSION 1
+#define ZEUS_ACCESS_BYTE_ORDER 0x01020304u
+
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t record_size;       /** sizeof(zeus_access_record_t), without the path. */
+    uint32_t byte_order;
+    uint32_t reserved;
+} zeus_access_file_t;
+
+/**
+ * Record flags.
+ */
+
+#define ZEUS_ACCESS_H2             0x01    /** HTTP/2 stream (else HTTP/1.x). */
+#define ZEUS_ACCESS_TLS_RESUMED    0x02    /** The TLS session was resumed. */
+#define ZEUS_ACCESS_KEEPALIVE      0x04    /** Connection stayed open after the response. */
+#define ZEUS_ACCESS_PATH_TRUNCATED 0x08
+
+/**
+ * Longest path kept in a record.
+ */
+
+#define ZEUS_ACCESS_PATH_MAX 512
+
+/**
+ * One response. The path follows the fixed part, padded so the next
+ * record starts on 8 bytes; size covers both.
+ */
+
+typedef struct {
+    uint16_t size;
+    uint16_t status;
+    uint16_t path_len;
+    uint8_t flags;
+    uint8_t http_minor;         /** HTTP/1.x minor version, 0 for HTTP/2. */
+    char method[8];             /** NUL-padded, truncated past 8 bytes. */
+    uint64_t time_us;           /** Wall clock when the request headers were complete. */
+    uint32_t latency_us;        /** From then until the response was fully written. */
+    int32_t fd;
+    uint64_t bytes_in;          /** Request header and body bytes. */
+    uint64_t bytes_out;         /** Response bytes written (before TLS). */
+    uint32_t stream_id;         /** HTTP/2 stream, 0 for HTTP/1.x. */
+    uint32_t pid;
+} zeus_access_record_t;
+
+/**
+ * Per-request accounting, kept in the connection from
+ * zeus_access_begin until the response is done. Shared with the
+ * per-route latency histograms (metrics.h).
+ */
+
+typedef struct {
+    uint64_t time_us;           /** Wall clock, only taken for the access log. */
+    uint64_t start_ns;          /** Monotonic clock when the headers were complete. */
+    uint64_t first_ns;          /** First response byte written. */
+    uint64_t end_ns;            /** Response fully written. */
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint32_t route;             /** Matched route id + 1, 0 when none. */
+} zeus_access_stamp_t;
+
+/**
+ * Worker side: the file and the records not written yet.
+ */
+
+typedef struct {
+    int fd;
+    uint32_t pid;
+    char *buf;
+    size_t len;
+    size_t cap;
+    size_t head;                /** File header bytes at the start of buf. */
+    size_t records;             /** Written since the worker started. */
+    size_t dropped;             /** Records lost to a failed write. */
+} zeus_access_log_t;
+
+/**
+ * Master: opens <access_log>.<worker id> for every worker (before the
+ * privilege drop), into server->access_fds. Does nothing when the
+ * access_log key is unset. Returns 0 or -1.
+ */
+
+int zeus_access_log_open(zeus_server_t *server);
+
+/**
+ * Worker: attaches the buffer to its file, writing the file header when
+ * the file is new. Returns 0, or -1 when access logging stays off.
+ */
+
+int zeus_access_log_init(zeus_access_log_t *log, int fd);
+void zeus_access_log_flush(zeus_access_log_t *log);
+void zeus_access_log_destroy(zeus_access_log_t *log);
+
+/**
+ * Starts timing a request once its headers are in; header_bytes seeds
+ * bytes_in. Responses written afterwards add to bytes_out. Takes no
+ * clock reading when neither the access log nor metrics are on.
+ */
+
+void zeus_access_begin(zeus_conn_t *conn, uint64_t header_bytes);
+
+/**
+ * Monotonic clock in nanoseconds.
+ */
+
+uint64_t zeus_access_now(void);
+
+/**
+ * Marks the response as fully written (end_ns).
+ */
+
+void zeus_access_end(zeus_conn_t *conn);
+
+/**
+ * Appends the record of the request begun on conn (nothing when access
+ * logging is off) and closes the request's accounting.
+ */
+
+void zeus_access_record(zeus_conn_t *conn, const char *method, const char *path,
+                        uint16_t status, uint32_t stream_id);
+
+#endif // ZEUS_ACCESS_LOG_H
@@ -0,0 +1,199 @@
+/**
+ * include/core/buffer.h
+ * Per-worker pool of fixed-size I/O chunks and the output queues
+ * (chains of segments) built on it.
+ */
+
+#ifndef ZEUS_BUFFER_H
+#define ZEUS_BUFFER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/**
+ * One chunk holds a full TLS record (16 KB), so a chunk of the output
+ * chain maps to one SSL_write. Chunks are carved from slabs of
+ * ZEUS_BUF_SLAB_COUNT to keep malloc out of the per-request path.
+ */
+
+#define ZEUS_BUF_SIZE       (16 * 1024)
+#define ZEUS_BUF_SLAB_COUNT 32
+#define ZEUS_SEG_SLAB_COUNT 256
+
+typedef struct zeus_buf {
+    struct zeus_buf *next;      /** Next chunk in the free list. */
+    size_t start;               /** First byte not consumed yet. */
+    size_t end;                 /** End of valid data. */
+    char data[ZEUS_BUF_SIZE];
+} zeus_buf_t;
+
+/**
+ * Output segment kinds:
+ *  - ZEUS_SEG_BUF:  bytes copied into a pool chunk (owned).
+ *  - ZEUS_SEG_REF:  bytes owned by someone else, sent in place. Static
+ *                   data, caller data that zeus_chain_pin copies
+ *                   before the caller's buffer goes away, or shared
+ *                   data held until the release hook runs.
+ *  - ZEUS_SEG_FILE: a range of an open file; the fd is closed once the
+ *                   range is sent (or the chain is freed), or handed
+ *                   back through the release hook when it is shared.
+ */
+
+typedef enum {
+    ZEUS_SEG_BUF,
+    ZEUS_SEG_REF,
+    ZEUS_SEG_FILE
+} zeus_seg_type_t;
+
+typedef struct zeus_seg {
+    struct zeus_seg *next;
+    zeus_seg_type_t type;
+    int transient;              /** REF: data does not outlive the call that queued it. */
+
+    zeus_buf_t *buf;            /** BUF */
+    const char *ref;            /** REF: next byte to send. */
+    int fd;                     /** FILE */
+    off_t offset;               /** FILE: next byte to send. */
+    size_t len;                 /** REF / FILE: bytes left. */
+    void (*release)(void *);    /** REF / FILE: called when the segment is done (FILE: instead of close). */
+    void *release_arg;
+} zeus_seg_t;
+
+typedef struct zeus_buf_pool {
+    zeus_buf_t *free_list;
+    void **slabs;
+    size_t num_slabs;
+
+    zeus_seg_t *seg_free;
+    void **seg_slabs;
+    size_t num_seg_slabs;
+
+    size_t total;               /** Chunks allocated. */
+    size_t in_use;              /** Chunks attached to connections. */
+    size_t high_water;          /** Peak of in_use. */
+} zeus_buf_pool_t;
+
+/**
+ * FIFO of segments (output queue).
+ */
+
+typedef struct zeus_chain {
+    zeus_seg_t *head;
+    zeus_seg_t *tail;
+    size_t len;                 /** Bytes queued, file ranges included. */
+} zeus_chain_t;
+
+void zeus_buf_pool_init(zeus_buf_pool_t *pool);
+void zeus_buf_pool_destroy(zeus_buf_pool_t *pool);
+
+/**
+ * Takes a chunk from the pool (start = end = 0). NULL on OOM.
+ */
+
+zeus_buf_t *zeus_buf_get(zeus_buf_pool_t *pool);
+void zeus_buf_put(zeus_buf_pool_t *pool, zeus_buf_t *buf);
+
+/**
+ * Copies data at the end of the chain, filling the tail chunk first.
+ */
+
+int zeus_chain_append(zeus_buf_pool_t *pool, zeus_chain_t *chain, const void *data, size_t len);
+
+/**
+ * Queues data without copying it. With transient set, the bytes must
+ * be pinned (zeus_chain_pin) before the caller's buffer is released.
+ */
+
+int zeus_chain_append_ref(zeus_buf_pool_t *pool, zeus_chain_t *chain, const void *data, size_t len, int transient);
+
+/**
+ * Queues shared data without copying it. release(arg) is called once the
+ * bytes are sent or dropped (even on failure); until then data must stay
+ * valid.
+ */
+
+int zeus_chain_append_ref_shared(zeus_buf_pool_t *pool, zeus_chain_t *chain, const void *data, size_t len,
+                                 void (*release)(void *), void *arg);
+
+/**
+ * Queues len bytes of fd starting at offset. The chain owns fd from
+ * now on, even on failure.
+ */
+
+int zeus_chain_append_file(zeus_buf_pool_t *pool, zeus_chain_t *chain, int fd, off_t offset, size_t len);
+
+/**
+ * Same, for an fd the chain does not own: release(arg) is called once
+ * the range is done with (even on failure) and fd is left open.
+ */
+
+int zeus_chain_append_file_shared(zeus_buf_pool_t *pool, zeus_chain_t *chain, int fd, off_t offset, size_t len,
+                                  void (*release)(void *), void *arg);
+
+/**
+ * Writable space at the end of the chain, for producers that write in
+ * place (a compressor): returns the free bytes of the tail chunk,
+ * adding a fresh chunk when needed, and stores their count in avail.
+ * zeus_chain_commit then accounts for the bytes actually written; a
+ * fresh chunk left empty is taken off the chain again.
+ */
+
+char *zeus_chain_reserve(zeus_buf_pool_t *pool, zeus_chain_t *chain, size_t *avail);
+void zeus_chain_commit(zeus_buf_pool_t *pool, zeus_chain_t *chain, size_t n);
+
+/**
+ * Copies data in front of the chain (len <= ZEUS_BUF_SIZE). Used to put
+ * the status line before headers queued earlier.
+ */
+
+int zeus_chain_prepend(zeus_buf_pool_t *pool, zeus_chain_t *chain, const void *data, size_t len);
+
+/**
+ * Moves every segment of src to the end of dst, leaving src empty.
+ */
+
+void zeus_chain_concat(zeus_chain_t *dst, zeus_chain_t *src);
+
+/**
+ * Copies the transient references still queued into pool chunks.
+ */
+
+int zeus_chain_pin(zeus_buf_pool_t *pool, zeus_chain_t *chain);
+
+/**
+ * Fills iov with the memory segments at the front of the chain, up to
+ * the first file range. Returns the number of entries (0 when the chain
+ * starts with a file range or is empty).
+ */
+
+int zeus_chain_iov(const zeus_chain_t *chain, struct iovec *iov, int max);
+
+/**
+ * Copies up to max bytes from the front of the chain into dst without
+ * consuming them. Used to build whole TLS records out of small
+ * segments. File ranges are read with pread when with_files is set;
+ * otherwise copying stops at the first one. Returns the bytes copied
+ * or -1.
+ */
+
+ssize_t zeus_chain_copy_out(const zeus_chain_t *chain, char *dst, size_t max, int with_files);
+
+/**
+ * Drops n bytes from the front, returning emptied chunks to the pool and
+ * closing finished files.
+ */
+
+void zeus_chain_consume(zeus_buf_pool_t *pool, zeus_chain_t *chain, size_t n);
+
+void zeus_chain_free(zeus_buf_pool_t *pool, zeus_chain_t *chain);
+
+static inline int zeus_chain_empty(const zeus_chain_t *chain) {
+    return chain->head == NULL;
+}
+
+static inline size_t zeus_seg_len(const zeus_seg_t *seg) {
+    return seg->type == ZEUS_SEG_BUF ? seg->buf->end - seg->buf->start : seg->len;
+}
+
+#endif // ZEUS_BUFFER_H
@@ -7,15 +7,17 @@
 #include "../http/avl.h"
 #include "../config/config.h"  
 #include "io_event.h"
+#include "timer.h"
+#include "buffer.h"
+#include "access_log.h"
 
 #include <stddef.h>
+#include <sys/types.h>
+#include <sys/socket.h>
 
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 
-
-#define MAX_RESPONSE_BUFFER 4096
-
 typedef struct zeus_server zeus_server_t;
 typedef struct zeus_io_event zeus_io_event_t; 
 
@@ -24,6 +26,25 @@ typedef enum {
     PROTO_HTTP2
 } zeus_protocol_t;
 
+/**
+ * Which deadline the connection timer currently enforces.
+ */
+
+typedef enum {
+    CONN_TIMEOUT_NONE,
+    CONN_TIMEOUT_HANDSHAKE,     /** Absolute: TLS handshake. */
+    CONN_TIMEOUT_HEADER,        /** Absolute: request line + headers. */
+    CONN_TIMEOUT_BODY,          /** Idle: re-armed on every body read. */
+    CONN_TIMEOUT_KEEPALIVE,     /** Idle: between requests (and H2 frames). */
+    CONN_TIMEOUT_WRITE          /** Idle: re-armed on every write progress. */
+} zeus_conn_timeout_t;
+
+/**
+ * Chunks of ring_out handed to one io_uring send (see ring_io.h).
+ */
+
+#define ZEUS_RING_IOV 16
+
 /**
  * Represents a single HTTP connection (socket)
  */
@@ -35,9 +56,11 @@ typedef struct zeus_conn {
     int parser_state;               /** Current state of the HTTP State Machine. */
     size_t header_len_count;
     size_t headers_count;
-    char read_buffer[4096];         /** Fixed-size read buffer. */
+    zeus_buf_t *rbuf;               /** Read chunk, attached only while input is pending. */
+    char *read_buffer;              /** rbuf->data, NULL while the connection is idle. */
     size_t buffer_used;
     char *parse_cursor;             /** Current position in read_buffer for parsing. */
+    char *scan_cursor;              /** End of the bytes already searched for a line end. */
     
 
     volatile int fd;
@@ -45,15 +68,13 @@ typedef struct zeus_conn {
     volatile int closing;
     volatile int ready_to_free;
 
-    char response_buffer[MAX_RESPONSE_BUFFER];
-    size_t response_len;
-    size_t write_offset;
+    zeus_chain_t out;               /** Pending output: chunks, borrowed data and file ranges. */
 
     SSL *ssl_conn;                
     int handshake_done;             /** 0 = Handshake in progress, 1 = ready for R/W */
     int is_ssl;
+    int ktls_send;                  /** Kernel encrypts outgoing records (SSL_sendfile usable). */
 
-    zeus_request_t req;
     zeus_response_t res;
 
     zeus_protocol_t protocol;
@@ -71,11 +92,108 @@ typedef struct zeus_conn {
     uint32_t h2_max_streams;
     uint32_t h2_window_size;
 
-    int sendfile_fd;                /** File descriptor of file to be sended. */
-    size_t sendfile_size;           /** Total size of file */
-    off_t sendfile_offset;          /** File offset */
-    int is_sending_file;            /** Flag to distinguish between buffered and senfile I/O */
+    zeus_timer_t timer;             /** Deadline of the current phase (see timeout_phase). */
+    zeus_conn_timeout_t timeout_phase;
+
+    int keep_alive;                 /** Connection stays open after the current response. */
+    int http_minor;                 /** HTTP/1.x minor version of the current request. */
+    int head_request;               /** HEAD: the response goes out without its body. */
+    unsigned requests_served;       /** Responses completed on this connection. */
+    int in_parser;                  /** Parser is on the stack (pipelined requests wait). */
+
+    char *body_start;               /** Body bytes are decoded here; headers stay before it. */
+    uint64_t body_remaining;        /** Bytes left in the body (identity) or current chunk. */
+    int chunk_state;
+    zeus_body_mode_t body_mode;
+    zeus_body_cb body_cb;
+    zeus_handler_cb body_done_cb;
+    size_t body_max;                /** Limit of the buffered body. */
+
+    struct zeus_conn *pool_next;    /** Free-list link while in the worker pool. */
+
+    /**
+     * io_uring receive/send path (ring_io.h): ciphertext received and not
+     * read by OpenSSL yet, records written and not sent yet.
+     */
+
+    zeus_chain_t ring_in;
+    zeus_chain_t ring_out;
+    unsigned ring_state;            /** ZEUS_RING_* flags. */
+    int ring_error;                 /** errno of a failed receive or send, 0 if none. */
+    struct msghdr ring_msg;         /** Send in flight: iovecs over the front of ring_out. */
+    struct iovec ring_iov[ZEUS_RING_IOV];
+    struct zeus_conn *ring_next;    /** Link in the list of connections to service. */
+
+    zeus_access_stamp_t access;     /** Current request, for the access log. */
+
+    /**
+     * Kept last: recycling a connection only clears what comes before
+     * the request header array (see conn_pool.c).
+     */
+
+    zeus_request_t req;
 } zeus_conn_t;
 
+/**
+ * Reference counting (the accept path owns the first reference, which
+ * close_connection releases).
+ */
+
+void conn_ref(zeus_conn_t *c);
+void conn_unref(zeus_conn_t *c);
+
+/**
+ * Moves the connection timer to a new phase. Idle phases are re-armed on
+ * every call; absolute ones keep their original deadline.
+ */
+
+void zeus_conn_set_timeout(zeus_conn_t *conn, zeus_conn_timeout_t phase);
+
+/**
+ * Raw send (SSL_write or write). Returns the bytes written, 0 when the
+ * socket would block and -1 on error.
+ */
+
+ssize_t zeus_conn_send(zeus_conn_t *conn, const void *buf, size_t len);
+
+/**
+ * Output queue. The queue functions only add to the chain: a copy, a
+ * reference to data that outlives the flush (static) or a file range
+ * (the queue owns fd). zeus_conn_flush writes what the socket takes now
+ * and the rest on EPOLLOUT, in order; on error it closes the connection.
+ */
+
+int zeus_conn_queue(zeus_conn_t *conn, const void *data, size_t len);
+int zeus_conn_queue_ref(zeus_conn_t *conn, const void *data, size_t len);
+int zeus_conn_queue_file(zeus_conn_t *conn, int fd, off_t offset, size_t len);
+int zeus_conn_flush(zeus_conn_t *conn);
+
+/**
+ * zeus_conn_queue followed by zeus_conn_flush.
+ */
+
+int zeus_conn_write(zeus_conn_t *conn, const void *data, size_t len);
+
+/**
+ * HTTP/1.x response plumbing shared by the data and file senders:
+ * zeus_response_queue_head queues the status line, framing headers and
+ * blank line around the handler's headers; zeus_response_flush writes
+ * the queue and finishes the response, or parks it on EPOLLOUT.
+ * ZEUS_LENGTH_UNKNOWN frames a streamed body: chunked on HTTP/1.1,
+ * delimited by closing the connection on HTTP/1.0.
+ */
+
+#define ZEUS_LENGTH_UNKNOWN UINT64_MAX
+
+int zeus_response_queue_head(zeus_conn_t *conn, uint64_t content_length);
+int zeus_response_flush(zeus_conn_t *conn);
+
+/**
+ * Called once an HTTP/1.x response has been fully written. Either closes
+ * the connection or resets it for the next (possibly pipelined) request.
+ */
+
+void zeus_conn_finish_response(zeus_conn_t *conn);
+
 
 #endif // ZEUS_CONN_H
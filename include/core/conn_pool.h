@@ -0,0 +1,42 @@
+/**
+ * include/core/conn_pool.h
+ * Per-worker slab allocator for zeus_conn_t.
+ */
+
+#ifndef ZEUS_CONN_POOL_H
+#define ZEUS_CONN_POOL_H
+
+#include "conn.h"
+
+#include <stddef.h>
+
+/**
+ * Connections are carved from slabs of ZEUS_CONN_SLAB_COUNT and recycled
+ * through a free list, so accept/close never reach malloc once the
+ * worker has warmed up. Slabs are only released when the worker exits.
+ */
+
+#define ZEUS_CONN_SLAB_COUNT 64
+
+typedef struct zeus_conn_pool {
+    zeus_conn_t *free_list;
+    void **slabs;
+    size_t num_slabs;
+
+    size_t total;               /** Connections allocated. */
+    size_t in_use;              /** Connections handed out. */
+    size_t high_water;          /** Peak of in_use. */
+} zeus_conn_pool_t;
+
+void zeus_conn_pool_init(zeus_conn_pool_t *pool);
+void zeus_conn_pool_destroy(zeus_conn_pool_t *pool);
+
+/**
+ * Takes a connection from the pool, reset to its initial (zeroed) state.
+ * NULL on OOM.
+ */
+
+zeus_conn_t *zeus_conn_pool_get(zeus_conn_pool_t *pool);
+void zeus_conn_pool_put(zeus_conn_pool_t *pool, zeus_conn_t *conn);
+
+#endif // ZEUS_CONN_POOL_H
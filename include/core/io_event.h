@@ -16,6 +16,8 @@ typedef struct zeus_conn zeus_conn_t;
 typedef struct zeus_io_event {
     int fd;
     void *data;     /** Pointer to the associated zues_conn_t or server struct. */
+    uint32_t events;    /** Interest mask currently registered in the loop. */
+    int ring_io;        /** I/O runs on io_uring receives and sends, readiness is derived (ring_io.h). */
     void (*read_cb)(struct zeus_io_event *ev);
     void (*write_cb)(struct zeus_io_event *ev);
 } zeus_io_event_t;
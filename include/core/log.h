@@ -24,21 +24,67 @@
 
 void zeus_log(log_level_t level, const char *file, int line, const char *fmt, ...);
 
+/**
+ * Sends records to path (the log_file key; "stderr" keeps standard
+ * error). Opened in the master, before the workers fork and drop
+ * privileges. Returns 0 or -1, leaving the previous target in place.
+ */
+
+int zeus_log_open(const char *path);
+
+/**
+ * Buffers this process's records in a ring instead of writing each one.
+ * Called by every worker right after fork; the event loop then writes
+ * the ring out with zeus_log_flush before it waits for events. The ring
+ * is also flushed when it fills up, at exit and by a FATAL record.
+ */
+
+int zeus_log_start_async(void);
+void zeus_log_flush(void);
+
+/**
+ * Records below zeus_log_level (log_level in the configuration, INFO by
+ * default) are dropped before their arguments are evaluated.
+ */
+
+extern log_level_t zeus_log_level;
+
+void zeus_log_set_level(log_level_t level);
+
+/**
+ * Build-time floor: calls below ZEUS_LOG_MIN_LEVEL are constant-false
+ * and compiled out. The makefile sets it for the hot-path objects from
+ * LOG_MIN_LEVEL (e.g. make LOG_MIN_LEVEL=2 keeps WARN and up there).
+ */
+
+#ifndef ZEUS_LOG_MIN_LEVEL
+#define ZEUS_LOG_MIN_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+#define ZLOG_ENABLED(level) ((level) >= ZEUS_LOG_MIN_LEVEL && (level) >= zeus_log_level)
+
+#define ZLOG_AT(level, fmt, ...) do { \
+        if (ZLOG_ENABLED(level)) { \
+            zeus_log(level, __FILE__, __LINE__, fmt, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
 /**
  * Macro for error logging that includes the system error.
  */
 
- #define ZLOG_PERROR(fmt, ...) zeus_log(LOG_LEVEL_ERROR, __FILE__, __LINE__, fmt " (System Error: %s)", ##__VA_ARGS__, strerror(errno))
+ #define ZLOG_PERROR(fmt, ...) ZLOG_AT(LOG_LEVEL_ERROR, fmt " (System Error: %s)", ##__VA_ARGS__, strerror(errno))
 
 /**
  * Macros for standard logging, automatically capturing file and line.
+ * FATAL records are never filtered: they end the process.
  */
 
-#define ZLOG_DEBUG(fmt, ...)  zeus_log(LOG_LEVEL_INFO, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
-#define ZLOG_INFO(fmt, ...)  zeus_log(LOG_LEVEL_INFO, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
-#define ZLOG_ERROR(fmt, ...) zeus_log(LOG_LEVEL_ERROR, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
+#define ZLOG_DEBUG(fmt, ...) ZLOG_AT(LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+#define ZLOG_INFO(fmt, ...)  ZLOG_AT(LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#define ZLOG_WARN(fmt, ...)  ZLOG_AT(LOG_LEVEL_WARN, fmt, ##__VA_ARGS__)
+#define ZLOG_ERROR(fmt, ...) ZLOG_AT(LOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
 #define ZLOG_FATAL(fmt, ...) zeus_log(LOG_LEVEL_FATAL, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
-#define ZLOG_WARN(fmt, ...) zeus_log(LOG_LEVEL_FATAL, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
 
 
 #endif // ZEUS_LOG_H
\ No newline at end of file
@@ -0,0 +1,146 @@
+/**
+ * include/core/metrics.h
+ * Server-wide counters in a shared memory region mapped by the master
+ * before the workers fork. Each worker owns one cache-line aligned
+ * block and is its only writer, so updates take no lock and never
+ * bounce a line between cores; readers sum the blocks. The same goes
+ * for the per-route latency histograms that follow the blocks.
+ */
+
+#ifndef ZEUS_METRICS_H
+#define ZEUS_METRICS_H
+
+#include "../zeushttp.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define ZEUS_CACHE_LINE 64
+
+/**
+ * Blocks per worker id: the running worker's, and one for the
+ * replacement a reload starts while the old process still drains.
+ */
+
+#define ZEUS_METRICS_SLOTS_PER_WORKER 2
+
+/**
+ * One worker process's counters. conns_active is a gauge; everything
+ * else only grows over the life of the master (a respawned worker
+ * continues a block its worker id used before). Bytes are counted
+ * before TLS.
+ */
+
+typedef struct {
+    _Alignas(ZEUS_CACHE_LINE) uint64_t pid;
+    uint64_t spawns;
+    uint64_t conns_accepted;
+    uint64_t conns_closed;
+    uint64_t conns_active;
+    uint64_t handshakes;
+    uint64_t requests_h1;
+    uint64_t requests_h2;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t errors_handshake;      /** TLS handshake or ALPN failures. */
+    uint64_t errors_parse;          /** Malformed HTTP/1.x requests. */
+    uint64_t errors_io;             /** Failed reads and writes. */
+    uint64_t errors_timeout;        /** Connections closed by a deadline. */
+    uint64_t responses_4xx;
+    uint64_t responses_5xx;
+} zeus_metrics_block_t;
+
+/**
+ * Log-linear latency histogram in microseconds (HDR style): values
+ * below 2^SUB_BITS get a bucket each, every power of two above that is
+ * split into 2^SUB_BITS buckets, so any value is known within 1/16
+ * (6.25%). Values from 2^MAX_BITS us (about 67 s) up share the last
+ * bucket. The count is the sum of the buckets.
+ */
+
+#define ZEUS_HIST_SUB_BITS 4
+#define ZEUS_HIST_MAX_BITS 26
+#define ZEUS_HIST_BUCKETS ((ZEUS_HIST_MAX_BITS - ZEUS_HIST_SUB_BITS + 1) << ZEUS_HIST_SUB_BITS)
+
+typedef struct {
+    uint64_t sum_us;
+    uint64_t buckets[ZEUS_HIST_BUCKETS];
+} zeus_histogram_t;
+
+/**
+ * Latencies kept per route: until the first response byte is written,
+ * and until the last.
+ */
+
+typedef enum {
+    ZEUS_LATENCY_FIRST_BYTE,
+    ZEUS_LATENCY_TOTAL,
+    ZEUS_LATENCY_COUNT
+} zeus_latency_t;
+
+/**
+ * The calling worker's block, NULL in the master or when the region
+ * could not be mapped (the counters then cost one test).
+ */
+
+extern zeus_metrics_block_t *zeus_metrics_self;
+
+/**
+ * Relaxed atomic stores: single writer, readers see whole values.
+ */
+
+#define ZEUS_METRIC_ADD(field, n) do { \
+        if (zeus_metrics_self) { \
+            __atomic_store_n(&zeus_metrics_self->field, \
+                zeus_metrics_self->field + (uint64_t)(n), __ATOMIC_RELAXED); \
+        } \
+    } while (0)
+
+#define ZEUS_METRIC_INC(field) ZEUS_METRIC_ADD(field, 1)
+#define ZEUS_METRIC_DEC(field) ZEUS_METRIC_ADD(field, -1)
+
+/**
+ * Master: maps the shared region, one block and num_routes pairs of
+ * histograms per slot. Called once the routes are frozen. Returns 0
+ * or -1.
+ */
+
+int zeus_metrics_init(int num_workers, uint32_t num_routes);
+
+/**
+ * Master: zeus_metrics_claim picks a slot of worker_id that no living
+ * process owns (-1 when both are taken, e.g. a second reload before
+ * the first drained; that worker then runs without counters).
+ * zeus_metrics_assign records the forked owner and
+ * zeus_metrics_release frees its slot once waitpid reports it,
+ * returning that slot (-1 when pid had none).
+ */
+
+int zeus_metrics_claim(int worker_id);
+void zeus_metrics_assign(int slot, pid_t pid);
+int zeus_metrics_release(pid_t pid);
+
+/**
+ * Worker: takes the claimed slot right after fork.
+ */
+
+void zeus_metrics_attach(int slot);
+
+/**
+ * Counts a finished response by status class and, when it matched a
+ * route, adds its latencies (from conn->access) to the route's
+ * histograms. Called before zeus_access_record.
+ */
+
+void zeus_metrics_request_done(zeus_conn_t *conn, uint16_t status);
+
+/**
+ * Route handler serving all counters in the Prometheus text format:
+ * server totals, one series per worker, and p50/p90/p99/p999 of each
+ * route's latencies from the histograms of all workers merged.
+ */
+
+void zeus_metrics_handler(zeus_conn_t *conn, zeus_request_t *req);
+
+#endif // ZEUS_METRICS_H
@@ -0,0 +1,105 @@
+/**
+ * include/core/ring_io.h
+ * TLS connections on io_uring receives and sends (event_backend =
+ * io_uring). OpenSSL reads and writes a BIO of ours instead of the
+ * socket: ciphertext arrives through receives into provided buffers and
+ * waits on ring_in, records written wait on ring_out and leave with one
+ * sendmsg per connection, queued while the loop runs and submitted with
+ * the next wait. No readiness poll is armed; the callbacks keep their
+ * epoll contract, with readable meaning ring_in holds data (or the peer
+ * is gone) and writable meaning ring_out has room.
+ */
+
+#ifndef ZEUS_RING_IO_H
+#define ZEUS_RING_IO_H
+
+#ifdef __linux__
+
+#include "conn.h"
+#include "uring.h"
+
+#include <openssl/bio.h>
+
+#define ZEUS_RING_IN_MAX    (64 * 1024)     /** Receives pause above this until OpenSSL reads. */
+#define ZEUS_RING_OUT_MAX   (256 * 1024)    /** SSL_write would block above this. */
+#define ZEUS_RING_SEND_TIMEOUT  30          /** Seconds, when write_timeout is off. */
+
+/**
+ * ring_state flags.
+ */
+
+#define ZEUS_RING_RECVING   0x01    /** Receive in flight (holds a reference). */
+#define ZEUS_RING_SENDING   0x02    /** Send in flight (holds a reference). */
+#define ZEUS_RING_QUEUED    0x04    /** On the service list (holds a reference). */
+#define ZEUS_RING_WAKE      0x08    /** Readiness to report from the service list. */
+#define ZEUS_RING_EOF       0x10    /** The peer closed its side. */
+
+/**
+ * Per-worker state: the BIO method and the connections to service
+ * before the next wait.
+ */
+
+typedef struct zeus_ring_io {
+    BIO_METHOD *method;
+    zeus_conn_t *head;
+    zeus_conn_t *tail;
+    unsigned wakes;             /** Queued connections with ZEUS_RING_WAKE. */
+    struct __kernel_timespec send_timeout;  /** Bound of every send (write_timeout). */
+} zeus_ring_io_t;
+
+/**
+ * Sets up the receive buffers on server->uring and points
+ * server->ring_io at rio. Returns -1 when connections have to stay on
+ * readiness polls: ktls = on (kTLS needs OpenSSL on the socket), or a
+ * kernel without buffer rings.
+ */
+
+int zeus_ring_io_init(zeus_server_t *server, zeus_ring_io_t *rio);
+
+void zeus_ring_io_destroy(zeus_server_t *server);
+
+/**
+ * Puts a new connection's TLS on the ring and queues its first receive.
+ */
+
+int zeus_ring_io_attach(zeus_conn_t *conn);
+
+/**
+ * zeus_event_ctl for ring connections: records the interest and, like
+ * epoll, reports readiness that already holds.
+ */
+
+int zeus_ring_io_ctl(zeus_conn_t *conn, int op, uint32_t events);
+
+/**
+ * Handles a ZEUS_URING_TAG_RECV or ZEUS_URING_TAG_SEND completion.
+ */
+
+void zeus_ring_io_complete(zeus_server_t *server, const struct io_uring_cqe *cqe);
+
+/**
+ * Runs before every wait: reports deferred readiness, re-arms receives
+ * and queues the sends. Returns 1 when readiness was queued meanwhile,
+ * so the wait must not block.
+ */
+
+int zeus_ring_io_run(zeus_server_t *server);
+
+/**
+ * close_connection, after SSL_shutdown: cancels the receive and sends
+ * what is left (the end of the response, the close_notify). Returns 1
+ * when the fd is kept open until those sends complete and closed here,
+ * 0 when the caller closes it now.
+ */
+
+int zeus_ring_io_close(zeus_conn_t *conn);
+
+/**
+ * Last reference gone: drops the queued ciphertext.
+ */
+
+void zeus_ring_io_free(zeus_conn_t *conn);
+
+#endif // __linux__
+
+#endif // ZEUS_RING_IO_H
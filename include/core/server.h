@@ -7,7 +7,13 @@
 #define ZEUS_SERVER_H
 
 #include "conn.h"
+#include "timer.h"
+#include "buffer.h"
+#include "conn_pool.h"
 #include "../http/router.h"
+#include "../http/file_cache.h"
+#include "../http/compress.h"
+#include "access_log.h"
 
 #include <openssl/ssl.h>
 #include <openssl/err.h>
@@ -25,10 +31,22 @@ typedef struct zeus_server zeus_server_t;
 
 struct zeus_server {
     int listen_fd;      /** The file descriptor for the listeing socket. */
+    int *listen_fds;    /** Per-worker SO_REUSEPORT sockets (listen_mode = reuseport). */
+    int num_listen_fds;
+    int *access_fds;    /** Per-worker access log files, opened by the master. */
+    int num_access_fds;
+    int worker_id;      /** Index of the worker owning this copy (-1 in master). */
     int loop_fd;        /** The file descriptor for the epoll/kqueue instance. */
+    struct zeus_uring *uring;   /** io_uring ring when that backend is active (worker only). */
+    struct zeus_ring_io *ring_io;   /** Connections on io_uring receives/sends, NULL when polled. */
+    zeus_timer_wheel_t *timers; /** Per-worker timer wheel for connection timeouts. */
+    zeus_buf_pool_t *bufs;      /** Per-worker pool of read/write chunks. */
+    zeus_conn_pool_t *conns;    /** Per-worker connection slabs. */
+    zeus_file_cache_t *files;   /** Per-worker open-file cache. */
+    zeus_deflate_pool_t *deflate;   /** Per-worker gzip streams. */
+    zeus_access_log_t *access;      /** Per-worker access log buffer, NULL when off. */
     zeus_config_t config;   /** All server configuration */
     SSL_CTX *ssl_ctx;   /** The global TLS context (shared among worker.) */
-    zeus_route_node_t *router_root;
 };
 
 #endif // ZEUS_SERVER_H
\ No newline at end of file
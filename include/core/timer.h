@@ -0,0 +1,88 @@
+/**
+ * include/core/timer.h
+ * Hierarchical timer wheel used by each worker for connection timeouts.
+ */
+
+#ifndef ZEUS_TIMER_H
+#define ZEUS_TIMER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Wheel geometry: 4 levels of 64 slots with a 100 ms tick cover
+ * 6.4 s, 7 min, 7.5 h and 19 days respectively.
+ */
+
+#define ZEUS_TIMER_TICK_MS   100
+#define ZEUS_TIMER_LEVELS    4
+#define ZEUS_TIMER_SLOT_BITS 6
+#define ZEUS_TIMER_SLOTS     (1 << ZEUS_TIMER_SLOT_BITS)
+#define ZEUS_TIMER_SLOT_MASK (ZEUS_TIMER_SLOTS - 1)
+
+typedef struct zeus_timer zeus_timer_t;
+typedef void (*zeus_timer_cb)(zeus_timer_t *timer);
+
+/**
+ * Intrusive timer node, embedded in the object it guards.
+ */
+
+struct zeus_timer {
+    zeus_timer_t *next;
+    zeus_timer_t *prev;
+    uint64_t expires;       /** Absolute deadline, in ticks. */
+    zeus_timer_cb cb;
+    void *data;
+};
+
+typedef struct zeus_timer_wheel {
+    uint64_t tick;          /** Last tick processed by zeus_timer_expire. */
+    uint64_t origin_ms;     /** Monotonic time of tick 0. */
+    uint64_t now_ms;        /** Cached clock, refreshed once per loop iteration. */
+    size_t count;           /** Armed timers. */
+    zeus_timer_t slots[ZEUS_TIMER_LEVELS][ZEUS_TIMER_SLOTS];    /** List sentinels. */
+} zeus_timer_wheel_t;
+
+/**
+ * Monotonic clock in milliseconds.
+ */
+
+uint64_t zeus_monotonic_ms(void);
+
+void zeus_timer_wheel_init(zeus_timer_wheel_t *wheel);
+
+/**
+ * Refreshes the cached clock. Called right after the loop wakes up.
+ */
+
+void zeus_timer_update_clock(zeus_timer_wheel_t *wheel);
+
+void zeus_timer_init(zeus_timer_t *timer, zeus_timer_cb cb, void *data);
+
+/**
+ * Arms (or re-arms) a timer to fire timeout_ms from the cached clock.
+ * O(1): an unlink plus a list insert.
+ */
+
+void zeus_timer_arm(zeus_timer_wheel_t *wheel, zeus_timer_t *timer, uint32_t timeout_ms);
+
+void zeus_timer_cancel(zeus_timer_wheel_t *wheel, zeus_timer_t *timer);
+
+static inline int zeus_timer_pending(const zeus_timer_t *timer) {
+    return timer->next != NULL;
+}
+
+/**
+ * Milliseconds until the loop must wake up to run timers, -1 when no
+ * timer is armed. Used as the epoll_wait/io_uring timeout.
+ */
+
+int zeus_timer_next_timeout(zeus_timer_wheel_t *wheel);
+
+/**
+ * Advances the wheel up to the cached clock and runs expired timers.
+ */
+
+void zeus_timer_expire(zeus_timer_wheel_t *wheel);
+
+#endif // ZEUS_TIMER_H
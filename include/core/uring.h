@@ -0,0 +1,170 @@
+/**
+ * include/core/uring.h
+ * Minimal io_uring wrapper used by the io_uring event backend.
+ * Talks to the kernel through the raw syscalls, no liburing needed.
+ */
+
+#ifndef ZEUS_URING_H
+#define ZEUS_URING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+
+#define ZEUS_URING_ENTRIES 1024
+
+/**
+ * user_data tagging. Events are at least 8-byte aligned, so the low bits
+ * of the pointer tell which kind of operation produced a completion.
+ */
+
+#define ZEUS_URING_TAG_POLL    0x0ULL   /** Readiness for a zeus_io_event_t. */
+#define ZEUS_URING_TAG_ACCEPT  0x1ULL   /** Multishot accept on a listen socket. */
+#define ZEUS_URING_TAG_IGNORE  0x2ULL   /** Internal ops (poll removal) and stale entries. */
+#define ZEUS_URING_TAG_RECV    0x3ULL   /** Receive into a provided buffer (ring_io.h). */
+#define ZEUS_URING_TAG_SEND    0x4ULL   /** Send of queued output (ring_io.h). */
+#define ZEUS_URING_TAG_MASK    0x7ULL
+
+#define ZEUS_URING_UD(ptr, tag)   ((uint64_t)(uintptr_t)(ptr) | (tag))
+#define ZEUS_URING_UD_PTR(ud)     ((void *)(uintptr_t)((ud) & ~ZEUS_URING_TAG_MASK))
+#define ZEUS_URING_UD_TAG(ud)     ((ud) & ZEUS_URING_TAG_MASK)
+
+/**
+ * Provided receive buffers: the kernel picks one from the group when a
+ * receive completes, so sockets waiting for data hold no memory. Each
+ * buffer is handed back as soon as its bytes are copied out.
+ */
+
+#define ZEUS_URING_RECV_BUFS      128
+#define ZEUS_URING_RECV_BUF_SIZE  (16 * 1024)
+#define ZEUS_URING_BGID           0
+
+typedef struct zeus_uring {
+    int ring_fd;
+    unsigned features;
+
+    /** Submission queue (shared with the kernel). */
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned sq_entries;
+    struct io_uring_sqe *sqes;
+
+    /** Completion queue. */
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_ptr;
+    size_t sq_len;
+    void *cq_ptr;
+    size_t cq_len;
+    size_t sqes_len;
+
+    /** Provided receive buffers (zeus_uring_setup_recv_bufs). */
+    struct io_uring_buf_ring *buf_ring;
+    size_t buf_ring_len;
+    char *recv_bufs;
+    unsigned short buf_tail;
+} zeus_uring_t;
+
+/**
+ * Creates the ring. Returns -1 when the kernel (or a seccomp policy)
+ * does not allow io_uring, so callers can fall back to epoll.
+ */
+
+int zeus_uring_init(zeus_uring_t *ring, unsigned entries);
+
+void zeus_uring_destroy(zeus_uring_t *ring);
+
+/**
+ * Queues a multishot poll for fd. Nothing reaches the kernel until the
+ * next zeus_uring_submit/zeus_uring_wait call.
+ */
+
+int zeus_uring_poll_add(zeus_uring_t *ring, int fd, uint64_t user_data, uint32_t events);
+
+/**
+ * Queues the cancellation of a poll previously added with user_data.
+ */
+
+int zeus_uring_poll_remove(zeus_uring_t *ring, uint64_t user_data);
+
+/**
+ * Queues a multishot accept (one SQE, one CQE per accepted socket).
+ */
+
+int zeus_uring_accept_multishot(zeus_uring_t *ring, int fd, uint64_t user_data);
+
+/**
+ * Registers the provided receive buffers (5.19+). Returns -1 when the
+ * kernel does not support buffer rings.
+ */
+
+int zeus_uring_setup_recv_bufs(zeus_uring_t *ring);
+
+/**
+ * Queues a receive on fd into a buffer picked from the group. The
+ * completion carries the buffer id (IORING_CQE_F_BUFFER) when data
+ * arrived; the buffer must then be given back with zeus_uring_recycle_buf.
+ */
+
+int zeus_uring_recv(zeus_uring_t *ring, int fd, uint64_t user_data);
+
+const char *zeus_uring_recv_buf(zeus_uring_t *ring, unsigned bid);
+
+void zeus_uring_recycle_buf(zeus_uring_t *ring, unsigned bid);
+
+/**
+ * Queues a sendmsg. msg and the memory it points to must stay valid
+ * until the completion. With timeout set, a linked timeout cancels the
+ * send (-ECANCELED) when it does not complete in time; timeout must
+ * stay valid until the next submission.
+ */
+
+int zeus_uring_sendmsg(zeus_uring_t *ring, int fd, const struct msghdr *msg, uint64_t user_data,
+    const struct __kernel_timespec *timeout);
+
+/**
+ * Queues the cancellation of the operation submitted with user_data.
+ */
+
+int zeus_uring_cancel(zeus_uring_t *ring, uint64_t user_data);
+
+/**
+ * Submits every queued SQE without waiting.
+ */
+
+int zeus_uring_submit(zeus_uring_t *ring);
+
+/**
+ * Submits every queued SQE and waits for at least one completion in the
+ * same io_uring_enter call. timeout_ms < 0 waits forever.
+ */
+
+int zeus_uring_wait(zeus_uring_t *ring, int timeout_ms);
+
+/**
+ * Returns the next completion or NULL. zeus_uring_cqe_seen must be called
+ * once the entry has been consumed.
+ */
+
+struct io_uring_cqe *zeus_uring_peek_cqe(zeus_uring_t *ring);
+
+void zeus_uring_cqe_seen(zeus_uring_t *ring);
+
+/**
+ * Neutralises poll completions already posted for an event that is
+ * about to be released, so they are never dispatched.
+ */
+
+void zeus_uring_forget(zeus_uring_t *ring, const void *ptr);
+
+#endif // __linux__
+
+#endif // ZEUS_URING_H
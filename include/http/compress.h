@@ -0,0 +1,65 @@
+/**
+ * include/http/compress.h
+ * On-the-fly gzip for dynamic responses: a per-worker pool of deflate
+ * streams and the helpers that write compressed output into chains.
+ */
+
+#ifndef ZEUS_COMPRESS_H
+#define ZEUS_COMPRESS_H
+
+#include "../core/buffer.h"
+
+#include <stddef.h>
+#include <zlib.h>
+
+/**
+ * Idle streams kept per worker. A deflate stream costs a few hundred KB
+ * and its setup is the expensive part, so streams are reset and reused
+ * instead of being created per response.
+ */
+
+#define ZEUS_DEFLATE_POOL_MAX 16
+
+typedef struct zeus_deflate_pool {
+    z_stream *free[ZEUS_DEFLATE_POOL_MAX];
+    size_t num_free;
+    int level;
+
+    size_t created;             /** deflateInit2 calls. */
+    size_t in_use;
+    size_t high_water;
+} zeus_deflate_pool_t;
+
+void zeus_deflate_pool_init(zeus_deflate_pool_t *pool, int level);
+void zeus_deflate_pool_destroy(zeus_deflate_pool_t *pool);
+
+/**
+ * Returns a stream ready for a new gzip member, or NULL on OOM.
+ */
+
+z_stream *zeus_deflate_get(zeus_deflate_pool_t *pool);
+void zeus_deflate_put(zeus_deflate_pool_t *pool, z_stream *zs);
+
+/**
+ * Compresses len bytes of data into chain, written in place into pool
+ * chunks. flush is Z_NO_FLUSH, Z_SYNC_FLUSH or Z_FINISH. Returns 0 or -1.
+ */
+
+int zeus_deflate_chain(z_stream *zs, zeus_buf_pool_t *bufs, zeus_chain_t *chain,
+                       const void *data, size_t len, int flush);
+
+/**
+ * Content types worth compressing: text types, JSON, JavaScript, XML and
+ * SVG (parameters after ';' are ignored).
+ */
+
+int zeus_compress_type_allowed(const char *content_type);
+
+/**
+ * Returns 1 when an Accept-Encoding value allows coding: listed with a
+ * non-zero q, or covered by "*" without being listed.
+ */
+
+int zeus_encoding_accepted(const char *v, size_t len, const char *coding);
+
+#endif // ZEUS_COMPRESS_H
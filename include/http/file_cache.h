@@ -0,0 +1,120 @@
+/**
+ * include/http/file_cache.h
+ * Per-worker cache of open static files: fd, metadata and the
+ * pre-rendered header block, keyed by path.
+ */
+
+#ifndef ZEUS_FILE_CACHE_H
+#define ZEUS_FILE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+
+/**
+ * Room for the headers rendered once per file (Content-Type,
+ * Accept-Ranges, ETag and Last-Modified).
+ */
+
+#define ZEUS_FILE_HEADERS_MAX 256
+
+/**
+ * Precompressed siblings looked for next to each cached file, in order
+ * of preference. Bit i of an entry's variants is set when
+ * path + zeus_file_encodings[i].ext exists as a regular file.
+ */
+
+#define ZEUS_FILE_ENCODINGS 3
+
+typedef struct {
+    const char *name;           /** Content-Encoding / Accept-Encoding token. */
+    const char *ext;
+} zeus_file_encoding_t;
+
+extern const zeus_file_encoding_t zeus_file_encodings[ZEUS_FILE_ENCODINGS];
+
+typedef struct zeus_file_entry {
+    char *path;
+    uint32_t hash;
+    int fd;
+    off_t size;
+    time_t mtime;
+    ino_t ino;
+    dev_t dev;
+    const char *data;           /** Shared snapshot of a small file, or NULL. */
+    int shared;                 /** Its slot (file_shared.h). */
+    unsigned variants;          /** Precompressed siblings found (bit per encoding). */
+
+    char etag[48];              /** Quoted strong validator: "mtime-size" in hex. */
+    char last_modified[40];     /** IMF-fixdate of mtime. */
+    char headers[ZEUS_FILE_HEADERS_MAX];
+    size_t headers_len;
+    size_t type_len;            /** The Content-Type line opens headers; the validators follow. */
+
+    uint64_t validated_ms;      /** Last time the path was checked with stat. */
+    int refs;                   /** The cache's own reference plus in-flight responses. */
+    int cached;                 /** Still reachable from the table. */
+
+    struct zeus_file_entry *hnext;  /** Hash bucket chain. */
+    struct zeus_file_entry *prev;   /** LRU list, most recent first. */
+    struct zeus_file_entry *next;
+} zeus_file_entry_t;
+
+typedef struct zeus_file_cache {
+    zeus_file_entry_t **buckets;
+    size_t num_buckets;
+    size_t count;
+    size_t max_entries;         /** 0 disables caching (every lookup opens the file). */
+    uint64_t ttl_ms;            /** Revalidation interval. */
+    size_t memory_max;          /** Files up to this size are sent from a shared snapshot. */
+    int precompressed;          /** Look for precompressed siblings. */
+
+    zeus_file_entry_t *lru_head;
+    zeus_file_entry_t *lru_tail;
+
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+} zeus_file_cache_t;
+
+/**
+ * Cached files up to memory_max bytes are served from the snapshots
+ * all workers share (file_shared.h), read once when the first worker
+ * opens them.
+ */
+
+int zeus_file_cache_init(zeus_file_cache_t *cache, size_t max_entries, unsigned ttl_sec, size_t memory_max,
+                         int precompressed);
+void zeus_file_cache_destroy(zeus_file_cache_t *cache);
+
+/**
+ * Returns the entry for path with a reference held by the caller, or
+ * NULL (errno set) when the file cannot be opened or is not a regular
+ * file. A cached entry older than the TTL is revalidated with stat and
+ * reopened when the file changed; its precompressed siblings are looked
+ * for again at the same time. now_ms is the worker's cached clock.
+ */
+
+zeus_file_entry_t *zeus_file_cache_get(zeus_file_cache_t *cache, const char *path, uint64_t now_ms);
+
+/**
+ * Same for the precompressed sibling of path for encoding i
+ * (path + zeus_file_encodings[i].ext).
+ */
+
+zeus_file_entry_t *zeus_file_cache_get_variant(zeus_file_cache_t *cache, const char *path, int i, uint64_t now_ms);
+
+/**
+ * Drops a reference. The fd is closed and the entry freed once it is
+ * out of the cache and no response uses it any more.
+ */
+
+void zeus_file_entry_release(void *entry);
+
+static inline zeus_file_entry_t *zeus_file_entry_ref(zeus_file_entry_t *entry) {
+    entry->refs++;
+    return entry;
+}
+
+#endif // ZEUS_FILE_CACHE_H
@@ -0,0 +1,56 @@
+/**
+ * include/http/file_shared.h
+ * Snapshots of small static files in a shared memory region mapped by
+ * the master before the workers fork. The first worker to open a file
+ * reads it into a free slot; the others find it there by device,
+ * inode, size and mtime, so every worker serves the same pages instead
+ * of keeping a copy each. The region is anonymous memory: a file
+ * truncated or rewritten in place never changes a snapshot already
+ * published (no SIGBUS, no torn body).
+ */
+
+#ifndef ZEUS_FILE_SHARED_H
+#define ZEUS_FILE_SHARED_H
+
+#include <stddef.h>
+#include <sys/stat.h>
+
+/**
+ * Master: maps num_slots slots of size_max bytes, with reference
+ * counts for num_owners processes (the metrics slots, see
+ * zeus_metrics_claim). Pages are only backed once a file is stored in
+ * them. Does nothing when num_slots or size_max is 0. Returns 0 or -1.
+ */
+
+int zeus_file_shared_init(size_t num_slots, size_t size_max, int num_owners);
+
+/**
+ * Worker: uses owner's reference counts from now on. -1 (no metrics
+ * slot) leaves snapshots off, and small files are sent as ranges.
+ */
+
+void zeus_file_shared_attach(int owner);
+
+/**
+ * Master: drops the references a dead worker held, once waitpid
+ * reported it and before its slot is claimed again.
+ */
+
+void zeus_file_shared_release(int owner);
+
+/**
+ * Worker: the snapshot of the open file fd (st from fstat), read into
+ * the region when no worker did yet. Returns the data with a reference
+ * held and its slot in *slot, or NULL when the file is too large,
+ * every slot is in use, or it changed while being read.
+ */
+
+const char *zeus_file_shared_get(int fd, const struct stat *st, int *slot);
+
+/**
+ * Worker: drops a reference taken by zeus_file_shared_get.
+ */
+
+void zeus_file_shared_put(int slot);
+
+#endif // ZEUS_FILE_SHARED_H
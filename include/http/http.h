@@ -22,7 +22,27 @@
  * Security limits (adjustable).
  */
 #define MAX_HEADERS_LEN 8192        /** 8 KB total for all headers. */
-#define MAX_HEADERS 100             /** 100 headers maximum */
+
+/**
+ * Chunked body decoder states (PS_BODY_CHUNKED).
+ */
+
+enum {
+    CHUNK_SIZE,             /** Reading the chunk-size line */
+    CHUNK_DATA,             /** Reading chunk data */
+    CHUNK_DATA_END,         /** Reading the CRLF after chunk data */
+    CHUNK_TRAILER           /** Reading trailer fields until the empty line */
+};
+
+/**
+ * What happens to decoded body bytes.
+ */
+
+typedef enum {
+    BODY_DISCARD,           /** No consumer: dropped. */
+    BODY_STREAM,            /** Passed to the zeus_body_cb. */
+    BODY_BUFFER             /** Accumulated into req->body. */
+} zeus_body_mode_t;
 
 typedef struct zeus_conn zeus_conn_t;
 
@@ -32,6 +52,13 @@ typedef struct zeus_conn zeus_conn_t;
 
 void http_parser_run(zeus_conn_t *conn);
 
+/**
+ * Releases the body state of the current request (buffered body,
+ * callbacks). Called when the connection is reset or closed.
+ */
+
+void http_request_reset_body(zeus_conn_t *conn);
+
 /**
  * Dispatches the request to the correct user handler based on the path.
  */
@@ -0,0 +1,41 @@
+/**
+ * include/http/http_scan.h
+ * Character-class scanners used by the HTTP/1.x parser. Each scanner has
+ * an AVX2, an SSE4.2 and a portable scalar implementation; the fastest
+ * one supported by the CPU is picked at runtime (CPUID).
+ */
+
+#ifndef ZEUS_HTTP_SCAN_H
+#define ZEUS_HTTP_SCAN_H
+
+#include <stddef.h>
+
+/**
+ * Selects the implementation for this CPU. Optional: the scanners
+ * resolve themselves on first use.
+ */
+
+void zeus_http_scan_init(void);
+
+/**
+ * Name of the selected implementation ("avx2", "sse4.2" or "scalar").
+ */
+
+const char *zeus_http_scan_impl(void);
+
+/**
+ * Returns the index of the first byte that is not a token character
+ * (RFC 9110 tchar), or len when the whole range is a token.
+ */
+
+size_t zeus_http_scan_token(const char *p, size_t len);
+
+/**
+ * Returns the index of the first control character other than HT
+ * (CR and LF included), or len when there is none. Used to find line
+ * ends and to reject illegal bytes in field values in the same pass.
+ */
+
+size_t zeus_http_scan_field(const char *p, size_t len);
+
+#endif // ZEUS_HTTP_SCAN_H
@@ -0,0 +1,33 @@
+/**
+ * include/http/mime.h
+ * File extension to Content-Type mapping. The built-in table and the
+ * mime_type overrides from the configuration are compiled into a
+ * minimal perfect hash when the server starts: a lookup is one probe
+ * and one comparison.
+ */
+
+#ifndef ZEUS_MIME_H
+#define ZEUS_MIME_H
+
+#include "../config/config.h"
+
+#include <stddef.h>
+
+#define ZEUS_MIME_DEFAULT "application/octet-stream"
+
+/**
+ * Builds the table. Called once in the master, before the workers are
+ * forked; they share it read-only. Returns 0 or -1 (out of memory).
+ */
+
+int zeus_mime_init(const zeus_config_t *config);
+void zeus_mime_destroy(void);
+
+/**
+ * Content type for the extension of path (case-insensitive), or
+ * ZEUS_MIME_DEFAULT when it has none or an unknown one.
+ */
+
+const char *zeus_mime_type(const char *path);
+
+#endif // ZEUS_MIME_H
@@ -4,6 +4,9 @@
 #include "../core/conn.h"
 #include "../http/http.h"
 
+#include <stdint.h>
+#include <stdio.h>
+
 /**
  * Handler function prototype (callback). Receiveis the connection
  * for I/O and request.
@@ -12,37 +15,73 @@
 typedef void (*zeus_handler_cb)(zeus_conn_t *conn, zeus_request_t *req);
 
 /**
- * Structure that defines a route in the server.
+ * Methods a route can be registered for; each is one bit of a node's
+ * method set.
  */
 
-#define MAX_METHOD_LEN 8
-#define MAX_PATH_LEN 256
+typedef enum {
+    ZEUS_METHOD_GET,
+    ZEUS_METHOD_HEAD,
+    ZEUS_METHOD_POST,
+    ZEUS_METHOD_PUT,
+    ZEUS_METHOD_DELETE,
+    ZEUS_METHOD_PATCH,
+    ZEUS_METHOD_OPTIONS,
+    ZEUS_METHOD_CONNECT,
+    ZEUS_METHOD_TRACE,
+    ZEUS_METHOD_COUNT
+} zeus_method_t;
 
-typedef struct {
-    char *path;
-    zeus_handler_cb handler;
+/**
+ * Register a new handler (function) for a method and path specified.
+ *
+ * The method is one of zeus_method_t by name, or "*" for all of them.
+ * In the path, ":name" matches one segment and "*name" the rest of the
+ * path (last segment only); both are captured as request parameters.
+ * Static segments win over parameters, parameters over wildcards.
+ */
 
-    struct zeus_route_node *left;
-    struct zeus_route_node *right;
-    int height;
-} zeus_route_node_t;
+int register_route(const char *method, const char *path, zeus_handler_cb handler);
 
-typedef struct {
-    char method[MAX_METHOD_LEN];
-    char path[MAX_PATH_LEN];
-    zeus_handler_cb handler;
-} zeus_route_t;
+/**
+ * Compiles the registered routes into the read-only lookup table and
+ * frees the tree they were collected in. Called by the master before it
+ * forks; routes registered later are refused. Returns 0 or -1.
+ */
+
+int router_freeze(void);
 
 /**
- * Register a new handler (function) for a method and path specified.
+ * Prints the frozen table as a tree, one node per line, with the
+ * methods and pattern of each route.
  */
 
-int register_route(const char *method, const char *path, zeus_handler_cb handler);
+void router_dump(FILE *out);
 
 /**
  * The main dispatcher: Finds a new route and call their handler.
+ * Unknown paths get a 404, known paths without a handler for the
+ * method a 405 with an Allow header.
  */
 
 void router_dispatch(zeus_conn_t *conn);
 
-#endif // ZEUS_ROUTER_H
\ No newline at end of file
+/**
+ * Finds the route for method and path in the shared tree, filling the
+ * request parameters. Returns the handler with its route id in *route,
+ * or NULL with *status set to 404 or 405.
+ */
+
+zeus_handler_cb router_match(const char *method, const char *path, zeus_request_t *req,
+                             uint16_t *status, uint32_t *route);
+
+/**
+ * Routes are numbered 0 .. router_route_count() - 1 once frozen, one
+ * id per method and pattern. router_route_info names a route (for
+ * metrics labels); it returns -1 for an unknown id.
+ */
+
+uint32_t router_route_count(void);
+int router_route_info(uint32_t route, const char **method, const char **pattern);
+
+#endif // ZEUS_ROUTER_H
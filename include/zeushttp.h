@@ -13,11 +13,33 @@
 
 #define MAX_HEADERS 32
 
+/**
+ * A request header, as a view into the connection read buffer (valid
+ * until the response is finished). Both views are also NUL-terminated.
+ */
+
 typedef struct {
-    char *name;
-    char *value;
+    const char *name;
+    size_t name_len;
+    const char *value;
+    size_t value_len;
 } http_header_t;
 
+/**
+ * A route parameter (":name" or "*name" segment). The name points into
+ * the route table, the value into the request path; the value is not
+ * NUL-terminated.
+ */
+
+#define MAX_PARAMS 8
+
+typedef struct {
+    const char *name;
+    size_t name_len;
+    const char *value;
+    size_t value_len;
+} zeus_param_t;
+
 /**
  * Main server structure (contains the event loop and listening socket).
  */
@@ -34,8 +56,19 @@ typedef struct zeus_request {
     char *path;       /** Decoded request URI path. */
     char *version;     
 
-    http_header_t headers[MAX_HEADERS];
     size_t num_headers;
+
+    int64_t content_length;     /** Declared body length, -1 when absent or chunked. */
+    int chunked;                /** Body uses chunked transfer coding. */
+
+    char *body;                 /** Whole body, only in zeus_request_buffer_body mode. */
+    size_t body_len;
+
+    void *user_data;            /** Free for handler use until the response is done. */
+    size_t num_params;
+
+    http_header_t headers[MAX_HEADERS];     /** Only the first num_headers are valid. */
+    zeus_param_t params[MAX_PARAMS];        /** Only the first num_params are valid. */
 } zeus_request_t;
 
 /**
@@ -47,6 +80,12 @@ typedef struct zeus_response {
     /** 
      * Internal pointer to connection for writing data.
      */
+
+    uint8_t compressible;   /** Content-Type set by the handler is on the gzip allowlist. */
+    uint8_t encoded;        /** Handler set Content-Encoding itself. */
+    uint8_t streaming;      /** Between zeus_response_begin and zeus_response_end. */
+    uint8_t chunked;        /** Streamed body uses chunked transfer coding. */
+    void *deflate;          /** Compressor of a gzip stream (z_stream), from the worker pool. */
 } zeus_response_t;
 
 
@@ -56,6 +95,13 @@ typedef struct zeus_response {
 
 typedef void (*zeus_handler_cb)(zeus_conn_t *conn, zeus_request_t *req);
 
+/**
+ * Receives the request body piece by piece as it is decoded. Called one
+ * last time with data == NULL and len == 0 at the end of the body.
+ */
+
+typedef void (*zeus_body_cb)(zeus_conn_t *conn, zeus_request_t *req, const char *data, size_t len);
+
 
 /**
  * Initializes the ZeusHTTP server and allocates resources.
@@ -75,6 +121,35 @@ int zeus_server_add_handler(zeus_server_t *server, const char *path, zeus_handle
 
 int zeus_server_run(zeus_server_t *server);
 
+/**
+ * Looks up a request header by name (case-insensitive). Returns the value
+ * and stores its length in len, or NULL when the header is absent.
+ */
+
+const char *zeus_request_header(const zeus_request_t *req, const char *name, size_t *len);
+
+/**
+ * Looks up a route parameter by name. Returns a view into the request
+ * path and stores its length in len, or NULL when the route has no such
+ * parameter.
+ */
+
+const char *zeus_request_param(const zeus_request_t *req, const char *name, size_t *len);
+
+/**
+ * Streams the request body to cb. Must be called from the route handler;
+ * a body nobody asked for is discarded.
+ */
+
+int zeus_request_on_body(zeus_conn_t *conn, zeus_body_cb cb);
+
+/**
+ * Buffers the whole request body (at most max_len bytes) into req->body
+ * and calls done once it is complete. Larger bodies get a 413 response.
+ */
+
+int zeus_request_buffer_body(zeus_conn_t *conn, size_t max_len, zeus_handler_cb done);
+
 /**
  * Sets the HTTP status code for the response.
  */
@@ -93,6 +168,18 @@ int zeus_response_add_header(zeus_response_t *res, const char *key, const char *
 
 int zeus_response_send_data(zeus_response_t *res, const char *data, size_t len);
 
+/**
+ * Streams a response whose length is not known up front: begin sends the
+ * head (chunked on HTTP/1.1, close-delimited on HTTP/1.0), each write
+ * sends one piece of the body and end completes it. When gzip is
+ * negotiated the pieces are compressed as they go, so large responses
+ * are never held whole.
+ */
+
+int zeus_response_begin(zeus_response_t *res);
+int zeus_response_write(zeus_response_t *res, const char *data, size_t len);
+int zeus_response_end(zeus_response_t *res);
+
 /**
  * Sends a static file using zero-copy (sendfile/io_uring).
  */
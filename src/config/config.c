@@ -25,6 +25,28 @@ static config_key_t get_key_id(const char *key) {
     if (strcmp(key, "tls_cert_path") == 0) return CONFIG_KEY_TLS_CERT_PATH;
     if (strcmp(key, "tls_key_path") == 0) return CONFIG_KEY_TLS_KEY_PATH;
     if (strcmp(key, "log_file") == 0) return CONFIG_KEY_LOG_FILE;
+    if (strcmp(key, "listen_mode") == 0) return CONFIG_KEY_LISTEN_MODE;
+    if (strcmp(key, "event_backend") == 0) return CONFIG_KEY_EVENT_BACKEND;
+    if (strcmp(key, "handshake_timeout") == 0) return CONFIG_KEY_HANDSHAKE_TIMEOUT;
+    if (strcmp(key, "header_timeout") == 0) return CONFIG_KEY_HEADER_TIMEOUT;
+    if (strcmp(key, "body_timeout") == 0) return CONFIG_KEY_BODY_TIMEOUT;
+    if (strcmp(key, "keepalive_timeout") == 0) return CONFIG_KEY_KEEPALIVE_TIMEOUT;
+    if (strcmp(key, "write_timeout") == 0) return CONFIG_KEY_WRITE_TIMEOUT;
+    if (strcmp(key, "max_keepalive_requests") == 0) return CONFIG_KEY_MAX_KEEPALIVE_REQUESTS;
+    if (strcmp(key, "ktls") == 0) return CONFIG_KEY_KTLS;
+    if (strcmp(key, "file_cache_size") == 0) return CONFIG_KEY_FILE_CACHE_SIZE;
+    if (strcmp(key, "file_cache_ttl") == 0) return CONFIG_KEY_FILE_CACHE_TTL;
+    if (strcmp(key, "file_cache_memory_max") == 0) return CONFIG_KEY_FILE_CACHE_MEMORY_MAX;
+    if (strcmp(key, "precompressed") == 0) return CONFIG_KEY_PRECOMPRESSED;
+    if (strcmp(key, "gzip") == 0) return CONFIG_KEY_GZIP;
+    if (strcmp(key, "gzip_level") == 0) return CONFIG_KEY_GZIP_LEVEL;
+    if (strcmp(key, "gzip_min_length") == 0) return CONFIG_KEY_GZIP_MIN_LENGTH;
+    if (strcmp(key, "mime_type") == 0) return CONFIG_KEY_MIME_TYPE;
+    if (strcmp(key, "dump_routes") == 0) return CONFIG_KEY_DUMP_ROUTES;
+    if (strcmp(key, "log_level") == 0) return CONFIG_KEY_LOG_LEVEL;
+    if (strcmp(key, "access_log") == 0) return CONFIG_KEY_ACCESS_LOG;
+    if (strcmp(key, "metrics") == 0) return CONFIG_KEY_METRICS;
+    if (strcmp(key, "metrics_path") == 0) return CONFIG_KEY_METRICS_PATH;
 
     return CONFIG_KEY_UNKNOWN;
 }
@@ -57,6 +79,38 @@ static char *trim_whitesapce(char *str) {
     return str;
 }
 
+/**
+ * Parses "<ext> <type>" (the extension may start with a dot) into the
+ * next mime_types slot.
+ */
+
+static int parse_mime_type(zeus_config_t *config, char *value) {
+    char *type = value + strcspn(value, " \t");
+    if (*type == '\0' || config->num_mime_types == ZEUS_MAX_MIME_TYPES) {
+        return -1;
+    }
+    *type++ = '\0';
+    type = trim_whitesapce(type);
+
+    if (*value == '.') {
+        value++;
+    }
+
+    size_t ext_len = strlen(value);
+    size_t type_len = strlen(type);
+    if (ext_len == 0 || ext_len >= ZEUS_MIME_EXT_MAX || type_len == 0 || type_len >= ZEUS_MIME_TYPE_MAX ||
+        strchr(type, '\r') || strchr(type, '\n')) {
+        return -1;
+    }
+
+    zeus_mime_override_t *m = &config->mime_types[config->num_mime_types++];
+    for (size_t i = 0; i <= ext_len; i++) {
+        m->ext[i] = (char)tolower((unsigned char)value[i]);
+    }
+    memcpy(m->type, type, type_len + 1);
+    return 0;
+}
+
 /**
  * Initiate the configuration with default value.
  */
@@ -69,8 +123,31 @@ void zeus_config_init_default(zeus_config_t *config) {
     strncpy(config->bind_host, "127.0.0.1", sizeof(config->bind_host));
     config->bind_port = DEFAULT_PORT;
     config->num_workers = DEFAULT_WORKERS;
+    config->listen_mode = DEFAULT_LISTEN_MODE;
+    config->event_backend = DEFAULT_EVENT_BACKEND;
+
+    config->handshake_timeout = DEFAULT_HANDSHAKE_TIMEOUT;
+    config->header_timeout = DEFAULT_HEADER_TIMEOUT;
+    config->body_timeout = DEFAULT_BODY_TIMEOUT;
+    config->keepalive_timeout = DEFAULT_KEEPALIVE_TIMEOUT;
+    config->write_timeout = DEFAULT_WRITE_TIMEOUT;
+    config->max_keepalive_requests = DEFAULT_MAX_KEEPALIVE_REQUESTS;
+    config->ktls = DEFAULT_KTLS;
+    config->file_cache_size = DEFAULT_FILE_CACHE_SIZE;
+    config->file_cache_ttl = DEFAULT_FILE_CACHE_TTL;
+    config->file_cache_memory_max = DEFAULT_FILE_CACHE_MEMORY_MAX;
+    config->precompressed = DEFAULT_PRECOMPRESSED;
+    config->gzip = DEFAULT_GZIP;
+    config->gzip_level = DEFAULT_GZIP_LEVEL;
+    config->gzip_min_length = DEFAULT_GZIP_MIN_LENGTH;
+    config->num_mime_types = 0;
+    config->dump_routes = DEFAULT_DUMP_ROUTES;
+    config->log_level = DEFAULT_LOG_LEVEL;
 
     strncpy(config->log_file, "stderr", sizeof(config->log_file));
+    config->access_log[0] = '\0';
+    config->metrics = DEFAULT_METRICS;
+    strncpy(config->metrics_path, DEFAULT_METRICS_PATH, sizeof(config->metrics_path));
     strncpy(config->tls_cert_path, "certs/server.crt", sizeof(config->tls_cert_path));
     strncpy(config->tls_key_path, "certs/server.key", sizeof(config->tls_key_path));
 
@@ -138,6 +215,143 @@ int zeus_config_load(zeus_config_t *config, const char *config_path) {
             case CONFIG_KEY_LOG_FILE:
                 strncpy(config->log_file, value, sizeof(config->log_file) - 1);
                 break;
+            case CONFIG_KEY_LISTEN_MODE:
+                if (strcmp(value, "shared") == 0) {
+                    config->listen_mode = ZEUS_LISTEN_SHARED;
+                } else if (strcmp(value, "reuseport") == 0) {
+                    config->listen_mode = ZEUS_LISTEN_REUSEPORT;
+                } else {
+                    ZLOG_ERROR("Config: Invalid listen_mode '%s' at line %d. Using 'shared'.", value, line_num);
+                    config->listen_mode = ZEUS_LISTEN_SHARED;
+                }
+                break;
+            case CONFIG_KEY_EVENT_BACKEND:
+                if (strcmp(value, "epoll") == 0) {
+                    config->event_backend = ZEUS_BACKEND_EPOLL;
+                } else if (strcmp(value, "io_uring") == 0) {
+                    config->event_backend = ZEUS_BACKEND_IO_URING;
+                } else {
+                    ZLOG_ERROR("Config: Invalid event_backend '%s' at line %d. Using 'epoll'.", value, line_num);
+                    config->event_backend = ZEUS_BACKEND_EPOLL;
+                }
+                break;
+            case CONFIG_KEY_HANDSHAKE_TIMEOUT:
+                config->handshake_timeout = atoi(value);
+                break;
+            case CONFIG_KEY_HEADER_TIMEOUT:
+                config->header_timeout = atoi(value);
+                break;
+            case CONFIG_KEY_BODY_TIMEOUT:
+                config->body_timeout = atoi(value);
+                break;
+            case CONFIG_KEY_KEEPALIVE_TIMEOUT:
+                config->keepalive_timeout = atoi(value);
+                break;
+            case CONFIG_KEY_WRITE_TIMEOUT:
+                config->write_timeout = atoi(value);
+                break;
+            case CONFIG_KEY_MAX_KEEPALIVE_REQUESTS:
+                config->max_keepalive_requests = atoi(value);
+                break;
+            case CONFIG_KEY_KTLS:
+                if (strcmp(value, "on") == 0) {
+                    config->ktls = 1;
+                } else if (strcmp(value, "off") == 0) {
+                    config->ktls = 0;
+                } else {
+                    ZLOG_ERROR("Config: Invalid ktls '%s' at line %d. Using 'off'.", value, line_num);
+                    config->ktls = 0;
+                }
+                break;
+            case CONFIG_KEY_FILE_CACHE_SIZE:
+                config->file_cache_size = atoi(value);
+                break;
+            case CONFIG_KEY_FILE_CACHE_TTL:
+                config->file_cache_ttl = atoi(value);
+                break;
+            case CONFIG_KEY_FILE_CACHE_MEMORY_MAX:
+                config->file_cache_memory_max = atoi(value);
+                break;
+            case CONFIG_KEY_PRECOMPRESSED:
+                if (strcmp(value, "on") == 0) {
+                    config->precompressed = 1;
+                } else if (strcmp(value, "off") == 0) {
+                    config->precompressed = 0;
+                } else {
+                    ZLOG_ERROR("Config: Invalid precompressed '%s' at line %d. Using 'on'.", value, line_num);
+                    config->precompressed = 1;
+                }
+                break;
+            case CONFIG_KEY_GZIP:
+                if (strcmp(value, "on") == 0) {
+                    config->gzip = 1;
+                } else if (strcmp(value, "off") == 0) {
+                    config->gzip = 0;
+                } else {
+                    ZLOG_ERROR("Config: Invalid gzip '%s' at line %d. Using 'off'.", value, line_num);
+                    config->gzip = 0;
+                }
+                break;
+            case CONFIG_KEY_GZIP_LEVEL:
+                config->gzip_level = atoi(value);
+                if (config->gzip_level < 1 || config->gzip_level > 9) {
+                    ZLOG_ERROR("Config: Invalid gzip_level '%s' at line %d. Using %d.", value, line_num, DEFAULT_GZIP_LEVEL);
+                    config->gzip_level = DEFAULT_GZIP_LEVEL;
+                }
+                break;
+            case CONFIG_KEY_GZIP_MIN_LENGTH:
+                config->gzip_min_length = atoi(value);
+                break;
+            case CONFIG_KEY_MIME_TYPE:
+                if (parse_mime_type(config, value) < 0) {
+                    ZLOG_ERROR("Config: Invalid mime_type '%s' at line %d. Ignoring.", value, line_num);
+                }
+                break;
+            case CONFIG_KEY_DUMP_ROUTES:
+                if (strcmp(value, "on") == 0) {
+                    config->dump_routes = 1;
+                } else if (strcmp(value, "off") == 0) {
+                    config->dump_routes = 0;
+                } else {
+                    ZLOG_ERROR("Config: Invalid dump_routes '%s' at line %d. Using 'off'.", value, line_num);
+                    config->dump_routes = 0;
+                }
+                break;
+            case CONFIG_KEY_LOG_LEVEL:
+                if (strcmp(value, "debug") == 0) {
+                    config->log_level = LOG_LEVEL_DEBUG;
+                } else if (strcmp(value, "info") == 0) {
+                    config->log_level = LOG_LEVEL_INFO;
+                } else if (strcmp(value, "warn") == 0) {
+                    config->log_level = LOG_LEVEL_WARN;
+                } else if (strcmp(value, "error") == 0) {
+                    config->log_level = LOG_LEVEL_ERROR;
+                } else {
+                    ZLOG_ERROR("Config: Invalid log_level '%s' at line %d. Using 'info'.", value, line_num);
+                    config->log_level = DEFAULT_LOG_LEVEL;
+                }
+                break;
+            case CONFIG_KEY_ACCESS_LOG:
+                strncpy(config->access_log, value, sizeof(config->access_log) - 1);
+                break;
+            case CONFIG_KEY_METRICS:
+                if (strcmp(value, "on") == 0) {
+                    config->metrics = 1;
+                } else if (strcmp(value, "off") == 0) {
+                    config->metrics = 0;
+                } else {
+                    ZLOG_ERROR("Config: Invalid metrics '%s' at line %d. Using 'off'.", value, line_num);
+                    config->metrics = 0;
+                }
+                break;
+            case CONFIG_KEY_METRICS_PATH:
+                if (value[0] != '/') {
+                    ZLOG_ERROR("Config: Invalid metrics_path '%s' at line %d. Using '%s'.",
+                        value, line_num, DEFAULT_METRICS_PATH);
+                } else {
+                    strncpy(config->metrics_path, value, sizeof(config->metrics_path) - 1);
+                }
+                break;
             case CONFIG_KEY_UNKNOWN:
             default:
                 ZLOG_FATAL("Config: Unknown key '%s' found at line. Ignoring.", key, line_num);
@@ -0,0 +1,262 @@
+/**
+ * access_log.c
+ * Binary access log records: built with a few stores and a memcpy of
+ * the path, buffered per worker and written in one write per loop
+ * iteration (or when the buffer is full).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../../include/core/access_log.h"
+#include "../../include/core/conn.h"
+#include "../../include/core/server.h"
+#include "../../include/core/log.h"
+#include "../../include/core/metrics.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <openssl/ssl.h>
+
+#define ZEUS_ACCESS_BUF_SIZE (64 * 1024)
+
+int zeus_access_log_open(zeus_server_t *server) {
+    const char *path = server->config.access_log;
+    int count = server->config.num_workers > 0 ? server->config.num_workers : 1;
+
+    if (path[0] == '\0') {
+        return 0;
+    }
+
+    server->access_fds = malloc(sizeof(int) * (size_t)count);
+    if (!server->access_fds) {
+        return -1;
+    }
+    server->num_access_fds = count;
+
+    for (int i = 0; i < count; i++) {
+        char name[sizeof(server->config.access_log) + 16];
+
+        snprintf(name, sizeof(name), "%s.%d", path, i);
+        server->access_fds[i] = open(name, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0640);
+
+        if (server->access_fds[i] < 0) {
+            ZLOG_PERROR("Access log: cannot open '%s'", name);
+            while (i-- > 0) {
+                close(server->access_fds[i]);
+            }
+            free(server->access_fds);
+            server->access_fds = NULL;
+            server->num_access_fds = 0;
+            return -1;
+        }
+    }
+
+    ZLOG_INFO("Access log: %s.0 .. %s.%d (binary, read with zeus-logcat).", path, path, count - 1);
+    return 0;
+}
+
+int zeus_access_log_init(zeus_access_log_t *log, int fd) {
+    struct stat st;
+
+    memset(log, 0, sizeof(*log));
+    log->fd = -1;
+
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        return -1;
+    }
+
+    log->buf = malloc(ZEUS_ACCESS_BUF_SIZE);
+    if (!log->buf) {
+        return -1;
+    }
+
+    log->fd = fd;
+    log->cap = ZEUS_ACCESS_BUF_SIZE;
+    log->pid = (uint32_t)getpid();
+
+    /**
+     * A respawned worker appends to the file of the one it replaces.
+     */
+
+    if (st.st_size == 0) {
+        zeus_access_file_t header;
+
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, ZEUS_ACCESS_MAGIC, sizeof(header.magic));
+        header.version = ZEUS_ACCESS_VERSION;
+        header.record_size = sizeof(zeus_access_record_t);
+        header.byte_order = ZEUS_ACCESS_BYTE_ORDER;
+
+        memcpy(log->buf, &header, sizeof(header));
+        log->len = sizeof(header);
+        log->head = sizeof(header);
+    }
+    return 0;
+}
+
+/**
+ * Drops the records a failed write did not get out completely. A record
+ * written only in part is cut off the file again, so the file still
+ * ends on a record boundary and later records decode. A file header
+ * that did not make it stays queued for the next flush.
+ */
+
+static void zeus_access_log_drop(zeus_access_log_t *log, size_t written) {
+    size_t pos = log->head;
+    size_t kept = written < log->head ? 0 : log->head;
+    struct stat st;
+
+    while (pos < log->len) {
+        size_t size = ((const zeus_access_record_t *)(log->buf + pos))->size;
+
+        if (pos + size <= written) {
+            kept = pos + size;
+        } else {
+            log->dropped++;
+        }
+        pos += size;
+    }
+
+    if (kept < written && (fstat(log->fd, &st) < 0 ||
+        ftruncate(log->fd, st.st_size - (off_t)(written - kept)) < 0)) {
+        ZLOG_PERROR("Access log: cannot cut a partial record");
+    }
+
+    log->len = written < log->head ? log->head : 0;
+    if (log->len == 0) {
+        log->head = 0;
+    }
+}
+
+void zeus_access_log_flush(zeus_access_log_t *log) {
+    size_t off = 0;
+
+    if (!log || log->len == 0) {
+        return;
+    }
+
+    while (off < log->len) {
+        ssize_t n = write(log->fd, log->buf + off, log->len - off);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            zeus_access_log_drop(log, off);
+            return;
+        }
+        off += (size_t)n;
+    }
+    log->len = 0;
+    log->head = 0;
+}
+
+void zeus_access_log_destroy(zeus_access_log_t *log) {
+    zeus_access_log_flush(log);
+    free(log->buf);
+    log->buf = NULL;
+    log->cap = 0;
+}
+
+static uint64_t zeus_access_clock(clockid_t id, uint64_t div) {
+    struct timespec ts;
+
+    clock_gettime(id, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec) / div;
+}
+
+uint64_t zeus_access_now(void) {
+    return zeus_access_clock(CLOCK_MONOTONIC, 1);
+}
+
+void zeus_access_begin(zeus_conn_t *conn, uint64_t header_bytes) {
+    conn->access.bytes_in = header_bytes;
+    conn->access.bytes_out = 0;
+    conn->access.first_ns = 0;
+    conn->access.end_ns = 0;
+    conn->access.route = 0;
+
+    if (!conn->server->access && !zeus_metrics_self) {
+        conn->access.start_ns = 0;
+        return;
+    }
+
+    if (conn->server->access) {
+        conn->access.time_us = zeus_access_clock(CLOCK_REALTIME, 1000);
+    }
+    conn->access.start_ns = zeus_access_now();
+}
+
+void zeus_access_end(zeus_conn_t *conn) {
+    if (conn->access.start_ns) {
+        conn->access.end_ns = zeus_access_now();
+    }
+}
+
+void zeus_access_record(zeus_conn_t *conn, const char *method, const char *path,
+                        uint16_t status, uint32_t stream_id) {
+    zeus_access_log_t *log = conn->server->access;
+    uint64_t start_ns = conn->access.start_ns;
+
+    conn->access.start_ns = 0;
+    if (!log || start_ns == 0) {
+        return;
+    }
+
+    size_t path_len = path ? strlen(path) : 0;
+    uint8_t flags = 0;
+
+    if (path_len > ZEUS_ACCESS_PATH_MAX) {
+        path_len = ZEUS_ACCESS_PATH_MAX;
+        flags |= ZEUS_ACCESS_PATH_TRUNCATED;
+    }
+
+    size_t size = (sizeof(zeus_access_record_t) + path_len + 7) & ~(size_t)7;
+
+    if (log->len + size > log->cap) {
+        zeus_access_log_flush(log);
+    }
+
+    zeus_access_record_t *rec = (zeus_access_record_t *)(log->buf + log->len);
+    uint64_t end_ns = conn->access.end_ns ? conn->access.end_ns : zeus_access_now();
+    uint64_t elapsed_us = (end_ns - start_ns) / 1000;
+
+    memset(rec, 0, size);
+    rec->size = (uint16_t)size;
+    rec->status = status;
+    rec->path_len = (uint16_t)path_len;
+    rec->http_minor = stream_id ? 0 : (uint8_t)conn->http_minor;
+    rec->time_us = conn->access.time_us;
+    rec->latency_us = elapsed_us > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed_us;
+    rec->fd = conn->event.fd;
+    rec->bytes_in = conn->access.bytes_in;
+    rec->bytes_out = conn->access.bytes_out;
+    rec->stream_id = stream_id;
+    rec->pid = log->pid;
+
+    if (method) {
+        strncpy(rec->method, method, sizeof(rec->method));
+    }
+    if (path_len) {
+        memcpy(rec + 1, path, path_len);
+    }
+
+    if (stream_id) {
+        flags |= ZEUS_ACCESS_H2 | ZEUS_ACCESS_KEEPALIVE;
+    } else if (conn->keep_alive) {
+        flags |= ZEUS_ACCESS_KEEPALIVE;
+    }
+    if (conn->ssl_conn && SSL_session_reused(conn->ssl_conn)) {
+        flags |= ZEUS_ACCESS_TLS_RESUMED;
+    }
+    rec->flags = flags;
+
+    log->len += size;
+    log->records++;
+}
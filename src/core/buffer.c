@@ -0,0 +1,515 @@
+/**
+ * buffer.c
+ * Chunk pool and output chains. Pools are per worker and single-threaded.
+ */
+
+#define _XOPEN_SOURCE 700
+
+#include "../../include/core/buffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+void zeus_buf_pool_init(zeus_buf_pool_t *pool) {
+    memset(pool, 0, sizeof(*pool));
+}
+
+void zeus_buf_pool_destroy(zeus_buf_pool_t *pool) {
+    for (size_t i = 0; i < pool->num_slabs; i++) {
+        free(pool->slabs[i]);
+    }
+    for (size_t i = 0; i < pool->num_seg_slabs; i++) {
+        free(pool->seg_slabs[i]);
+    }
+    free(pool->slabs);
+    free(pool->seg_slabs);
+    memset(pool, 0, sizeof(*pool));
+}
+
+/**
+ * Allocates a new slab and threads its chunks onto the free list.
+ */
+
+static int zeus_buf_pool_grow(zeus_buf_pool_t *pool) {
+    void **slabs = realloc(pool->slabs, sizeof(void *) * (pool->num_slabs + 1));
+    if (!slabs) {
+        return -1;
+    }
+    pool->slabs = slabs;
+
+    zeus_buf_t *slab = malloc(sizeof(zeus_buf_t) * ZEUS_BUF_SLAB_COUNT);
+    if (!slab) {
+        return -1;
+    }
+    pool->slabs[pool->num_slabs++] = slab;
+
+    for (size_t i = 0; i < ZEUS_BUF_SLAB_COUNT; i++) {
+        slab[i].next = pool->free_list;
+        pool->free_list = &slab[i];
+    }
+    pool->total += ZEUS_BUF_SLAB_COUNT;
+    return 0;
+}
+
+zeus_buf_t *zeus_buf_get(zeus_buf_pool_t *pool) {
+    if (!pool->free_list && zeus_buf_pool_grow(pool) < 0) {
+        return NULL;
+    }
+
+    zeus_buf_t *buf = pool->free_list;
+    pool->free_list = buf->next;
+
+    buf->next = NULL;
+    buf->start = 0;
+    buf->end = 0;
+
+    if (++pool->in_use > pool->high_water) {
+        pool->high_water = pool->in_use;
+    }
+    return buf;
+}
+
+void zeus_buf_put(zeus_buf_pool_t *pool, zeus_buf_t *buf) {
+    if (!buf) {
+        return;
+    }
+
+    buf->next = pool->free_list;
+    pool->free_list = buf;
+    pool->in_use--;
+}
+
+/**
+ * Segment descriptors live in their own slabs: a borrowed reference or a
+ * file range costs a few dozen bytes, not a chunk.
+ */
+
+static zeus_seg_t *zeus_seg_get(zeus_buf_pool_t *pool) {
+    if (!pool->seg_free) {
+        void **slabs = realloc(pool->seg_slabs, sizeof(void *) * (pool->num_seg_slabs + 1));
+        if (!slabs) {
+            return NULL;
+        }
+        pool->seg_slabs = slabs;
+
+        zeus_seg_t *slab = malloc(sizeof(zeus_seg_t) * ZEUS_SEG_SLAB_COUNT);
+        if (!slab) {
+            return NULL;
+        }
+        pool->seg_slabs[pool->num_seg_slabs++] = slab;
+
+        for (size_t i = 0; i < ZEUS_SEG_SLAB_COUNT; i++) {
+            slab[i].next = pool->seg_free;
+            pool->seg_free = &slab[i];
+        }
+    }
+
+    zeus_seg_t *seg = pool->seg_free;
+    pool->seg_free = seg->next;
+    memset(seg, 0, sizeof(*seg));
+    seg->fd = -1;
+    return seg;
+}
+
+static void zeus_seg_put(zeus_buf_pool_t *pool, zeus_seg_t *seg) {
+    if (seg->type == ZEUS_SEG_BUF) {
+        zeus_buf_put(pool, seg->buf);
+    } else if (seg->release) {
+        seg->release(seg->release_arg);
+    } else if (seg->type == ZEUS_SEG_FILE && seg->fd >= 0) {
+        close(seg->fd);
+    }
+
+    seg->next = pool->seg_free;
+    pool->seg_free = seg;
+}
+
+static void zeus_chain_link(zeus_chain_t *chain, zeus_seg_t *seg) {
+    if (chain->tail) {
+        chain->tail->next = seg;
+    } else {
+        chain->head = seg;
+    }
+    chain->tail = seg;
+}
+
+/**
+ * New segment backed by a fresh chunk.
+ */
+
+static zeus_seg_t *zeus_seg_new_buf(zeus_buf_pool_t *pool) {
+    zeus_seg_t *seg = zeus_seg_get(pool);
+    if (!seg) {
+        return NULL;
+    }
+
+    seg->type = ZEUS_SEG_BUF;
+    seg->buf = zeus_buf_get(pool);
+    if (!seg->buf) {
+        seg->next = pool->seg_free;
+        pool->seg_free = seg;
+        return NULL;
+    }
+    return seg;
+}
+
+int zeus_chain_append(zeus_buf_pool_t *pool, zeus_chain_t *chain, const void *data, size_t len) {
+    const char *p = data;
+
+    while (len > 0) {
+        zeus_seg_t *tail = chain->tail;
+
+        if (!tail || tail->type != ZEUS_SEG_BUF || tail->buf->end == ZEUS_BUF_SIZE) {
+            tail = zeus_seg_new_buf(pool);
+            if (!tail) {
+                return -1;
+            }
+            zeus_chain_link(chain, tail);
+        }
+
+        zeus_buf_t *buf = tail->buf;
+        size_t n = ZEUS_BUF_SIZE - buf->end;
+        if (n > len) {
+            n = len;
+        }
+
+        memcpy(buf->data + buf->end, p, n);
+        buf->end += n;
+        chain->len += n;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+char *zeus_chain_reserve(zeus_buf_pool_t *pool, zeus_chain_t *chain, size_t *avail) {
+    zeus_seg_t *tail = chain->tail;
+
+    if (!tail || tail->type != ZEUS_SEG_BUF || tail->buf->end == ZEUS_BUF_SIZE) {
+        tail = zeus_seg_new_buf(pool);
+        if (!tail) {
+            return NULL;
+        }
+        zeus_chain_link(chain, tail);
+    }
+
+    *avail = ZEUS_BUF_SIZE - tail->buf->end;
+    return tail->buf->data + tail->buf->end;
+}
+
+void zeus_chain_commit(zeus_buf_pool_t *pool, zeus_chain_t *chain, size_t n) {
+    zeus_seg_t *tail = chain->tail;
+
+    if (n > 0 || tail->buf->end > 0) {
+        tail->buf->end += n;
+        chain->len += n;
+        return;
+    }
+
+    /**
+     * Nothing written into a chunk reserve just added: unlink it, since
+     * an empty segment would read as a stalled socket to the writer.
+     */
+
+    zeus_seg_t *prev = NULL;
+    if (chain->head != tail) {
+        for (prev = chain->head; prev->next != tail; prev = prev->next) {
+        }
+        prev->next = NULL;
+    } else {
+        chain->head = NULL;
+    }
+    chain->tail = prev;
+    zeus_seg_put(pool, tail);
+}
+
+int zeus_chain_append_ref(zeus_buf_pool_t *pool, zeus_chain_t *chain, const void *data, size_t len, int transient) {
+    if (len == 0) {
+        return 0;
+    }
+
+    zeus_seg_t *seg = zeus_seg_get(pool);
+    if (!seg) {
+        return -1;
+    }
+
+    seg->type = ZEUS_SEG_REF;
+    seg->transient = transient;
+    seg->ref = data;
+    seg->len = len;
+
+    zeus_chain_link(chain, seg);
+    chain->len += len;
+    return 0;
+}
+
+int zeus_chain_append_ref_shared(zeus_buf_pool_t *pool, zeus_chain_t *chain, const void *data, size_t len,
+                                 void (*release)(void *), void *arg) {
+    if (len == 0) {
+        release(arg);
+        return 0;
+    }
+
+    zeus_seg_t *seg = zeus_seg_get(pool);
+    if (!seg) {
+        release(arg);
+        return -1;
+    }
+
+    seg->type = ZEUS_SEG_REF;
+    seg->ref = data;
+    seg->len = len;
+    seg->release = release;
+    seg->release_arg = arg;
+
+    zeus_chain_link(chain, seg);
+    chain->len += len;
+    return 0;
+}
+
+int zeus_chain_append_file(zeus_buf_pool_t *pool, zeus_chain_t *chain, int fd, off_t offset, size_t len) {
+    if (len == 0) {
+        close(fd);
+        return 0;
+    }
+
+    zeus_seg_t *seg = zeus_seg_get(pool);
+    if (!seg) {
+        close(fd);
+        return -1;
+    }
+
+    seg->type = ZEUS_SEG_FILE;
+    seg->fd = fd;
+    seg->offset = offset;
+    seg->len = len;
+
+    zeus_chain_link(chain, seg);
+    chain->len += len;
+    return 0;
+}
+
+int zeus_chain_append_file_shared(zeus_buf_pool_t *pool, zeus_chain_t *chain, int fd, off_t offset, size_t len,
+                                  void (*release)(void *), void *arg) {
+    if (len == 0) {
+        release(arg);
+        return 0;
+    }
+
+    zeus_seg_t *seg = zeus_seg_get(pool);
+    if (!seg) {
+        release(arg);
+        return -1;
+    }
+
+    seg->type = ZEUS_SEG_FILE;
+    seg->fd = fd;
+    seg->offset = offset;
+    seg->len = len;
+    seg->release = release;
+    seg->release_arg = arg;
+
+    zeus_chain_link(chain, seg);
+    chain->len += len;
+    return 0;
+}
+
+int zeus_chain_prepend(zeus_buf_pool_t *pool, zeus_chain_t *chain, const void *data, size_t len) {
+    zeus_seg_t *head = chain->head;
+    zeus_buf_t *buf = head && head->type == ZEUS_SEG_BUF ? head->buf : NULL;
+
+    if (len > ZEUS_BUF_SIZE) {
+        return -1;
+    }
+
+    /**
+     * Room in front of the unsent bytes, or after them: shift in place.
+     */
+
+    if (buf && buf->start >= len) {
+        buf->start -= len;
+        memcpy(buf->data + buf->start, data, len);
+        chain->len += len;
+        return 0;
+    }
+
+    if (buf && buf->end + len <= ZEUS_BUF_SIZE) {
+        memmove(buf->data + buf->start + len, buf->data + buf->start, buf->end - buf->start);
+        memcpy(buf->data + buf->start, data, len);
+        buf->end += len;
+        chain->len += len;
+        return 0;
+    }
+
+    zeus_seg_t *seg = zeus_seg_new_buf(pool);
+    if (!seg) {
+        return -1;
+    }
+
+    memcpy(seg->buf->data, data, len);
+    seg->buf->end = len;
+    seg->next = head;
+
+    chain->head = seg;
+    if (!chain->tail) {
+        chain->tail = seg;
+    }
+    chain->len += len;
+    return 0;
+}
+
+void zeus_chain_concat(zeus_chain_t *dst, zeus_chain_t *src) {
+    if (!src->head) {
+        return;
+    }
+
+    if (dst->tail) {
+        dst->tail->next = src->head;
+    } else {
+        dst->head = src->head;
+    }
+    dst->tail = src->tail;
+    dst->len += src->len;
+
+    src->head = NULL;
+    src->tail = NULL;
+    src->len = 0;
+}
+
+int zeus_chain_pin(zeus_buf_pool_t *pool, zeus_chain_t *chain) {
+    zeus_seg_t *prev = NULL;
+
+    for (zeus_seg_t *seg = chain->head; seg; ) {
+        if (seg->type != ZEUS_SEG_REF || !seg->transient) {
+            prev = seg;
+            seg = seg->next;
+            continue;
+        }
+
+        /**
+         * Copy into a private chain, then splice it where the reference
+         * was, so the byte order does not change.
+         */
+
+        zeus_chain_t copy = {0};
+        if (zeus_chain_append(pool, &copy, seg->ref, seg->len) < 0) {
+            zeus_chain_free(pool, &copy);
+            return -1;
+        }
+
+        zeus_seg_t *next = seg->next;
+        copy.tail->next = next;
+
+        if (prev) {
+            prev->next = copy.head;
+        } else {
+            chain->head = copy.head;
+        }
+        if (chain->tail == seg) {
+            chain->tail = copy.tail;
+        }
+
+        zeus_seg_put(pool, seg);
+        prev = copy.tail;
+        seg = next;
+    }
+    return 0;
+}
+
+int zeus_chain_iov(const zeus_chain_t *chain, struct iovec *iov, int max) {
+    int count = 0;
+
+    for (zeus_seg_t *seg = chain->head; seg && count < max; seg = seg->next) {
+        if (seg->type == ZEUS_SEG_FILE) {
+            break;
+        }
+
+        if (seg->type == ZEUS_SEG_BUF) {
+            iov[count].iov_base = seg->buf->data + seg->buf->start;
+        } else {
+            iov[count].iov_base = (void *)seg->ref;
+        }
+        iov[count].iov_len = zeus_seg_len(seg);
+        count++;
+    }
+    return count;
+}
+
+ssize_t zeus_chain_copy_out(const zeus_chain_t *chain, char *dst, size_t max, int with_files) {
+    size_t copied = 0;
+
+    for (zeus_seg_t *seg = chain->head; seg && copied < max; seg = seg->next) {
+        if (seg->type == ZEUS_SEG_FILE && !with_files) {
+            break;
+        }
+
+        size_t n = zeus_seg_len(seg);
+        if (n > max - copied) {
+            n = max - copied;
+        }
+
+        if (seg->type == ZEUS_SEG_BUF) {
+            memcpy(dst + copied, seg->buf->data + seg->buf->start, n);
+        } else if (seg->type == ZEUS_SEG_REF) {
+            memcpy(dst + copied, seg->ref, n);
+        } else {
+            ssize_t r;
+            do {
+                r = pread(seg->fd, dst + copied, n, seg->offset);
+            } while (r < 0 && errno == EINTR);
+
+            if (r <= 0) {
+                return -1;  /** Read error, or the file shrank under us. */
+            }
+
+            copied += (size_t)r;
+            if ((size_t)r < n) {
+                break;
+            }
+            continue;
+        }
+        copied += n;
+    }
+    return (ssize_t)copied;
+}
+
+void zeus_chain_consume(zeus_buf_pool_t *pool, zeus_chain_t *chain, size_t n) {
+    while (n > 0 && chain->head) {
+        zeus_seg_t *head = chain->head;
+        size_t avail = zeus_seg_len(head);
+
+        if (n < avail) {
+            if (head->type == ZEUS_SEG_BUF) {
+                head->buf->start += n;
+            } else if (head->type == ZEUS_SEG_REF) {
+                head->ref += n;
+                head->len -= n;
+            } else {
+                head->offset += (off_t)n;
+                head->len -= n;
+            }
+            chain->len -= n;
+            return;
+        }
+
+        n -= avail;
+        chain->len -= avail;
+        chain->head = head->next;
+        if (!chain->head) {
+            chain->tail = NULL;
+        }
+        zeus_seg_put(pool, head);
+    }
+}
+
+void zeus_chain_free(zeus_buf_pool_t *pool, zeus_chain_t *chain) {
+    while (chain->head) {
+        zeus_seg_t *next = chain->head->next;
+        zeus_seg_put(pool, chain->head);
+        chain->head = next;
+    }
+    chain->tail = NULL;
+    chain->len = 0;
+}
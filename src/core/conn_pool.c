@@ -0,0 +1,106 @@
+/**
+ * conn_pool.c
+ * Connection slabs and free list. Pools are per worker and single-threaded.
+ */
+
+#include "../../include/core/conn_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Under AddressSanitizer, pooled connections are poisoned so a stale
+ * pointer to a closed connection still faults instead of silently
+ * reaching whichever connection reused the slot.
+ */
+
+#if defined(__SANITIZE_ADDRESS__)
+#include <sanitizer/asan_interface.h>
+#define CONN_POISON(c)   ASAN_POISON_MEMORY_REGION((c), sizeof(zeus_conn_t))
+#define CONN_UNPOISON(c) ASAN_UNPOISON_MEMORY_REGION((c), sizeof(zeus_conn_t))
+#define CONN_UNPOISON_SLAB(s) ASAN_UNPOISON_MEMORY_REGION((s), sizeof(zeus_conn_t) * ZEUS_CONN_SLAB_COUNT)
+#else
+#define CONN_POISON(c)   ((void)(c))
+#define CONN_UNPOISON(c) ((void)(c))
+#define CONN_UNPOISON_SLAB(s) ((void)(s))
+#endif
+
+void zeus_conn_pool_init(zeus_conn_pool_t *pool) {
+    memset(pool, 0, sizeof(*pool));
+}
+
+void zeus_conn_pool_destroy(zeus_conn_pool_t *pool) {
+    for (size_t i = 0; i < pool->num_slabs; i++) {
+        CONN_UNPOISON_SLAB(pool->slabs[i]);
+        free(pool->slabs[i]);
+    }
+    free(pool->slabs);
+    memset(pool, 0, sizeof(*pool));
+}
+
+/**
+ * Allocates a new slab and threads its connections onto the free list.
+ * The slab comes zeroed, so fresh connections need no reset.
+ */
+
+static int zeus_conn_pool_grow(zeus_conn_pool_t *pool) {
+    void **slabs = realloc(pool->slabs, sizeof(void *) * (pool->num_slabs + 1));
+    if (!slabs) {
+        return -1;
+    }
+    pool->slabs = slabs;
+
+    zeus_conn_t *slab = calloc(ZEUS_CONN_SLAB_COUNT, sizeof(zeus_conn_t));
+    if (!slab) {
+        return -1;
+    }
+    pool->slabs[pool->num_slabs++] = slab;
+
+    for (size_t i = ZEUS_CONN_SLAB_COUNT; i > 0; i--) {
+        slab[i - 1].pool_next = pool->free_list;
+        pool->free_list = &slab[i - 1];
+        CONN_POISON(&slab[i - 1]);
+    }
+    pool->total += ZEUS_CONN_SLAB_COUNT;
+    return 0;
+}
+
+/**
+ * Clears a recycled connection. Everything before req is zeroed; of the
+ * request only the fields before the header array are, since
+ * num_headers bounds what is read from it. This skips the bulk of the
+ * struct (MAX_HEADERS views) on every accept.
+ */
+
+static void zeus_conn_reset(zeus_conn_t *conn) {
+    memset(conn, 0, offsetof(zeus_conn_t, req));
+    memset(&conn->req, 0, offsetof(zeus_request_t, headers));
+}
+
+zeus_conn_t *zeus_conn_pool_get(zeus_conn_pool_t *pool) {
+    if (!pool->free_list && zeus_conn_pool_grow(pool) < 0) {
+        return NULL;
+    }
+
+    zeus_conn_t *conn = pool->free_list;
+    CONN_UNPOISON(conn);
+    pool->free_list = conn->pool_next;
+
+    zeus_conn_reset(conn);
+
+    if (++pool->in_use > pool->high_water) {
+        pool->high_water = pool->in_use;
+    }
+    return conn;
+}
+
+void zeus_conn_pool_put(zeus_conn_pool_t *pool, zeus_conn_t *conn) {
+    if (!conn) {
+        return;
+    }
+
+    conn->pool_next = pool->free_list;
+    pool->free_list = conn;
+    pool->in_use--;
+    CONN_POISON(conn);
+}
@@ -1,3 +1,5 @@
+#define _GNU_SOURCE
+
 #include "../../include/zeushttp.h"
 #include "../../include/http/avl.h"
 #include "../../include/http/http.h"
@@ -6,6 +8,13 @@
 #include "../../include/core/io_event.h"
 #include "../../include/core/worker_signals.h"
 #include "../../include/core/log.h"
+#include "../../include/core/uring.h"
+#include "../../include/core/ring_io.h"
+#include "../../include/core/timer.h"
+#include "../../include/core/access_log.h"
+#include "../../include/core/metrics.h"
+#include "../../include/http/http_scan.h"
+#include "../../include/http/mime.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -28,24 +37,18 @@
 
 extern int zeus_handle_ssl_handshake(zeus_conn_t *conn);
 extern void handle_write_cb(zeus_io_event_t *ev);
+extern void start_graceful_close(zeus_conn_t *conn);
 extern int zeus_drop_privileges();
 
-/**
- * Security limits, adjustable.
- */
-
-#define MAX_HEADERS_LEN 8192       /** 8 KB total for all headers. */
-#define MAX_HEADERS 100            /** 100 headers maximum. */
-
-
  /**
   * Forward declarations for callback.
   */
 
 int zeus_event_ctl(zeus_server_t *server, zeus_io_event_t *ev, int op, uint32_t events);
 static void accept_connection_cb(zeus_io_event_t *ev);
+static void zeus_accept_fd(zeus_server_t *server, int conn_fd);
 static void handle_read_cb(zeus_io_event_t *ev);
-int http_process_read_buffer(zeus_conn_t *conn);
+static void zeus_http1_drive(zeus_conn_t *conn);
 void close_connection(zeus_conn_t *conn);
 
   /**
@@ -61,7 +64,7 @@ static int set_nonblocking(int fd) {
     return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
 }
 
-static void zeus_dispatch_event(zeus_server_t *server, struct epoll_event *ee) {
+void zeus_dispatch_event(zeus_server_t *server, struct epoll_event *ee) {
     zeus_io_event_t *ev = (zeus_io_event_t *)ee->data.ptr;
     if (!ev) {
         return;
@@ -102,17 +105,300 @@ static void zeus_dispatch_event(zeus_server_t *server, struct epoll_event *ee) {
     conn_unref(conn);
 }
 
+#ifdef __linux__
+
+/**
+ * Handles one io_uring completion. Poll completions carry the ready mask
+ * in res and are turned into the same epoll_event shape the epoll loop
+ * uses, so every callback keeps working unchanged.
+ */
+
+static void zeus_uring_dispatch(zeus_server_t *server, struct io_uring_cqe *cqe) {
+    uint64_t tag = ZEUS_URING_UD_TAG(cqe->user_data);
+    zeus_io_event_t *ev = ZEUS_URING_UD_PTR(cqe->user_data);
+    int res = cqe->res;
+    int more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+
+    if (tag == ZEUS_URING_TAG_IGNORE || !ev) {
+        return;
+    }
+
+    if (tag == ZEUS_URING_TAG_RECV || tag == ZEUS_URING_TAG_SEND) {
+        zeus_ring_io_complete(server, cqe);
+        return;
+    }
+
+    if (tag == ZEUS_URING_TAG_ACCEPT) {
+        if (res >= 0) {
+            zeus_accept_fd(server, res);
+        }
+
+        if (!more) {
+            if (res >= 0) {
+                zeus_uring_accept_multishot(server->uring, ev->fd,
+                    ZEUS_URING_UD(ev, ZEUS_URING_TAG_ACCEPT));
+                return;
+            }
+
+            /**
+             * Multishot accept needs 5.19 (EINVAL). Other errors (EMFILE,
+             * ENFILE, ENOMEM) leave the backlog readable, so re-arming at
+             * once would fail again on the next io_uring_enter and spin.
+             * Either way the listen socket is polled edge-triggered from
+             * here on and drained by the accept() loop, as with epoll.
+             */
+
+            if (res == -EINVAL) {
+                ZLOG_INFO("io_uring: multishot accept unsupported, polling listen_fd.");
+            } else {
+                ZLOG_ERROR("io_uring: accept failed: %s, polling listen_fd.", strerror(-res));
+            }
+            zeus_event_ctl(server, ev, EPOLL_CTL_ADD, EPOLLIN | EPOLLET);
+        }
+        return;
+    }
+
+    if (res < 0) {
+        return;     /** Poll cancelled by a MOD/DEL. */
+    }
+
+    /**
+     * The kernel dropped the multishot poll (e.g. CQ overflow): re-arm
+     * it with the current interest before running the callbacks.
+     */
+
+    if (!more) {
+        zeus_uring_poll_add(server->uring, ev->fd,
+            ZEUS_URING_UD(ev, ZEUS_URING_TAG_POLL), ev->events);
+    }
+
+    struct epoll_event ee;
+    ee.events = (uint32_t)res;
+    ee.data.ptr = ev;
+    zeus_dispatch_event(server, &ee);
+}
+
+/**
+ * Worker loop for the io_uring backend. Returns 1 when io_uring cannot
+ * be used, so the caller falls back to epoll.
+ */
+
+static int zeus_uring_worker_loop(zeus_server_t *server) {
+    zeus_uring_t ring;
+    zeus_ring_io_t rio;
+    zeus_io_event_t *listen_ev = NULL;
+
+    if (zeus_uring_init(&ring, ZEUS_URING_ENTRIES) < 0) {
+        return 1;
+    }
+
+    server->uring = &ring;
+    server->loop_fd = -1;
+
+    /**
+     * Connections read and write through the ring when it can provide
+     * receive buffers; otherwise they are polled like epoll sockets.
+     */
+
+    zeus_ring_io_init(server, &rio);
+
+    listen_ev = calloc(1, sizeof(*listen_ev));
+    if (!listen_ev) goto fatal;
+
+    listen_ev->fd      = server->listen_fd;
+    listen_ev->data    = server;
+    listen_ev->read_cb = accept_connection_cb;
+
+    if (zeus_uring_accept_multishot(&ring, server->listen_fd,
+            ZEUS_URING_UD(listen_ev, ZEUS_URING_TAG_ACCEPT)) < 0) {
+        ZLOG_ERROR("Worker fatal: cannot queue accept on listen_fd");
+        goto fatal;
+    }
+
+    ZLOG_INFO("Worker (PID %d) ready (io_uring%s). listen_fd=%d", getpid(),
+        server->ring_io ? ", ring I/O" : "", server->listen_fd);
+
+    while (!shutdown_requested) {
+        int timeout = zeus_timer_next_timeout(server->timers);
+
+        zeus_log_flush();
+        zeus_access_log_flush(server->access);
+
+        /**
+         * Receives re-armed and sends queued during the last batch go out
+         * with this wait.
+         */
+
+        if (server->ring_io && zeus_ring_io_run(server)) {
+            timeout = 0;
+        }
+
+        if (zeus_uring_wait(&ring, timeout) < 0) {
+            ZLOG_PERROR("io_uring_enter fatal error");
+            break;
+        }
+
+        zeus_timer_update_clock(server->timers);
+
+        struct io_uring_cqe *cqe;
+        while ((cqe = zeus_uring_peek_cqe(&ring)) != NULL) {
+            struct io_uring_cqe copy = *cqe;
+            zeus_uring_cqe_seen(&ring);
+
+            zeus_uring_dispatch(server, &copy);
+            if (shutdown_requested) break;
+        }
+
+        zeus_timer_expire(server->timers);
+    }
+
+    free(listen_ev);
+    zeus_ring_io_destroy(server);
+    server->uring = NULL;
+    zeus_uring_destroy(&ring);
+    return 0;
+
+fatal:
+    free(listen_ev);
+    zeus_ring_io_destroy(server);
+    server->uring = NULL;
+    zeus_uring_destroy(&ring);
+    return -1;
+}
+
+#endif // __linux__
+
 /**
  * Master worker loop :p
  */
 
+/**
+ * Per-worker state shared by both backends: the timer wheel, the I/O
+ * buffer pool, the connection pool, the open-file cache, the gzip
+ * stream pool and the access log buffer.
+ */
+
+static int zeus_worker_state_init(zeus_server_t *server) {
+    server->timers = malloc(sizeof(*server->timers));
+    server->bufs = malloc(sizeof(*server->bufs));
+    server->conns = malloc(sizeof(*server->conns));
+    server->files = malloc(sizeof(*server->files));
+    server->deflate = malloc(sizeof(*server->deflate));
+
+    if (!server->timers || !server->bufs || !server->conns || !server->files || !server->deflate) {
+        ZLOG_ERROR("Worker fatal: cannot allocate timer wheel / buffer pool / connection pool / file cache / gzip pool");
+        free(server->timers);
+        free(server->bufs);
+        free(server->conns);
+        free(server->files);
+        free(server->deflate);
+        server->timers = NULL;
+        server->bufs = NULL;
+        server->conns = NULL;
+        server->files = NULL;
+        server->deflate = NULL;
+        return -1;
+    }
+
+    zeus_timer_wheel_init(server->timers);
+    zeus_buf_pool_init(server->bufs);
+    zeus_conn_pool_init(server->conns);
+    zeus_deflate_pool_init(server->deflate, server->config.gzip_level);
+
+    int cache_size = server->config.file_cache_size > 0 ? server->config.file_cache_size : 0;
+    int cache_ttl = server->config.file_cache_ttl > 0 ? server->config.file_cache_ttl : 0;
+    int memory_max = server->config.file_cache_memory_max > 0 ? server->config.file_cache_memory_max : 0;
+
+    if (zeus_file_cache_init(server->files, (size_t)cache_size, (unsigned)cache_ttl, (size_t)memory_max,
+                             server->config.precompressed) < 0) {
+        ZLOG_WARN("Worker (PID %d): cannot allocate the file cache, serving files uncached.", getpid());
+    }
+
+    if (server->access_fds) {
+        int fd = server->access_fds[(server->worker_id < 0 ? 0 : server->worker_id) % server->num_access_fds];
+
+        server->access = malloc(sizeof(*server->access));
+        if (!server->access || zeus_access_log_init(server->access, fd) < 0) {
+            ZLOG_WARN("Worker (PID %d): cannot set up the access log, requests are not logged.", getpid());
+            free(server->access);
+            server->access = NULL;
+        }
+    }
+    return 0;
+}
+
+static void zeus_worker_state_free(zeus_server_t *server) {
+    if (server->bufs) {
+        ZLOG_INFO("Worker (PID %d): buffer pool high water %zu chunks (%zu KB), %zu allocated.",
+            getpid(), server->bufs->high_water,
+            server->bufs->high_water * ZEUS_BUF_SIZE / 1024, server->bufs->total);
+        zeus_buf_pool_destroy(server->bufs);
+    }
+
+    if (server->conns) {
+        ZLOG_INFO("Worker (PID %d): connection pool high water %zu connections (%zu KB), %zu allocated.",
+            getpid(), server->conns->high_water,
+            server->conns->high_water * sizeof(zeus_conn_t) / 1024, server->conns->total);
+        zeus_conn_pool_destroy(server->conns);
+    }
+
+    if (server->files) {
+        ZLOG_INFO("Worker (PID %d): file cache %zu hits, %zu misses, %zu evictions.",
+            getpid(), server->files->hits, server->files->misses, server->files->evictions);
+        zeus_file_cache_destroy(server->files);
+    }
+
+    if (server->deflate) {
+        if (server->config.gzip) {
+            ZLOG_INFO("Worker (PID %d): gzip pool high water %zu streams, %zu created.",
+                getpid(), server->deflate->high_water, server->deflate->created);
+        }
+        zeus_deflate_pool_destroy(server->deflate);
+    }
+
+    if (server->access) {
+        zeus_access_log_destroy(server->access);
+        ZLOG_INFO("Worker (PID %d): access log %zu records, %zu dropped.",
+            getpid(), server->access->records, server->access->dropped);
+        free(server->access);
+        server->access = NULL;
+    }
+
+    free(server->deflate);
+    free(server->files);
+    free(server->conns);
+    free(server->bufs);
+    free(server->timers);
+    server->deflate = NULL;
+    server->files = NULL;
+    server->conns = NULL;
+    server->bufs = NULL;
+    server->timers = NULL;
+}
+
 int zeus_worker_loop(zeus_server_t *server) {
     struct epoll_event *events = NULL;
     zeus_io_event_t *listen_ev = NULL;
 
+    if (zeus_worker_state_init(server) < 0) {
+        return -1;
+    }
+
+#ifdef __linux__
+    if (server->config.event_backend == ZEUS_BACKEND_IO_URING) {
+        int rc = zeus_uring_worker_loop(server);
+        if (rc <= 0) {
+            zeus_worker_state_free(server);
+            return rc;
+        }
+        ZLOG_INFO("Worker (PID %d): io_uring unavailable, falling back to epoll.", getpid());
+    }
+#endif
+
     server->loop_fd = epoll_create1(0);
     if (server->loop_fd < 0) {
         ZLOG_PERROR("Worker fatal: epoll_create1 failed");
+        zeus_worker_state_free(server);
         return -1;
     }
 
@@ -134,7 +420,16 @@ int zeus_worker_loop(zeus_server_t *server) {
     ZLOG_INFO("Worker (PID %d) ready. listen_fd=%d", getpid(), server->listen_fd);
 
     while (!shutdown_requested) {
-        int n_fds = epoll_wait(server->loop_fd, events, ZEUS_MAX_EVENTS, -1);
+        int timeout = zeus_timer_next_timeout(server->timers);
+
+        /**
+         * Idle phase: log and access records produced while handling the
+         * last batch leave in one write each.
+         */
+
+        zeus_log_flush();
+        zeus_access_log_flush(server->access);
+        int n_fds = epoll_wait(server->loop_fd, events, ZEUS_MAX_EVENTS, timeout);
         
         if (n_fds < 0) {
             if (errno == EINTR) continue;
@@ -142,21 +437,32 @@ int zeus_worker_loop(zeus_server_t *server) {
             break;
         }
 
+        zeus_timer_update_clock(server->timers);
+
         for (int i = 0; i < n_fds; i++) {
             zeus_dispatch_event(server, &events[i]);
             if (shutdown_requested) break;
         }
+
+        /**
+         * Timers run after the batch so no pending event can point to a
+         * connection released by a timeout.
+         */
+
+        zeus_timer_expire(server->timers);
     }
 
     // Cleanup
     free(events);
     free(listen_ev);
+    zeus_worker_state_free(server);
     if (server->loop_fd >= 0) close(server->loop_fd);
     return 0;
 
 fatal:
     if (listen_ev) free(listen_ev);
     if (events) free(events);
+    zeus_worker_state_free(server);
     if (server->loop_fd >= 0) close(server->loop_fd);
     return -1;
 }
@@ -167,7 +473,51 @@ fatal:
 
 int zeus_event_ctl(zeus_server_t *server, zeus_io_event_t *ev, int op, uint32_t events) {
 #ifdef __linux__
+    if (server->uring) {
+        uint64_t ud = ZEUS_URING_UD(ev, ZEUS_URING_TAG_POLL);
+
+        if (ev->ring_io) {
+            return zeus_ring_io_ctl(ev->data, op, events);
+        }
+
+        switch (op) {
+            case EPOLL_CTL_ADD:
+                ev->events = events;
+                return zeus_uring_poll_add(server->uring, ev->fd, ud, events);
+
+            case EPOLL_CTL_MOD:
+                /**
+                 * Queued remove + add: both go out with the next wait, and
+                 * the new poll reports readiness immediately like epoll MOD.
+                 */
+
+                ev->events = events;
+                if (zeus_uring_poll_remove(server->uring, ud) < 0) {
+                    return -1;
+                }
+                return zeus_uring_poll_add(server->uring, ev->fd, ud, events);
+
+            case EPOLL_CTL_DEL:
+                /**
+                 * Submitted right away: the event may be freed as soon as we
+                 * return, so any completion already posted for it is dropped.
+                 */
+
+                ev->events = 0;
+                if (zeus_uring_poll_remove(server->uring, ud) < 0) {
+                    return -1;
+                }
+                zeus_uring_submit(server->uring);
+                zeus_uring_forget(server->uring, ev);
+                return 0;
+
+            default:
+                return -1;
+        }
+    }
+
     struct epoll_event event;
+    ev->events = events;
     event.events = events;
     event.data.ptr = ev;
     
@@ -199,6 +549,72 @@ void zeus_apply_alpn(zeus_conn_t *conn) {
     }
 }
 
+/**
+ * Configured duration (seconds) of a timeout phase.
+ */
+
+static int zeus_conn_timeout_value(zeus_server_t *server, zeus_conn_timeout_t phase) {
+    switch (phase) {
+        case CONN_TIMEOUT_HANDSHAKE: return server->config.handshake_timeout;
+        case CONN_TIMEOUT_HEADER:    return server->config.header_timeout;
+        case CONN_TIMEOUT_BODY:      return server->config.body_timeout;
+        case CONN_TIMEOUT_KEEPALIVE: return server->config.keepalive_timeout;
+        case CONN_TIMEOUT_WRITE:     return server->config.write_timeout;
+        default:                     return 0;
+    }
+}
+
+static const char *zeus_conn_timeout_name(zeus_conn_timeout_t phase) {
+    switch (phase) {
+        case CONN_TIMEOUT_HANDSHAKE: return "handshake";
+        case CONN_TIMEOUT_HEADER:    return "header";
+        case CONN_TIMEOUT_BODY:      return "body";
+        case CONN_TIMEOUT_KEEPALIVE: return "keep-alive";
+        case CONN_TIMEOUT_WRITE:     return "write";
+        default:                     return "none";
+    }
+}
+
+/**
+ * Fired by the timer wheel when the current phase deadline passes.
+ */
+
+static void conn_timeout_cb(zeus_timer_t *timer) {
+    zeus_conn_t *conn = timer->data;
+
+    ZEUS_METRIC_INC(errors_timeout);
+    ZLOG_DEBUG("Timeout (%s) on FD %d. Closing connection.",
+        zeus_conn_timeout_name(conn->timeout_phase), conn->event.fd);
+    close_connection(conn);
+}
+
+void zeus_conn_set_timeout(zeus_conn_t *conn, zeus_conn_timeout_t phase) {
+    zeus_timer_wheel_t *wheel = conn->server->timers;
+    if (!wheel || conn->closing) {
+        return;
+    }
+
+    /**
+     * Handshake and header deadlines are absolute: re-arming them on each
+     * read would let a slow client trickle bytes forever.
+     */
+
+    if (phase == conn->timeout_phase && zeus_timer_pending(&conn->timer) &&
+        (phase == CONN_TIMEOUT_HANDSHAKE || phase == CONN_TIMEOUT_HEADER)) {
+        return;
+    }
+
+    conn->timeout_phase = phase;
+
+    int seconds = zeus_conn_timeout_value(conn->server, phase);
+    if (seconds <= 0) {
+        zeus_timer_cancel(wheel, &conn->timer);
+        return;
+    }
+
+    zeus_timer_arm(wheel, &conn->timer, (uint32_t)seconds * 1000U);
+}
+
 /**
  * Callback when the listen socket is ready for reading (new connection).
  */
@@ -217,40 +633,71 @@ static void accept_connection_cb(zeus_io_event_t *ev) {
             break;
         }
 
-        if (set_nonblocking(conn_fd) == -1) {
-            close(conn_fd);
-            continue;
-        }
+        zeus_accept_fd(server, conn_fd);
+    }
+}
 
-        zeus_conn_t *conn = calloc(1, sizeof(zeus_conn_t));
-        if (!conn) {
-            close(conn_fd);
-            continue;
-        }
+/**
+ * Sets up the connection state for a freshly accepted socket and
+ * registers it in the loop. Shared by the accept() loop and by the
+ * io_uring multishot accept completions.
+ */
 
-        conn->refcount = 1; 
-        conn->server = server;
-        conn->event.fd = conn_fd;
-        conn->event.data = conn;
-        conn->event.read_cb = handle_read_cb;
-        conn->event.write_cb = handle_write_cb;
+static void zeus_accept_fd(zeus_server_t *server, int conn_fd) {
+    if (set_nonblocking(conn_fd) == -1) {
+        close(conn_fd);
+        return;
+    }
 
-        conn->ssl_conn = SSL_new(server->ssl_ctx);
-        if (!conn->ssl_conn) {
-            close_connection(conn);
-            continue;
-        }
+    zeus_conn_t *conn = zeus_conn_pool_get(server->conns);
+    if (!conn) {
+        close(conn_fd);
+        return;
+    }
+
+    ZEUS_METRIC_INC(conns_accepted);
+    ZEUS_METRIC_INC(conns_active);
 
+    conn->refcount = 1; 
+    conn->server = server;
+    conn->event.fd = conn_fd;
+    conn->event.data = conn;
+    conn->event.read_cb = handle_read_cb;
+    conn->event.write_cb = handle_write_cb;
+    zeus_timer_init(&conn->timer, conn_timeout_cb, conn);
+
+    conn->ssl_conn = SSL_new(server->ssl_ctx);
+    if (!conn->ssl_conn) {
+        close_connection(conn);
+        return;
+    }
+
+#ifdef __linux__
+    if (server->ring_io && zeus_ring_io_attach(conn) < 0) {
+        close_connection(conn);
+        return;
+    }
+#endif
+    if (!conn->event.ring_io) {
         SSL_set_fd(conn->ssl_conn, conn_fd);
-        SSL_set_accept_state(conn->ssl_conn);
-        conn->is_ssl = 1;
+    }
+    SSL_set_accept_state(conn->ssl_conn);
 
-        if (zeus_event_ctl(server, &conn->event, EPOLL_CTL_ADD, EPOLLIN | EPOLLET) == -1) {
-            close_connection(conn);
-            continue;
-        }
-        ZLOG_INFO("New connection: FD %d", conn_fd);
+    /**
+     * The output chain hands SSL_write one chunk at a time and consumes
+     * whatever was written, possibly from a different chunk on retry.
+     */
+
+    SSL_set_mode(conn->ssl_conn, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    conn->is_ssl = 1;
+
+    if (zeus_event_ctl(server, &conn->event, EPOLL_CTL_ADD, EPOLLIN | EPOLLET) == -1) {
+        close_connection(conn);
+        return;
     }
+
+    zeus_conn_set_timeout(conn, CONN_TIMEOUT_HANDSHAKE);
+    ZLOG_DEBUG("New connection: FD %d", conn_fd);
 }
 
 /**
@@ -259,8 +706,42 @@ static void accept_connection_cb(zeus_io_event_t *ev) {
  * reading.
  */
 
+static int zeus_conn_attach_rbuf(zeus_conn_t *conn) {
+    conn->rbuf = zeus_buf_get(conn->server->bufs);
+    if (!conn->rbuf) {
+        return -1;
+    }
+
+    conn->read_buffer = conn->rbuf->data;
+    conn->parse_cursor = conn->read_buffer;
+    conn->scan_cursor = conn->read_buffer;
+    conn->buffer_used = 0;
+    return 0;
+}
+
+/**
+ * Gives the read chunk back to the pool once nothing is buffered and no
+ * request is in progress, so idle connections hold no buffer.
+ */
+
+static void zeus_conn_release_rbuf(zeus_conn_t *conn) {
+    if (!conn->rbuf || conn->buffer_used > 0) {
+        return;
+    }
+    if (conn->protocol != PROTO_HTTP2 && conn->parser_state != PS_START_LINE) {
+        return;
+    }
+
+    zeus_buf_put(conn->server->bufs, conn->rbuf);
+    conn->rbuf = NULL;
+    conn->read_buffer = NULL;
+    conn->parse_cursor = NULL;
+    conn->scan_cursor = NULL;
+}
+
 static void handle_read_cb(zeus_io_event_t *ev) {
     zeus_conn_t *conn = ev->data;
+    int should_close = 0;
     conn_ref(conn);
 
     if (conn->closing) goto out;
@@ -271,29 +752,62 @@ static void handle_read_cb(zeus_io_event_t *ev) {
 
     if (conn->is_ssl && !conn->handshake_done) {
         int hs = zeus_handle_ssl_handshake(conn);
-        if (hs < 0) { conn->closing = 1; goto out; }
+        if (hs < 0) {
+            ZEUS_METRIC_INC(errors_handshake);
+            should_close = 1;
+            goto out;
+        }
         if (hs == 0) goto out; /** Waiting for more data in handshake. */
         
         conn->handshake_done = 1;
+        ZEUS_METRIC_INC(handshakes);
+        conn->ktls_send = BIO_get_ktls_send(SSL_get_wbio(conn->ssl_conn));
         zeus_apply_alpn(conn);
         
         if (conn->protocol == PROTO_HTTP2) {
             zeus_hpack_table_init(&conn->h2_dynamic_table);
         }
         
-        ZLOG_INFO("SSL Handshake completed for FD %d. Protocol: %s", 
+        ZLOG_DEBUG("SSL Handshake completed for FD %d. Protocol: %s%s", 
                   conn->event.fd, 
-                  conn->protocol == PROTO_HTTP2 ? "H2" : "H1.1");
+                  conn->protocol == PROTO_HTTP2 ? "H2" : "H1.1",
+                  conn->ktls_send ? " (kTLS)" : "");
+
+        zeus_conn_set_timeout(conn, conn->protocol == PROTO_HTTP2 ?
+            CONN_TIMEOUT_KEEPALIVE : CONN_TIMEOUT_HEADER);
     }
 
     while (1) {
-        if (conn->buffer_used >= sizeof(conn->read_buffer) - 1) {
+        /**
+         * The handler may have finished (and closed) the connection.
+         */
+
+        if (conn->closing) {
+            break;
+        }
+
+        if (!conn->rbuf && zeus_conn_attach_rbuf(conn) < 0) {
+            ZLOG_ERROR("Out of buffers for FD %d", conn->event.fd);
+            should_close = 1;
+            break;
+        }
+
+        if (conn->buffer_used >= ZEUS_BUF_SIZE - 1) {
+            /**
+             * Pipelined requests filled the buffer while the current
+             * response is in flight: resume once it has been flushed.
+             */
+
+            if (conn->parser_state == PS_COMPLETED) {
+                break;
+            }
+
             ZLOG_WARN("Security: read buffer full for FD %d", conn->event.fd);
-            conn->closing = 1;
+            should_close = 1;
             break;
         }
 
-        size_t space = sizeof(conn->read_buffer) - conn->buffer_used - 1;
+        size_t space = ZEUS_BUF_SIZE - conn->buffer_used - 1;
         ssize_t n;
 
         if (conn->is_ssl) {
@@ -303,30 +817,41 @@ static void handle_read_cb(zeus_io_event_t *ev) {
         }
 
         if (n > 0) {
+            ZEUS_METRIC_ADD(bytes_in, n);
             conn->buffer_used += (size_t)n;
             conn->read_buffer[conn->buffer_used] = '\0';
 
+            /**
+             * Keep the deadline of the current phase up to date.
+             */
+
+            if (conn->protocol == PROTO_HTTP2) {
+                zeus_conn_set_timeout(conn, CONN_TIMEOUT_KEEPALIVE);
+            } else if (conn->parser_state < PS_HEADERS_FINISHED) {
+                zeus_conn_set_timeout(conn, CONN_TIMEOUT_HEADER);
+            } else if (conn->parser_state == PS_BODY_IDENTITY ||
+                       conn->parser_state == PS_BODY_CHUNKED) {
+                zeus_conn_set_timeout(conn, CONN_TIMEOUT_BODY);
+            }
+
             /**
              * We call the handler to process what is already in the buffer.
              */
 
             if (conn->protocol == PROTO_HTTP2) {
-                if (zeus_h2_handler(conn) < 0) {
-                    conn->closing = 1;
+                if (zeus_h2_handler(conn) < 0 || zeus_conn_flush(conn) < 0) {
+                    should_close = 1;
                     break;
                 }
             } else {
-                http_parser_run(conn);
+                zeus_http1_drive(conn);
                 if (conn->parser_state == PS_ERROR) {
-                    conn->closing = 1;
+                    ZEUS_METRIC_INC(errors_parse);
+                    should_close = 1;
                     break;
                 }
             }
 
-            if (conn->is_ssl && SSL_pending(conn->ssl_conn) > 0) {
-                continue;
-            }
-            
             continue; 
         }
 
@@ -335,7 +860,7 @@ static void handle_read_cb(zeus_io_event_t *ev) {
          */
 
         if (n == 0) {
-            conn->closing = 1;  /** Client closed the connection. */
+            should_close = 1;  /** Client closed the connection. */
             break;
         }
 
@@ -351,13 +876,16 @@ static void handle_read_cb(zeus_io_event_t *ev) {
             }
         }
 
-        conn->closing = 1;
+        ZEUS_METRIC_INC(errors_io);
+        should_close = 1;
         break;
     }
 
 out:
-    if (conn->closing) {
+    if (should_close) {
         close_connection(conn);
+    } else if (!conn->closing) {
+        zeus_conn_release_rbuf(conn);
     }
     conn_unref(conn);
 }
@@ -365,65 +893,92 @@ out:
 
 
 /**
- * The core HTTP State Machine. Parses the request incrementally.
+ * Runs the HTTP/1.x parser until it stops making progress. A handler
+ * that answers synchronously resets the connection for the next request,
+ * so pipelined requests already in the buffer are served in order here.
  */
 
-int http_process_read_buffer(zeus_conn_t *conn) {
-    char *buffer = conn->read_buffer;
-    size_t len = conn->buffer_used;
-    char *end_of_headers = NULL;
+static void zeus_http1_drive(zeus_conn_t *conn) {
+    unsigned served;
 
-    /**
-     * Lookup for header terminator.
-     */
-    
-    end_of_headers = strstr(buffer, "\r\n\r\n");
+    if (conn->in_parser || !conn->read_buffer) {
+        return;
+    }
+
+    conn->in_parser = 1;
+    do {
+        served = conn->requests_served;
+        http_parser_run(conn);
+    } while (!conn->closing && conn->requests_served != served &&
+             conn->parser_state == PS_START_LINE && conn->buffer_used > 0);
+    conn->in_parser = 0;
+}
+
+void zeus_conn_finish_response(zeus_conn_t *conn) {
+    if (conn->closing) {
+        return;
+    }
+
+    if (shutdown_requested) {
+        conn->keep_alive = 0;
+    }
+    zeus_access_end(conn);
+    zeus_metrics_request_done(conn, conn->res.status_code);
+    zeus_access_record(conn, conn->req.method, conn->req.path, conn->res.status_code, 0);
+
+    if (!conn->keep_alive || shutdown_requested) {
+        start_graceful_close(conn);
+        return;
+    }
+
+    conn_ref(conn);
+    conn->requests_served++;
 
     /**
-     * Waiting for headers.
+     * Bytes past the current request belong to the next one: move them
+     * to the front of the buffer and start over.
      */
 
-    if (conn->parser_state <= PS_HEADERS_FINISHED) {
-        if (!end_of_headers) {
-            
-            if (len > MAX_HEADERS_LEN) {            /** Security limits... */
-                ZLOG_INFO("Security Limit: Headers too long. FD %d", conn->event.fd);
-                conn->parser_state = PS_ERROR;
-                close_connection(conn); 
-                return -1;
-            }
-            
-            conn->parser_state = PS_HEADERS;
-            return 0; 
-        }
-        
-        /** 
-         * Calls parser from initial line to fill up conn->req.
-         */
+    size_t consumed = (size_t)(conn->parse_cursor - conn->read_buffer);
+    size_t leftover = conn->buffer_used > consumed ? conn->buffer_used - consumed : 0;
 
-        if (parse_http_request(conn, &conn->req) < 0) {
-            ZLOG_WARN("HTTP Parse: Failed to parse request line or headers. FD %d", conn->event.fd);
-            conn->parser_state = PS_ERROR;
-            close_connection(conn);
-            return -1;
-        }
+    memmove(conn->read_buffer, conn->parse_cursor, leftover);
+    conn->buffer_used = leftover;
+    conn->read_buffer[leftover] = '\0';
+    conn->parse_cursor = conn->read_buffer;
+    conn->scan_cursor = conn->read_buffer;
+    conn->parser_state = PS_START_LINE;
 
-        ZLOG_INFO("HTTP headers finished processing. FD %d", conn->event.fd);
+    http_request_reset_body(conn);
+    memset(&conn->req, 0, offsetof(zeus_request_t, headers));
+    memset(&conn->res, 0, sizeof(conn->res));
+    conn->keep_alive = 0;
+    conn->event.write_cb = handle_write_cb;
 
-        /**
-         * Define the state to completed. (Ready for body but for while - COMPLETED).
-         */
+    zeus_event_ctl(conn->server, &conn->event, EPOLL_CTL_MOD, EPOLLIN | EPOLLET);
+    zeus_conn_set_timeout(conn, leftover > 0 ? CONN_TIMEOUT_HEADER : CONN_TIMEOUT_KEEPALIVE);
 
-        conn->parser_state = PS_COMPLETED;
+    if (!conn->in_parser) {
+        zeus_conn_release_rbuf(conn);
     }
 
-    if (conn->parser_state == PS_COMPLETED) {
-        ZLOG_INFO("Request fully parsed. Dispatching handler. FD %d", conn->event.fd);
-        router_dispatch(conn); 
-        return 0;
+    /**
+     * Called from the write path: serve what is already buffered, then
+     * drain the socket (and TLS records) left unread while writing.
+     */
+
+    if (!conn->in_parser) {
+        zeus_http1_drive(conn);
+
+        if (!conn->closing && conn->parser_state == PS_ERROR) {
+            ZEUS_METRIC_INC(errors_parse);
+            close_connection(conn);
+        } else if (!conn->closing && conn->parser_state != PS_COMPLETED) {
+            handle_read_cb(&conn->event);
+        }
     }
-    
-    return 0; 
+
+    conn_unref(conn);
 }
 
 /**
@@ -431,11 +986,11 @@ int http_process_read_buffer(zeus_conn_t *conn) {
  * This is the best way that i found to prevent UAF.
  */
 
-inline void conn_ref(zeus_conn_t *c) {
+void conn_ref(zeus_conn_t *c) {
     __atomic_add_fetch(&c->refcount, 1, __ATOMIC_SEQ_CST);
 }
 
-inline void conn_unref(zeus_conn_t *c) {
+void conn_unref(zeus_conn_t *c) {
     if (!c) {
         return;
     }
@@ -443,12 +998,33 @@ inline void conn_unref(zeus_conn_t *c) {
     int refs = __atomic_sub_fetch(&c->refcount, 1, __ATOMIC_SEQ_CST);
 
     if (refs == 0) {
-       free(c);
+        if (c->server && c->server->timers) {
+            zeus_timer_cancel(c->server->timers, &c->timer);
+        }
+
+        /**
+         * Buffers go back last: callbacks still on the stack may be
+         * looking at them after close_connection.
+         */
+
+        if (c->server && c->server->bufs) {
+            zeus_buf_put(c->server->bufs, c->rbuf);
+            zeus_chain_free(c->server->bufs, &c->out);
+#ifdef __linux__
+            zeus_ring_io_free(c);
+#endif
+        }
+        if (c->server && c->server->deflate && c->res.deflate) {
+            zeus_deflate_put(c->server->deflate, c->res.deflate);   /** Stream never ended. */
+        }
+        zeus_conn_pool_put(c->server->conns, c);
     }
 }
 
 /**
- * Cleans up resources and closes the connection.
+ * Cleans up resources and closes the connection. Releases the reference
+ * owned by the accept path; the memory goes away once the callbacks
+ * still running on it drop theirs.
  */
 
 void close_connection(zeus_conn_t *conn) {
@@ -460,6 +1036,13 @@ void close_connection(zeus_conn_t *conn) {
         return;
     }
 
+    ZEUS_METRIC_INC(conns_closed);
+    ZEUS_METRIC_DEC(conns_active);
+
+    if (conn->server->timers) {
+        zeus_timer_cancel(conn->server->timers, &conn->timer);
+    }
+
 #ifdef __linux__
     zeus_event_ctl(conn->server, &conn->event, EPOLL_CTL_DEL, 0);
 #endif
@@ -468,9 +1051,22 @@ void close_connection(zeus_conn_t *conn) {
         SSL_shutdown(conn->ssl_conn);
         SSL_free(conn->ssl_conn);
         conn->ssl_conn = NULL;
+
+        /**
+         * The error queue is per thread: what this connection left there
+         * (an unexpected EOF, a shutdown during the handshake) would turn
+         * the next connection's SSL_ERROR_WANT_READ into a failure.
+         */
+
+        ERR_clear_error();
     }
 
-    if (conn->event.fd >= 0) {
+    int lingering = 0;
+#ifdef __linux__
+    lingering = zeus_ring_io_close(conn);
+#endif
+
+    if (conn->event.fd >= 0 && !lingering) {
         close(conn->event.fd);
         conn->event.fd = -1;
     }
@@ -479,32 +1075,31 @@ void close_connection(zeus_conn_t *conn) {
         avl_free(conn->h2_streams);
         conn->h2_streams = NULL;
     }
+
+    free(conn->h2_header_block);
+    conn->h2_header_block = NULL;
+
+    http_request_reset_body(conn);
+
+    conn_unref(conn);
 }
 
  /**
-  * Initializes the server, creates epoll instance, and binds the socket.
+  * Creates a non-blocking TCP socket bound to host:port and puts it in
+  * listening state. With reuse_port set, SO_REUSEPORT is enabled so
+  * several sockets can share the same address.
   */
 
-zeus_server_t* zeus_server_init(zeus_config_t *config) {
-    const char *host = config->bind_host;
-    const uint16_t port = config->bind_port;
-
-    zeus_server_t *server = calloc(1, sizeof(zeus_server_t));
-    if (!server) {
-        return NULL;
-    }
-
-    server->config = *config;
+static int zeus_listen_socket_open(const char *host, uint16_t port, int reuse_port) {
 
     /**
      * Create Socket (using SOCK_NONBLOCK for asynchronous I/O)
      */
 
-    server->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
-    if (server->listen_fd < 0) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (fd < 0) {
         ZLOG_PERROR("socket failed");
-        free(server);
-        return NULL;
+        return -1;
     }
 
     /**
@@ -512,11 +1107,20 @@ zeus_server_t* zeus_server_init(zeus_config_t *config) {
      */
 
     int opt = 1;
-    if (setsockopt(server->listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
         ZLOG_PERROR("setsockopt SO_REUSEADDR failed");
-        close(server->listen_fd);
-        free(server);
-        return NULL;
+        close(fd);
+        return -1;
+    }
+
+    /**
+     * SO_REUSEPORT must be set on every socket of the group before bind.
+     */
+
+    if (reuse_port && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        ZLOG_PERROR("setsockopt SO_REUSEPORT failed");
+        close(fd);
+        return -1;
     }
 
     /**
@@ -524,33 +1128,157 @@ zeus_server_t* zeus_server_init(zeus_config_t *config) {
      */
 
     struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
     addr.sin_family = AF_INET;
     addr.sin_port = htons(port);
     if (inet_pton(AF_INET, host, &addr.sin_addr) <= 0) {
         ZLOG_PERROR("inet_pton failed (invalid host address)");
-        close(server->listen_fd);
-        free(server);
-        return NULL;
+        close(fd);
+        return -1;
     }
 
-    if (bind(server->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
         ZLOG_PERROR("bind failed");
-        close(server->listen_fd);
-        free(server);
-        return NULL;
+        close(fd);
+        return -1;
     }
 
     /**
      * Listen (Start accepting connections)
      */
 
-    if (listen(server->listen_fd, 4096) < 0) {
+    if (listen(fd, 4096) < 0) {
         ZLOG_PERROR("listen failed");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * Closes every listening socket owned by the server.
+ */
+
+static void zeus_listen_sockets_close(zeus_server_t *server) {
+    if (server->listen_fds) {
+        for (int i = 0; i < server->num_listen_fds; i++) {
+            if (server->listen_fds[i] >= 0) {
+                close(server->listen_fds[i]);
+            }
+        }
+        free(server->listen_fds);
+        server->listen_fds = NULL;
+        server->num_listen_fds = 0;
+    } else if (server->listen_fd >= 0) {
         close(server->listen_fd);
+    }
+    server->listen_fd = -1;
+}
+
+/**
+ * Selects the listening socket used by a freshly forked worker.
+ * In reuseport mode each worker takes its own socket and closes its
+ * copies of the others, so the kernel only wakes the owner.
+ */
+
+int zeus_server_bind_worker(zeus_server_t *server, int worker_id) {
+    server->worker_id = worker_id;
+
+    if (server->config.listen_mode != ZEUS_LISTEN_REUSEPORT || !server->listen_fds) {
+        return server->listen_fd >= 0 ? 0 : -1;
+    }
+
+    int slot = worker_id % server->num_listen_fds;
+    for (int i = 0; i < server->num_listen_fds; i++) {
+        if (i != slot && server->listen_fds[i] >= 0) {
+            close(server->listen_fds[i]);
+            server->listen_fds[i] = -1;
+        }
+    }
+
+    server->listen_fd = server->listen_fds[slot];
+    return server->listen_fd >= 0 ? 0 : -1;
+}
+
+ /**
+  * Initializes the server, creates epoll instance, and binds the socket.
+  */
+
+zeus_server_t* zeus_server_init(zeus_config_t *config) {
+    const char *host = config->bind_host;
+    const uint16_t port = config->bind_port;
+
+    zeus_server_t *server = calloc(1, sizeof(zeus_server_t));
+    if (!server) {
+        return NULL;
+    }
+
+    server->config = *config;
+    server->listen_fd = -1;
+    server->worker_id = -1;
+
+    zeus_log_open(config->log_file);
+    zeus_log_set_level(config->log_level);
+
+    /**
+     * Picked once in the master; workers inherit the choice on fork.
+     */
+
+    zeus_http_scan_init();
+
+    if (zeus_mime_init(config) < 0) {
+        ZLOG_ERROR("Failed to build the MIME type table.");
         free(server);
         return NULL;
     }
 
+    /**
+     * Listening sockets are always created by the master, before the
+     * privilege drop, so privileged ports keep working in both modes.
+     */
+
+    if (config->listen_mode == ZEUS_LISTEN_REUSEPORT) {
+        int count = config->num_workers > 0 ? config->num_workers : 1;
+
+        server->listen_fds = malloc(sizeof(int) * (size_t)count);
+        if (!server->listen_fds) {
+            free(server);
+            return NULL;
+        }
+
+        for (int i = 0; i < count; i++) {
+            server->listen_fds[i] = -1;
+        }
+        server->num_listen_fds = count;
+
+        for (int i = 0; i < count; i++) {
+            server->listen_fds[i] = zeus_listen_socket_open(host, port, 1);
+            if (server->listen_fds[i] < 0) {
+                zeus_listen_sockets_close(server);
+                free(server);
+                return NULL;
+            }
+        }
+
+        server->listen_fd = server->listen_fds[0];
+    } else {
+        server->listen_fd = zeus_listen_socket_open(host, port, 0);
+        if (server->listen_fd < 0) {
+            free(server);
+            return NULL;
+        }
+    }
+
+    /**
+     * Access log files are opened here too, while the master may still
+     * write anywhere. Without them the server runs unlogged.
+     */
+
+    if (zeus_access_log_open(server) < 0) {
+        ZLOG_ERROR("Access log disabled.");
+    }
+
     /**
      * Drop Privileges (Security check, after listen)
      */
@@ -577,7 +1305,9 @@ zeus_server_t* zeus_server_init(zeus_config_t *config) {
     }
     */
 
-    ZLOG_INFO("listen_fd = %d\n", server->listen_fd);
+    ZLOG_INFO("listen_fd = %d (mode: %s, sockets: %d)\n", server->listen_fd,
+        config->listen_mode == ZEUS_LISTEN_REUSEPORT ? "reuseport" : "shared",
+        server->num_listen_fds ? server->num_listen_fds : 1);
     ZLOG_INFO("zeusHttp running on %s:%d (FD: %d)\n", host, port, server->listen_fd);
     ZLOG_INFO("Security: Privileges successfully dropped.\n"); 
     
@@ -658,15 +1388,6 @@ int zeus_server_add_handler(zeus_server_t *server, const char *path, zeus_handle
 }
 
 
-/**
- * Sends a file using zero-copy (placeholder).
- *
-int zeus_response_send_file(zeus_response_t *res, const char *filepath) {
-    return 0;
-}
-*/
-
-
 
 
 
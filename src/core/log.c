@@ -1,48 +1,194 @@
 /**
  * log.c
- * Implements structured logging and timestamping. 
+ * Implements structured logging and timestamping.
+ *
+ * Records are formatted once, with a timestamp string that is rebuilt
+ * only when the second changes. The master writes them straight away;
+ * workers append them to a per-process ring that the event loop writes
+ * out in one writev before it waits for events. A worker is a single
+ * thread, so the ring needs no locks.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "../../include/core/log.h"
 #include <stdarg.h>
+#include <stdint.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+
+/**
+ * Ring size (a power of two) and the longest record kept; longer
+ * messages are truncated.
+ */
+
+#define ZEUS_LOG_RING_SIZE (256 * 1024)
+#define ZEUS_LOG_RECORD_MAX 1024
 
 static const char *level_strings[] = {
     "DEBUG", "INFO", "WARN", "ERROR", "FATAL"
 };
 
+log_level_t zeus_log_level = LOG_LEVEL_INFO;
+
+static int log_fd = STDERR_FILENO;
+static pid_t log_pid;
+
+static time_t log_second = -1;
+static char log_time[32];
+
+static char *log_ring;
+static uint64_t log_head;       /** Bytes appended since the ring was created. */
+static uint64_t log_tail;       /** Bytes written out. */
+
+int zeus_log_open(const char *path) {
+    if (!path || path[0] == '\0' || strcmp(path, "stderr") == 0) {
+        log_fd = STDERR_FILENO;
+        return 0;
+    }
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0640);
+    if (fd < 0) {
+        ZLOG_PERROR("Log: Cannot open log_file '%s', logging to stderr", path);
+        return -1;
+    }
+
+    if (log_fd != STDERR_FILENO) {
+        close(log_fd);
+    }
+    log_fd = fd;
+    return 0;
+}
+
+void zeus_log_set_level(log_level_t level) {
+    zeus_log_level = level > LOG_LEVEL_ERROR ? LOG_LEVEL_ERROR : level;
+}
+
+int zeus_log_start_async(void) {
+    log_pid = getpid();
+
+    if (log_ring) {
+        return 0;
+    }
+
+    log_ring = malloc(ZEUS_LOG_RING_SIZE);
+    if (!log_ring) {
+        return -1;
+    }
+    log_head = 0;
+    log_tail = 0;
+    atexit(zeus_log_flush);
+    return 0;
+}
+
+/**
+ * Writes all of [data, data + len), retrying short writes.
+ */
+
+static void zeus_log_write(const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(log_fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;     /** Nowhere left to report it. */
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+}
+
+void zeus_log_flush(void) {
+    while (log_ring && log_tail < log_head) {
+        size_t start = (size_t)(log_tail & (ZEUS_LOG_RING_SIZE - 1));
+        size_t pending = (size_t)(log_head - log_tail);
+        struct iovec iov[2];
+        int count = 1;
+
+        iov[0].iov_base = log_ring + start;
+        iov[0].iov_len = pending;
+        if (start + pending > ZEUS_LOG_RING_SIZE) {
+            iov[0].iov_len = ZEUS_LOG_RING_SIZE - start;
+            iov[1].iov_base = log_ring;
+            iov[1].iov_len = pending - iov[0].iov_len;
+            count = 2;
+        }
+
+        ssize_t n = writev(log_fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log_tail = log_head;    /** Drop rather than spin on a broken fd. */
+            return;
+        }
+        log_tail += (uint64_t)n;
+    }
+}
+
+static void zeus_log_append(const char *rec, size_t len) {
+    if (log_head - log_tail + len > ZEUS_LOG_RING_SIZE) {
+        zeus_log_flush();
+    }
+
+    size_t start = (size_t)(log_head & (ZEUS_LOG_RING_SIZE - 1));
+    size_t first = len < ZEUS_LOG_RING_SIZE - start ? len : ZEUS_LOG_RING_SIZE - start;
+
+    memcpy(log_ring + start, rec, first);
+    memcpy(log_ring, rec + first, len - first);
+    log_head += len;
+}
+
 void zeus_log(log_level_t level, const char *file, int line, const char *fmt, ...) {
+    char rec[ZEUS_LOG_RECORD_MAX];
+
     /**
      * Obtain timestamp.
      */
 
-    time_t timer;
-    char time_buffer[26];
-    struct tm* tm_info;
+    time_t now = time(NULL);
+    if (now != log_second) {
+        struct tm tm_info;
+        localtime_r(&now, &tm_info);
+        strftime(log_time, sizeof(log_time), "%Y-%m-%d %H:%M:%S", &tm_info);
+        log_second = now;
+    }
 
-    time(&timer);
-    tm_info = localtime(&timer);
-    strftime(time_buffer, 26, "%Y-%m-%d %H:%M:%S", tm_info);
+    if (log_pid == 0) {
+        log_pid = getpid();
+    }
 
-    fprintf(stderr, "[%s] [%s] [%d] %s:%d: ", 
-            time_buffer, 
-            level_strings[level], 
-            getpid(),   /** Include PID */
-            file, 
+    int n = snprintf(rec, sizeof(rec), "[%s] [%s] [%d] %s:%d: ",
+            log_time,
+            level_strings[level],
+            (int)log_pid,   /** Include PID */
+            file,
             line);
 
     va_list args;
     va_start(args, fmt);
-    vfprintf(stderr, fmt, args);
+    int m = vsnprintf(rec + n, sizeof(rec) - (size_t)n, fmt, args);
     va_end(args);
 
-    fprintf(stderr, "\n");
+    size_t len = (size_t)n + (m > 0 ? (size_t)m : 0);
+    if (len > sizeof(rec) - 1) {
+        len = sizeof(rec) - 1;
+    }
+    rec[len++] = '\n';
+
+    if (log_ring) {
+        zeus_log_append(rec, len);
+    } else {
+        zeus_log_write(rec, len);
+    }
 
     if (level == LOG_LEVEL_FATAL) {
+        zeus_log_flush();
         exit(EXIT_FAILURE);
     }
 }
-
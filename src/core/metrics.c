@@ -0,0 +1,420 @@
+/**
+ * metrics.c
+ * Shared counter region, per-route latency histograms and the
+ * Prometheus text exposition.
+ */
+
+#define _GNU_SOURCE
+
+#include "../../include/core/metrics.h"
+#include "../../include/core/conn.h"
+#include "../../include/core/log.h"
+#include "../../include/http/router.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+zeus_metrics_block_t *zeus_metrics_self;
+
+/**
+ * Blocks are slots, ZEUS_METRICS_SLOTS_PER_WORKER per worker id: a
+ * replacement spawned by a reload takes the other slot while the old
+ * worker drains, so each block keeps a single writer. The master
+ * alone tracks which process owns which slot.
+ */
+
+static zeus_metrics_block_t *metrics_blocks;
+static int metrics_slots;
+static int metrics_workers;
+static pid_t *metrics_owners;
+
+/**
+ * Histograms, after the blocks in the same region: for each slot,
+ * ZEUS_LATENCY_COUNT per route.
+ */
+
+static zeus_histogram_t *metrics_hists;
+static zeus_histogram_t *metrics_self_hists;
+static uint32_t metrics_routes;
+
+typedef struct {
+    const char *name;
+    const char *help;
+    const char *type;
+    size_t offset;
+} zeus_metric_desc_t;
+
+#define ZEUS_METRIC(field, name, type, help) \
+    { name, help, type, offsetof(zeus_metrics_block_t, field) }
+
+static const zeus_metric_desc_t zeus_metric_descs[] = {
+    ZEUS_METRIC(conns_accepted,   "zeus_connections_accepted_total", "counter", "Accepted connections."),
+    ZEUS_METRIC(conns_closed,     "zeus_connections_closed_total",   "counter", "Closed connections."),
+    ZEUS_METRIC(conns_active,     "zeus_connections_active",         "gauge",   "Open connections."),
+    ZEUS_METRIC(handshakes,       "zeus_tls_handshakes_total",       "counter", "Completed TLS handshakes."),
+    ZEUS_METRIC(requests_h1,      "zeus_requests_http1_total",       "counter", "HTTP/1.x requests dispatched."),
+    ZEUS_METRIC(requests_h2,      "zeus_requests_http2_total",       "counter", "HTTP/2 streams dispatched."),
+    ZEUS_METRIC(bytes_in,         "zeus_received_bytes_total",       "counter", "Bytes read from clients (before TLS)."),
+    ZEUS_METRIC(bytes_out,        "zeus_sent_bytes_total",           "counter", "Bytes written to clients (before TLS)."),
+    ZEUS_METRIC(responses_4xx,    "zeus_responses_4xx_total",        "counter", "Responses with a 4xx status."),
+    ZEUS_METRIC(responses_5xx,    "zeus_responses_5xx_total",        "counter", "Responses with a 5xx status."),
+    ZEUS_METRIC(errors_handshake, "zeus_errors_handshake_total",     "counter", "Failed TLS handshakes."),
+    ZEUS_METRIC(errors_parse,     "zeus_errors_parse_total",         "counter", "Malformed HTTP/1.x requests."),
+    ZEUS_METRIC(errors_io,        "zeus_errors_io_total",            "counter", "Failed reads and writes."),
+    ZEUS_METRIC(errors_timeout,   "zeus_errors_timeout_total",       "counter", "Connections closed by a timeout."),
+    ZEUS_METRIC(spawns,           "zeus_spawns_total",               "counter", "Worker processes started."),
+};
+
+#define ZEUS_METRIC_DESCS (sizeof(zeus_metric_descs) / sizeof(zeus_metric_descs[0]))
+
+/**
+ * Room for the exposition: three lines for the totals of each metric
+ * and one per worker, then six wider lines for each route and phase.
+ */
+
+#define ZEUS_METRICS_LINE 160
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} zeus_metrics_out_t;
+
+static void zeus_metrics_printf(zeus_metrics_out_t *out, const char *fmt, ...) {
+    va_list args;
+
+    va_start(args, fmt);
+    int n = vsnprintf(out->data + out->len, out->cap - out->len, fmt, args);
+    va_end(args);
+
+    if (n > 0) {
+        out->len += (size_t)n < out->cap - out->len ? (size_t)n : out->cap - out->len - 1;
+    }
+}
+
+/**
+ * Quantiles reported for every route and phase.
+ */
+
+static const struct {
+    double q;
+    const char *label;
+} zeus_quantiles[] = {
+    { 0.5, "0.5" }, { 0.9, "0.9" }, { 0.99, "0.99" }, { 0.999, "0.999" },
+};
+
+#define ZEUS_QUANTILES (sizeof(zeus_quantiles) / sizeof(zeus_quantiles[0]))
+
+static const char *zeus_latency_names[ZEUS_LATENCY_COUNT] = { "first_byte", "total" };
+
+static uint32_t zeus_hist_index(uint64_t us) {
+    if (us < (1u << ZEUS_HIST_SUB_BITS)) {
+        return (uint32_t)us;
+    }
+    if (us >= (1ull << ZEUS_HIST_MAX_BITS)) {
+        return ZEUS_HIST_BUCKETS - 1;
+    }
+
+    uint32_t e = 63 - (uint32_t)__builtin_clzll(us);
+    uint32_t shift = e - ZEUS_HIST_SUB_BITS;
+
+    return ((shift + 1) << ZEUS_HIST_SUB_BITS) + (uint32_t)(us >> shift) - (1u << ZEUS_HIST_SUB_BITS);
+}
+
+/**
+ * Largest value that lands in bucket idx.
+ */
+
+static uint64_t zeus_hist_upper(uint32_t idx) {
+    if (idx < (1u << ZEUS_HIST_SUB_BITS)) {
+        return idx;
+    }
+
+    uint32_t shift = (idx >> ZEUS_HIST_SUB_BITS) - 1;
+    uint64_t m = (idx & ((1u << ZEUS_HIST_SUB_BITS) - 1)) + (1u << ZEUS_HIST_SUB_BITS);
+
+    return ((m + 1) << shift) - 1;
+}
+
+static void zeus_hist_add(zeus_histogram_t *h, uint64_t us) {
+    uint64_t *bucket = &h->buckets[zeus_hist_index(us)];
+
+    __atomic_store_n(bucket, *bucket + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->sum_us, h->sum_us + us, __ATOMIC_RELAXED);
+}
+
+int zeus_metrics_init(int num_workers, uint32_t num_routes) {
+    int workers = num_workers > 0 ? num_workers : 1;
+    int count = workers * ZEUS_METRICS_SLOTS_PER_WORKER;
+    size_t blocks = sizeof(zeus_metrics_block_t) * (size_t)count;
+    size_t size = blocks + sizeof(zeus_histogram_t) * ZEUS_LATENCY_COUNT * num_routes * (size_t)count;
+
+    void *region = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        ZLOG_PERROR("Metrics: cannot map the shared region");
+        return -1;
+    }
+
+    metrics_owners = calloc((size_t)count, sizeof(pid_t));
+    if (!metrics_owners) {
+        munmap(region, size);
+        return -1;
+    }
+
+    metrics_blocks = region;    /** Zero-filled by the kernel. */
+    metrics_slots = count;
+    metrics_workers = workers;
+    metrics_hists = num_routes ? (zeus_histogram_t *)((char *)region + blocks) : NULL;
+    metrics_routes = num_routes;
+    return 0;
+}
+
+int zeus_metrics_claim(int worker_id) {
+    if (!metrics_owners || worker_id < 0) {
+        return -1;
+    }
+
+    int first = (worker_id % metrics_workers) * ZEUS_METRICS_SLOTS_PER_WORKER;
+
+    for (int slot = first; slot < first + ZEUS_METRICS_SLOTS_PER_WORKER; slot++) {
+        if (metrics_owners[slot] == 0) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+void zeus_metrics_assign(int slot, pid_t pid) {
+    if (metrics_owners && slot >= 0 && slot < metrics_slots) {
+        metrics_owners[slot] = pid;
+    }
+}
+
+int zeus_metrics_release(pid_t pid) {
+    for (int slot = 0; metrics_owners && slot < metrics_slots; slot++) {
+        if (metrics_owners[slot] == pid) {
+            metrics_owners[slot] = 0;
+
+            /**
+             * The writer is gone, and so are the connections it did not
+             * close before exiting.
+             */
+
+            __atomic_store_n(&metrics_blocks[slot].conns_active, 0, __ATOMIC_RELAXED);
+            return slot;
+        }
+    }
+    return -1;
+}
+
+void zeus_metrics_attach(int slot) {
+    if (!metrics_blocks || slot < 0 || slot >= metrics_slots) {
+        return;
+    }
+
+    zeus_metrics_block_t *block = &metrics_blocks[slot];
+
+    __atomic_store_n(&block->pid, (uint64_t)getpid(), __ATOMIC_RELAXED);
+    __atomic_store_n(&block->spawns, block->spawns + 1, __ATOMIC_RELAXED);
+    zeus_metrics_self = block;
+
+    if (metrics_hists) {
+        size_t per_worker = (size_t)metrics_routes * ZEUS_LATENCY_COUNT;
+        metrics_self_hists = &metrics_hists[(size_t)slot * per_worker];
+    }
+}
+
+void zeus_metrics_request_done(zeus_conn_t *conn, uint16_t status) {
+    const zeus_access_stamp_t *stamp = &conn->access;
+
+    if (status >= 500) {
+        ZEUS_METRIC_INC(responses_5xx);
+    } else if (status >= 400) {
+        ZEUS_METRIC_INC(responses_4xx);
+    }
+
+    if (!metrics_self_hists || stamp->route == 0 || stamp->route > metrics_routes ||
+        stamp->start_ns == 0) {
+        return;
+    }
+
+    uint64_t end_ns = stamp->end_ns ? stamp->end_ns : zeus_access_now();
+    uint64_t first_ns = stamp->first_ns ? stamp->first_ns : end_ns;
+    zeus_histogram_t *h = &metrics_self_hists[(size_t)(stamp->route - 1) * ZEUS_LATENCY_COUNT];
+
+    zeus_hist_add(&h[ZEUS_LATENCY_FIRST_BYTE], (first_ns - stamp->start_ns) / 1000);
+    zeus_hist_add(&h[ZEUS_LATENCY_TOTAL], (end_ns - stamp->start_ns) / 1000);
+}
+
+static uint64_t zeus_metrics_read(const zeus_metrics_block_t *block, size_t offset) {
+    return __atomic_load_n((const uint64_t *)((const char *)block + offset), __ATOMIC_RELAXED);
+}
+
+/**
+ * Sums one route's histogram of the given phase over all slots.
+ * Returns the number of samples.
+ */
+
+static uint64_t zeus_hist_merge(zeus_histogram_t *dst, uint32_t route, zeus_latency_t phase) {
+    uint64_t count = 0;
+
+    memset(dst, 0, sizeof(*dst));
+    for (int w = 0; w < metrics_slots; w++) {
+        size_t at = ((size_t)w * metrics_routes + route) * ZEUS_LATENCY_COUNT + phase;
+        const zeus_histogram_t *src = &metrics_hists[at];
+
+        dst->sum_us += __atomic_load_n(&src->sum_us, __ATOMIC_RELAXED);
+        for (uint32_t b = 0; b < ZEUS_HIST_BUCKETS; b++) {
+            uint64_t n = __atomic_load_n(&src->buckets[b], __ATOMIC_RELAXED);
+            dst->buckets[b] += n;
+            count += n;
+        }
+    }
+    return count;
+}
+
+/**
+ * Upper bound of the bucket holding the sample of rank ceil(q * count).
+ */
+
+static uint64_t zeus_hist_quantile(const zeus_histogram_t *h, uint64_t count, double q) {
+    uint64_t rank = (uint64_t)(q * (double)count);
+    uint64_t seen = 0;
+
+    if ((double)rank < q * (double)count) {
+        rank++;
+    }
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    for (uint32_t b = 0; b < ZEUS_HIST_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen >= rank) {
+            return zeus_hist_upper(b);
+        }
+    }
+    return zeus_hist_upper(ZEUS_HIST_BUCKETS - 1);
+}
+
+/**
+ * Copies s into dst as a label value, escaping quotes and backslashes.
+ */
+
+static void zeus_metrics_label(char *dst, size_t size, const char *s) {
+    size_t j = 0;
+
+    for (; *s && j + 2 < size; s++) {
+        if (*s == '"' || *s == '\\') {
+            dst[j++] = '\\';
+        }
+        dst[j++] = *s;
+    }
+    dst[j] = '\0';
+}
+
+static void zeus_metrics_latency(zeus_metrics_out_t *out) {
+    static const char *name = "zeus_route_latency_seconds";
+    zeus_histogram_t *merged = malloc(sizeof(*merged));
+
+    if (!merged) {
+        return;
+    }
+
+    zeus_metrics_printf(out, "# HELP %s Request latency per route, from the request headers "
+        "to the first and to the last response byte.\n# TYPE %s summary\n", name, name);
+
+    for (uint32_t r = 0; r < metrics_routes; r++) {
+        const char *method;
+        const char *pattern;
+        char labels[ZEUS_METRICS_LINE * 2];
+        char escaped[ZEUS_METRICS_LINE * 2 - 64];
+
+        if (router_route_info(r, &method, &pattern) < 0) {
+            continue;
+        }
+        zeus_metrics_label(escaped, sizeof(escaped), pattern);
+
+        for (int p = 0; p < ZEUS_LATENCY_COUNT; p++) {
+            uint64_t count = zeus_hist_merge(merged, r, (zeus_latency_t)p);
+
+            snprintf(labels, sizeof(labels), "method=\"%s\",route=\"%s\",phase=\"%s\"",
+                method, escaped, zeus_latency_names[p]);
+
+            for (size_t q = 0; q < ZEUS_QUANTILES && count; q++) {
+                uint64_t us = zeus_hist_quantile(merged, count, zeus_quantiles[q].q);
+                zeus_metrics_printf(out, "%s{%s,quantile=\"%s\"} %.6f\n",
+                    name, labels, zeus_quantiles[q].label, (double)us / 1e6);
+            }
+            zeus_metrics_printf(out, "%s_sum{%s} %.6f\n%s_count{%s} %llu\n",
+                name, labels, (double)merged->sum_us / 1e6, name, labels, (unsigned long long)count);
+        }
+    }
+
+    free(merged);
+}
+
+void zeus_metrics_handler(zeus_conn_t *conn, zeus_request_t *req) {
+    (void)req;
+
+    zeus_metrics_out_t out;
+    out.cap = ZEUS_METRIC_DESCS * ZEUS_METRICS_LINE * (size_t)(metrics_slots + 4) +
+              (size_t)metrics_routes * ZEUS_LATENCY_COUNT * (ZEUS_QUANTILES + 2) * ZEUS_METRICS_LINE * 3 +
+              ZEUS_METRICS_LINE * 2;
+    out.data = metrics_blocks ? malloc(out.cap) : NULL;
+    out.len = 0;
+
+    if (!out.data) {
+        zeus_response_set_status(&conn->res, 503);
+        zeus_response_send_data(&conn->res, "Metrics unavailable\n", 20);
+        return;
+    }
+
+    /**
+     * Totals first, then the same metric per worker (the sum of its
+     * slots) to spot an imbalanced one.
+     */
+
+    for (size_t m = 0; m < ZEUS_METRIC_DESCS; m++) {
+        const zeus_metric_desc_t *d = &zeus_metric_descs[m];
+        uint64_t total = 0;
+
+        for (int w = 0; w < metrics_slots; w++) {
+            total += zeus_metrics_read(&metrics_blocks[w], d->offset);
+        }
+
+        zeus_metrics_printf(&out, "# HELP %s %s\n# TYPE %s %s\n%s %llu\n",
+            d->name, d->help, d->name, d->type, d->name, (unsigned long long)total);
+    }
+
+    for (size_t m = 0; m < ZEUS_METRIC_DESCS; m++) {
+        const zeus_metric_desc_t *d = &zeus_metric_descs[m];
+        const char *suffix = d->name + sizeof("zeus_") - 1;
+
+        zeus_metrics_printf(&out, "# HELP zeus_worker_%s %s\n# TYPE zeus_worker_%s %s\n",
+            suffix, d->help, suffix, d->type);
+        for (int w = 0; w < metrics_workers; w++) {
+            uint64_t value = 0;
+
+            for (int s = 0; s < ZEUS_METRICS_SLOTS_PER_WORKER; s++) {
+                value += zeus_metrics_read(&metrics_blocks[w * ZEUS_METRICS_SLOTS_PER_WORKER + s], d->offset);
+            }
+            zeus_metrics_printf(&out, "zeus_worker_%s{worker=\"%d\"} %llu\n",
+                suffix, w, (unsigned long long)value);
+        }
+    }
+
+    if (metrics_hists) {
+        zeus_metrics_latency(&out);
+    }
+
+    zeus_response_set_status(&conn->res, 200);
+    zeus_response_add_header(&conn->res, "Content-Type", "text/plain; version=0.0.4");
+    zeus_response_add_header(&conn->res, "Cache-Control", "no-store");
+    zeus_response_send_data(&conn->res, out.data, out.len);
+    free(out.data);
+}
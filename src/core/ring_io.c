@@ -0,0 +1,421 @@
+/**
+ * ring_io.c
+ * TLS over io_uring receives and sends: the BIO OpenSSL talks to, the
+ * completions that feed it and the per-iteration service pass.
+ */
+
+#define _GNU_SOURCE
+
+#include "../../include/core/ring_io.h"
+#include "../../include/core/server.h"
+#include "../../include/core/log.h"
+#include "../../include/core/metrics.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#ifdef __linux__
+
+extern void zeus_dispatch_event(zeus_server_t *server, struct epoll_event *ee);
+extern void close_connection(zeus_conn_t *conn);
+
+static int zeus_ring_readable(const zeus_conn_t *conn) {
+    return !zeus_chain_empty(&conn->ring_in) || (conn->ring_state & ZEUS_RING_EOF) || conn->ring_error;
+}
+
+static int zeus_ring_writable(const zeus_conn_t *conn) {
+    return conn->ring_out.len < ZEUS_RING_OUT_MAX || conn->ring_error;
+}
+
+/**
+ * Puts the connection on the service list (once), with the readiness
+ * to report when wake is set.
+ */
+
+static void zeus_ring_queue(zeus_conn_t *conn, int wake) {
+    zeus_ring_io_t *rio = conn->server->ring_io;
+
+    if (wake && !(conn->ring_state & ZEUS_RING_WAKE)) {
+        conn->ring_state |= ZEUS_RING_WAKE;
+        rio->wakes++;
+    }
+    if (conn->ring_state & ZEUS_RING_QUEUED) {
+        return;
+    }
+
+    conn_ref(conn);
+    conn->ring_state |= ZEUS_RING_QUEUED;
+    conn->ring_next = NULL;
+    if (rio->tail) {
+        rio->tail->ring_next = conn;
+    } else {
+        rio->head = conn;
+    }
+    rio->tail = conn;
+}
+
+/**
+ * BIO callbacks. The BIO never blocks: an empty ring_in is a retry
+ * (SSL_ERROR_WANT_READ), a full ring_out too (SSL_ERROR_WANT_WRITE).
+ */
+
+static int zeus_ring_bio_write(BIO *bio, const char *data, int len) {
+    zeus_conn_t *conn = BIO_get_data(bio);
+
+    BIO_clear_retry_flags(bio);
+    if (conn->ring_error) {
+        errno = conn->ring_error;
+        return -1;
+    }
+    if (conn->ring_out.len >= ZEUS_RING_OUT_MAX) {
+        BIO_set_retry_write(bio);
+        return -1;
+    }
+    if (zeus_chain_append(conn->server->bufs, &conn->ring_out, data, (size_t)len) < 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    zeus_ring_queue(conn, 0);
+    return len;
+}
+
+static int zeus_ring_bio_read(BIO *bio, char *out, int len) {
+    zeus_conn_t *conn = BIO_get_data(bio);
+
+    BIO_clear_retry_flags(bio);
+    if (zeus_chain_empty(&conn->ring_in)) {
+        if (conn->ring_error) {
+            errno = conn->ring_error;
+            return -1;
+        }
+        if (conn->ring_state & ZEUS_RING_EOF) {
+            return 0;
+        }
+        BIO_set_retry_read(bio);
+        return -1;
+    }
+
+    ssize_t n = zeus_chain_copy_out(&conn->ring_in, out, (size_t)len, 0);
+    zeus_chain_consume(conn->server->bufs, &conn->ring_in, (size_t)n);
+
+    /**
+     * Receiving paused on a full ring_in: resume now there is room.
+     */
+
+    if (!(conn->ring_state & ZEUS_RING_RECVING) && conn->ring_in.len < ZEUS_RING_IN_MAX) {
+        zeus_ring_queue(conn, 0);
+    }
+    return (int)n;
+}
+
+static long zeus_ring_bio_ctrl(BIO *bio, int cmd, long num, void *ptr) {
+    zeus_conn_t *conn = BIO_get_data(bio);
+
+    (void)num;
+    (void)ptr;
+
+    switch (cmd) {
+        case BIO_CTRL_FLUSH:
+            return 1;
+        case BIO_CTRL_PENDING:
+            return (long)conn->ring_in.len;
+        case BIO_CTRL_WPENDING:
+            return (long)conn->ring_out.len;
+        case BIO_CTRL_EOF:
+            return (conn->ring_state & ZEUS_RING_EOF) && zeus_chain_empty(&conn->ring_in);
+        default:
+            return 0;
+    }
+}
+
+int zeus_ring_io_init(zeus_server_t *server, zeus_ring_io_t *rio) {
+    memset(rio, 0, sizeof(*rio));
+
+    if (server->config.ktls) {
+        ZLOG_INFO("io_uring: ktls = on, connections are polled.");
+        return -1;
+    }
+
+    if (zeus_uring_setup_recv_bufs(server->uring) < 0) {
+        ZLOG_INFO("io_uring: provided buffers unsupported, connections are polled.");
+        return -1;
+    }
+
+    rio->method = BIO_meth_new(BIO_get_new_index() | BIO_TYPE_SOURCE_SINK, "zeus io_uring");
+    if (!rio->method ||
+        !BIO_meth_set_write(rio->method, zeus_ring_bio_write) ||
+        !BIO_meth_set_read(rio->method, zeus_ring_bio_read) ||
+        !BIO_meth_set_ctrl(rio->method, zeus_ring_bio_ctrl)) {
+        ZLOG_ERROR("io_uring: cannot create the BIO method, connections are polled.");
+        BIO_meth_free(rio->method);
+        rio->method = NULL;
+        return -1;
+    }
+
+    rio->send_timeout.tv_sec = server->config.write_timeout > 0 ?
+        server->config.write_timeout : ZEUS_RING_SEND_TIMEOUT;
+    server->ring_io = rio;
+    return 0;
+}
+
+void zeus_ring_io_destroy(zeus_server_t *server) {
+    if (!server->ring_io) {
+        return;
+    }
+
+    BIO_meth_free(server->ring_io->method);
+    server->ring_io = NULL;
+}
+
+int zeus_ring_io_attach(zeus_conn_t *conn) {
+    BIO *bio = BIO_new(conn->server->ring_io->method);
+    if (!bio) {
+        return -1;
+    }
+
+    BIO_set_data(bio, conn);
+    BIO_set_init(bio, 1);
+    SSL_set_bio(conn->ssl_conn, bio, bio);
+
+    conn->event.ring_io = 1;
+    zeus_ring_queue(conn, 0);
+    return 0;
+}
+
+int zeus_ring_io_ctl(zeus_conn_t *conn, int op, uint32_t events) {
+    if (op == EPOLL_CTL_DEL) {
+        conn->event.events = 0;
+        return 0;
+    }
+
+    conn->event.events = events;
+    if (((events & EPOLLIN) && zeus_ring_readable(conn)) ||
+        ((events & EPOLLOUT) && zeus_ring_writable(conn))) {
+        zeus_ring_queue(conn, 1);
+    }
+    return 0;
+}
+
+/**
+ * Queues the next receive or send. Each holds a reference until its
+ * completion, so the connection (and ring_out, which the kernel reads
+ * in place) outlives it even when closed meanwhile. A send that makes
+ * no progress for write_timeout is cancelled by the kernel, so a
+ * stalled peer cannot hold a closed connection forever.
+ */
+
+static void zeus_ring_recv(zeus_conn_t *conn) {
+    if (zeus_uring_recv(conn->server->uring, conn->event.fd,
+            ZEUS_URING_UD(conn, ZEUS_URING_TAG_RECV)) < 0) {
+        conn->ring_error = EAGAIN;
+        return;
+    }
+    conn_ref(conn);
+    conn->ring_state |= ZEUS_RING_RECVING;
+}
+
+static void zeus_ring_send(zeus_conn_t *conn) {
+    int count = zeus_chain_iov(&conn->ring_out, conn->ring_iov, ZEUS_RING_IOV);
+
+    memset(&conn->ring_msg, 0, sizeof(conn->ring_msg));
+    conn->ring_msg.msg_iov = conn->ring_iov;
+    conn->ring_msg.msg_iovlen = (size_t)count;
+
+    if (zeus_uring_sendmsg(conn->server->uring, conn->event.fd, &conn->ring_msg,
+            ZEUS_URING_UD(conn, ZEUS_URING_TAG_SEND), &conn->server->ring_io->send_timeout) < 0) {
+        conn->ring_error = EAGAIN;
+        return;
+    }
+    conn_ref(conn);
+    conn->ring_state |= ZEUS_RING_SENDING;
+}
+
+static void zeus_ring_wake(zeus_conn_t *conn, uint32_t events) {
+    struct epoll_event ee;
+
+    events &= conn->event.events;
+    if (!events || conn->closing) {
+        return;
+    }
+
+    ee.events = events;
+    ee.data.ptr = &conn->event;
+    zeus_dispatch_event(conn->server, &ee);
+}
+
+static void zeus_ring_recv_done(zeus_conn_t *conn, const struct io_uring_cqe *cqe) {
+    zeus_uring_t *ring = conn->server->uring;
+    int res = cqe->res;
+
+    conn->ring_state &= ~ZEUS_RING_RECVING;
+
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+
+        if (res > 0 && !conn->closing &&
+            zeus_chain_append(conn->server->bufs, &conn->ring_in,
+                zeus_uring_recv_buf(ring, bid), (size_t)res) < 0) {
+            conn->ring_error = ENOMEM;
+        }
+        zeus_uring_recycle_buf(ring, bid);
+    }
+
+    if (conn->closing) {
+        return;
+    }
+
+    if (res == -ENOBUFS) {
+        zeus_ring_queue(conn, 0);   /** Every buffer was taken: they are back by the next wait. */
+        return;
+    }
+
+    if (res == 0) {
+        conn->ring_state |= ZEUS_RING_EOF;
+    } else if (res < 0) {
+        conn->ring_error = -res;
+    } else {
+        zeus_ring_queue(conn, 0);
+    }
+
+    zeus_ring_wake(conn, EPOLLIN);
+}
+
+static void zeus_ring_send_done(zeus_conn_t *conn, int res) {
+    conn->ring_state &= ~ZEUS_RING_SENDING;
+
+    if (res > 0) {
+        zeus_chain_consume(conn->server->bufs, &conn->ring_out, (size_t)res);
+    } else if (!conn->ring_error) {
+        conn->ring_error = res < 0 ? -res : EPIPE;
+    }
+
+    /**
+     * Closed while records were still queued: keep sending them, then
+     * close the fd that close_connection left open.
+     */
+
+    if (conn->closing) {
+        if (!conn->ring_error && !zeus_chain_empty(&conn->ring_out)) {
+            zeus_ring_send(conn);
+        }
+        if (!(conn->ring_state & ZEUS_RING_SENDING) && conn->event.fd >= 0) {
+            close(conn->event.fd);
+            conn->event.fd = -1;
+        }
+        return;
+    }
+
+    /**
+     * Cancelled by its linked timeout: the peer read nothing for
+     * write_timeout, a write timeout like the epoll backend reports.
+     */
+
+    if (res == -ECANCELED) {
+        ZEUS_METRIC_INC(errors_timeout);
+        ZLOG_DEBUG("Timeout (write) on FD %d. Closing connection.", conn->event.fd);
+        close_connection(conn);
+        return;
+    }
+
+    if (conn->ring_error) {
+        zeus_ring_wake(conn, EPOLLIN | EPOLLOUT);
+        return;
+    }
+
+    if (!zeus_chain_empty(&conn->ring_out)) {
+        zeus_ring_queue(conn, 0);
+    }
+    if (zeus_ring_writable(conn)) {
+        zeus_ring_wake(conn, EPOLLOUT);
+    }
+}
+
+void zeus_ring_io_complete(zeus_server_t *server, const struct io_uring_cqe *cqe) {
+    zeus_conn_t *conn = ZEUS_URING_UD_PTR(cqe->user_data);
+
+    (void)server;
+
+    if (ZEUS_URING_UD_TAG(cqe->user_data) == ZEUS_URING_TAG_RECV) {
+        zeus_ring_recv_done(conn, cqe);
+    } else {
+        zeus_ring_send_done(conn, cqe->res);
+    }
+    conn_unref(conn);   /** Held by the operation. */
+}
+
+/**
+ * Services the connections queued so far. Those queued again by their
+ * own callbacks wait for the next pass, which keeps every pass bounded.
+ */
+
+int zeus_ring_io_run(zeus_server_t *server) {
+    zeus_ring_io_t *rio = server->ring_io;
+    zeus_conn_t *conn = rio->head;
+
+    rio->head = NULL;
+    rio->tail = NULL;
+
+    while (conn) {
+        zeus_conn_t *next = conn->ring_next;
+        unsigned state = conn->ring_state;
+
+        conn->ring_state &= ~(ZEUS_RING_QUEUED | ZEUS_RING_WAKE);
+        if (state & ZEUS_RING_WAKE) {
+            rio->wakes--;
+        }
+
+        if ((state & ZEUS_RING_WAKE) && !conn->closing) {
+            uint32_t events = 0;
+
+            if (zeus_ring_readable(conn)) {
+                events |= EPOLLIN;
+            }
+            if (zeus_ring_writable(conn)) {
+                events |= EPOLLOUT;
+            }
+            zeus_ring_wake(conn, events);
+        }
+
+        if (!conn->closing && !conn->ring_error) {
+            if (!(conn->ring_state & (ZEUS_RING_RECVING | ZEUS_RING_EOF)) &&
+                conn->ring_in.len < ZEUS_RING_IN_MAX) {
+                zeus_ring_recv(conn);
+            }
+            if (!(conn->ring_state & ZEUS_RING_SENDING) && !zeus_chain_empty(&conn->ring_out)) {
+                zeus_ring_send(conn);
+            }
+        }
+
+        conn_unref(conn);
+        conn = next;
+    }
+
+    return rio->wakes > 0;
+}
+
+int zeus_ring_io_close(zeus_conn_t *conn) {
+    zeus_uring_t *ring = conn->server->uring;
+
+    if (!conn->event.ring_io) {
+        return 0;
+    }
+
+    if (conn->ring_state & ZEUS_RING_RECVING) {
+        zeus_uring_cancel(ring, ZEUS_URING_UD(conn, ZEUS_URING_TAG_RECV));
+    }
+    if (!(conn->ring_state & ZEUS_RING_SENDING) && !conn->ring_error &&
+        !zeus_chain_empty(&conn->ring_out)) {
+        zeus_ring_send(conn);
+    }
+    return (conn->ring_state & ZEUS_RING_SENDING) != 0;
+}
+
+void zeus_ring_io_free(zeus_conn_t *conn) {
+    zeus_chain_free(conn->server->bufs, &conn->ring_in);
+    zeus_chain_free(conn->server->bufs, &conn->ring_out);
+}
+
+#endif // __linux__
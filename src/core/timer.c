@@ -0,0 +1,189 @@
+/**
+ * timer.c
+ * Hierarchical timer wheel (4 x 64 slots) driving per-worker timeouts.
+ * Arm, re-arm and cancel are O(1) list operations, so connections can
+ * re-arm their idle timer on every read.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../../include/core/timer.h"
+
+#include <time.h>
+#include <limits.h>
+
+#define TIMER_LEVEL_SHIFT(level) (ZEUS_TIMER_SLOT_BITS * (level))
+#define TIMER_MAX_DELTA ((1ULL << TIMER_LEVEL_SHIFT(ZEUS_TIMER_LEVELS)) - 1)
+
+uint64_t zeus_monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000ULL + (uint64_t)ts.tv_nsec / 1000000ULL;
+}
+
+void zeus_timer_wheel_init(zeus_timer_wheel_t *wheel) {
+    for (int level = 0; level < ZEUS_TIMER_LEVELS; level++) {
+        for (int slot = 0; slot < ZEUS_TIMER_SLOTS; slot++) {
+            zeus_timer_t *head = &wheel->slots[level][slot];
+            head->next = head;
+            head->prev = head;
+        }
+    }
+
+    wheel->origin_ms = zeus_monotonic_ms();
+    wheel->now_ms = wheel->origin_ms;
+    wheel->tick = 0;
+    wheel->count = 0;
+}
+
+void zeus_timer_update_clock(zeus_timer_wheel_t *wheel) {
+    wheel->now_ms = zeus_monotonic_ms();
+}
+
+void zeus_timer_init(zeus_timer_t *timer, zeus_timer_cb cb, void *data) {
+    timer->next = NULL;
+    timer->prev = NULL;
+    timer->expires = 0;
+    timer->cb = cb;
+    timer->data = data;
+}
+
+static void timer_unlink(zeus_timer_t *timer) {
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = NULL;
+    timer->prev = NULL;
+}
+
+/**
+ * Places a timer in the level matching its distance from the current
+ * tick; the slot is taken from the bits of the absolute deadline.
+ */
+
+static void timer_link(zeus_timer_wheel_t *wheel, zeus_timer_t *timer) {
+    uint64_t delta = timer->expires > wheel->tick ? timer->expires - wheel->tick : 0;
+    int level = 0;
+
+    if (delta > TIMER_MAX_DELTA) {
+        timer->expires = wheel->tick + TIMER_MAX_DELTA;
+        delta = TIMER_MAX_DELTA;
+    }
+
+    while (level < ZEUS_TIMER_LEVELS - 1 && delta >= (1ULL << TIMER_LEVEL_SHIFT(level + 1))) {
+        level++;
+    }
+
+    size_t slot = (size_t)((timer->expires >> TIMER_LEVEL_SHIFT(level)) & ZEUS_TIMER_SLOT_MASK);
+    zeus_timer_t *head = &wheel->slots[level][slot];
+
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+void zeus_timer_arm(zeus_timer_wheel_t *wheel, zeus_timer_t *timer, uint32_t timeout_ms) {
+    if (zeus_timer_pending(timer)) {
+        timer_unlink(timer);
+    } else {
+        wheel->count++;
+    }
+
+    uint64_t deadline_ms = wheel->now_ms - wheel->origin_ms + timeout_ms;
+    uint64_t expires = (deadline_ms + ZEUS_TIMER_TICK_MS - 1) / ZEUS_TIMER_TICK_MS;
+
+    timer->expires = expires > wheel->tick ? expires : wheel->tick + 1;
+    timer_link(wheel, timer);
+}
+
+void zeus_timer_cancel(zeus_timer_wheel_t *wheel, zeus_timer_t *timer) {
+    if (!zeus_timer_pending(timer)) {
+        return;
+    }
+
+    timer_unlink(timer);
+    wheel->count--;
+}
+
+/**
+ * Moves every timer of an upper level slot down to the level matching
+ * its remaining distance.
+ */
+
+static void timer_cascade(zeus_timer_wheel_t *wheel, int level, size_t slot) {
+    zeus_timer_t *head = &wheel->slots[level][slot];
+
+    while (head->next != head) {
+        zeus_timer_t *timer = head->next;
+        timer_unlink(timer);
+        timer_link(wheel, timer);
+    }
+}
+
+void zeus_timer_expire(zeus_timer_wheel_t *wheel) {
+    uint64_t target = (wheel->now_ms - wheel->origin_ms) / ZEUS_TIMER_TICK_MS;
+
+    while (wheel->tick < target) {
+        if (wheel->count == 0) {
+            wheel->tick = target;
+            break;
+        }
+
+        uint64_t tick = ++wheel->tick;
+
+        /**
+         * When the lower levels wrap, refill them from the upper ones,
+         * highest level first so nothing lands in an already drained slot.
+         */
+
+        int top = 0;
+        while (top < ZEUS_TIMER_LEVELS - 1 &&
+               ((tick >> TIMER_LEVEL_SHIFT(top)) & ZEUS_TIMER_SLOT_MASK) == 0) {
+            top++;
+        }
+
+        for (int level = top; level > 0; level--) {
+            timer_cascade(wheel, level,
+                (size_t)((tick >> TIMER_LEVEL_SHIFT(level)) & ZEUS_TIMER_SLOT_MASK));
+        }
+
+        zeus_timer_t *head = &wheel->slots[0][tick & ZEUS_TIMER_SLOT_MASK];
+        while (head->next != head) {
+            zeus_timer_t *timer = head->next;
+            timer_unlink(timer);
+            wheel->count--;
+
+            if (timer->cb) {
+                timer->cb(timer);
+            }
+        }
+    }
+}
+
+int zeus_timer_next_timeout(zeus_timer_wheel_t *wheel) {
+    if (wheel->count == 0) {
+        return -1;
+    }
+
+    /**
+     * Nearest non-empty level 0 slot, or the next wrap (where upper
+     * levels cascade), whichever comes first.
+     */
+
+    uint64_t next = wheel->tick + 1;
+    for (uint64_t t = wheel->tick + 1; t <= wheel->tick + ZEUS_TIMER_SLOTS; t++) {
+        zeus_timer_t *head = &wheel->slots[0][t & ZEUS_TIMER_SLOT_MASK];
+        if (head->next != head || (t & ZEUS_TIMER_SLOT_MASK) == 0) {
+            next = t;
+            break;
+        }
+    }
+
+    uint64_t deadline_ms = wheel->origin_ms + next * ZEUS_TIMER_TICK_MS;
+    if (deadline_ms <= wheel->now_ms) {
+        return 0;
+    }
+
+    uint64_t wait_ms = deadline_ms - wheel->now_ms;
+    return wait_ms > INT_MAX ? INT_MAX : (int)wait_ms;
+}
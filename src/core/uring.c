@@ -0,0 +1,425 @@
+/**
+ * uring.c
+ * Raw io_uring ring management (setup, SQE preparation, CQE reaping)
+ * for the io_uring event backend.
+ */
+
+#define _GNU_SOURCE
+
+#include "../../include/core/uring.h"
+#include "../../include/core/log.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#ifdef __linux__
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+    unsigned flags, void *arg, size_t argsz) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/**
+ * Creates the ring and maps the SQ/CQ rings and the SQE array.
+ */
+
+int zeus_uring_init(zeus_uring_t *ring, unsigned entries) {
+    struct io_uring_params p;
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&p, 0, sizeof(p));
+    ring->ring_fd = -1;
+
+    ring->ring_fd = sys_io_uring_setup(entries, &p);
+    if (ring->ring_fd < 0) {
+        return -1;
+    }
+
+    ring->features = p.features;
+
+    /**
+     * The backend relies on timed waits (IORING_ENTER_EXT_ARG, 5.11+);
+     * older kernels are handled by the epoll fallback.
+     */
+
+    if (!(p.features & IORING_FEAT_EXT_ARG)) {
+        close(ring->ring_fd);
+        ring->ring_fd = -1;
+        return -1;
+    }
+
+    ring->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_len > ring->sq_len) {
+            ring->sq_len = ring->cq_len;
+        }
+        ring->cq_len = ring->sq_len;
+    }
+
+    ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) {
+        ring->sq_ptr = NULL;
+        goto fail;
+    }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ptr = ring->sq_ptr;
+    } else {
+        ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ptr == MAP_FAILED) {
+            ring->cq_ptr = NULL;
+            goto fail;
+        }
+    }
+
+    ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        goto fail;
+    }
+
+    char *sq = ring->sq_ptr;
+    ring->sq_head  = (unsigned *)(sq + p.sq_off.head);
+    ring->sq_tail  = (unsigned *)(sq + p.sq_off.tail);
+    ring->sq_mask  = (unsigned *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+    ring->sq_entries = p.sq_entries;
+
+    char *cq = ring->cq_ptr;
+    ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    ring->cqes    = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    return 0;
+
+fail:
+    zeus_uring_destroy(ring);
+    return -1;
+}
+
+void zeus_uring_destroy(zeus_uring_t *ring) {
+    if (ring->buf_ring) {
+        munmap(ring->buf_ring, ring->buf_ring_len +
+            (size_t)ZEUS_URING_RECV_BUFS * ZEUS_URING_RECV_BUF_SIZE);
+    }
+    if (ring->sqes) {
+        munmap(ring->sqes, ring->sqes_len);
+    }
+    if (ring->cq_ptr && ring->cq_ptr != ring->sq_ptr) {
+        munmap(ring->cq_ptr, ring->cq_len);
+    }
+    if (ring->sq_ptr) {
+        munmap(ring->sq_ptr, ring->sq_len);
+    }
+    if (ring->ring_fd >= 0) {
+        close(ring->ring_fd);
+    }
+
+    memset(ring, 0, sizeof(*ring));
+    ring->ring_fd = -1;
+}
+
+/**
+ * Number of SQEs queued that the kernel has not consumed yet.
+ */
+
+static unsigned zeus_uring_sq_ready(zeus_uring_t *ring) {
+    return *ring->sq_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Returns a zeroed SQE slot, flushing the queue to the kernel first
+ * when it is full.
+ */
+
+static struct io_uring_sqe *zeus_uring_get_sqe(zeus_uring_t *ring) {
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    unsigned tail = *ring->sq_tail;
+
+    if (tail - head >= ring->sq_entries) {
+        if (zeus_uring_submit(ring) < 0) {
+            return NULL;
+        }
+
+        head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+        if (tail - head >= ring->sq_entries) {
+            return NULL;
+        }
+    }
+
+    unsigned idx = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+
+    ring->sq_array[idx] = idx;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    return sqe;
+}
+
+int zeus_uring_poll_add(zeus_uring_t *ring, int fd, uint64_t user_data, uint32_t events) {
+    struct io_uring_sqe *sqe = zeus_uring_get_sqe(ring);
+    if (!sqe) {
+        return -1;
+    }
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->poll32_events = events;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+int zeus_uring_poll_remove(zeus_uring_t *ring, uint64_t user_data) {
+    struct io_uring_sqe *sqe = zeus_uring_get_sqe(ring);
+    if (!sqe) {
+        return -1;
+    }
+
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = user_data;
+    sqe->user_data = ZEUS_URING_UD(NULL, ZEUS_URING_TAG_IGNORE);
+    return 0;
+}
+
+int zeus_uring_accept_multishot(zeus_uring_t *ring, int fd, uint64_t user_data) {
+    struct io_uring_sqe *sqe = zeus_uring_get_sqe(ring);
+    if (!sqe) {
+        return -1;
+    }
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+/**
+ * The buffer ring and the buffers share one mapping: the ring entries
+ * on the first page(s), the buffers behind them. Closing the ring fd
+ * unregisters the group.
+ */
+
+int zeus_uring_setup_recv_bufs(zeus_uring_t *ring) {
+    struct io_uring_buf_reg reg;
+    long page = sysconf(_SC_PAGESIZE);
+    size_t ring_len = sizeof(struct io_uring_buf) * ZEUS_URING_RECV_BUFS;
+
+    ring_len = (ring_len + (size_t)page - 1) & ~((size_t)page - 1);
+
+    void *mem = mmap(NULL, ring_len + (size_t)ZEUS_URING_RECV_BUFS * ZEUS_URING_RECV_BUF_SIZE,
+        PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        return -1;
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)mem;
+    reg.ring_entries = ZEUS_URING_RECV_BUFS;
+    reg.bgid = ZEUS_URING_BGID;
+
+    if (sys_io_uring_register(ring->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        munmap(mem, ring_len + (size_t)ZEUS_URING_RECV_BUFS * ZEUS_URING_RECV_BUF_SIZE);
+        return -1;
+    }
+
+    ring->buf_ring = mem;
+    ring->buf_ring_len = ring_len;
+    ring->recv_bufs = (char *)mem + ring_len;
+    ring->buf_tail = 0;
+
+    for (unsigned bid = 0; bid < ZEUS_URING_RECV_BUFS; bid++) {
+        zeus_uring_recycle_buf(ring, bid);
+    }
+    return 0;
+}
+
+const char *zeus_uring_recv_buf(zeus_uring_t *ring, unsigned bid) {
+    return ring->recv_bufs + (size_t)bid * ZEUS_URING_RECV_BUF_SIZE;
+}
+
+void zeus_uring_recycle_buf(zeus_uring_t *ring, unsigned bid) {
+    struct io_uring_buf *buf = &ring->buf_ring->bufs[ring->buf_tail & (ZEUS_URING_RECV_BUFS - 1)];
+
+    buf->addr = (uint64_t)(uintptr_t)(ring->recv_bufs + (size_t)bid * ZEUS_URING_RECV_BUF_SIZE);
+    buf->len = ZEUS_URING_RECV_BUF_SIZE;
+    buf->bid = (unsigned short)bid;
+
+    ring->buf_tail++;
+    __atomic_store_n(&ring->buf_ring->tail, ring->buf_tail, __ATOMIC_RELEASE);
+}
+
+int zeus_uring_recv(zeus_uring_t *ring, int fd, uint64_t user_data) {
+    struct io_uring_sqe *sqe = zeus_uring_get_sqe(ring);
+    if (!sqe) {
+        return -1;
+    }
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = ZEUS_URING_BGID;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+int zeus_uring_sendmsg(zeus_uring_t *ring, int fd, const struct msghdr *msg, uint64_t user_data,
+    const struct __kernel_timespec *timeout) {
+
+    /**
+     * The send and its timeout must reach the kernel in the same
+     * submission, or the link is lost.
+     */
+
+    if (timeout && ring->sq_entries - zeus_uring_sq_ready(ring) < 2 && zeus_uring_submit(ring) < 0) {
+        return -1;
+    }
+
+    struct io_uring_sqe *sqe = zeus_uring_get_sqe(ring);
+    if (!sqe) {
+        return -1;
+    }
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = user_data;
+
+    if (!timeout) {
+        return 0;
+    }
+
+    sqe->flags |= IOSQE_IO_LINK;
+
+    sqe = zeus_uring_get_sqe(ring);
+    sqe->opcode = IORING_OP_LINK_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t)(uintptr_t)timeout;
+    sqe->len = 1;
+    sqe->user_data = ZEUS_URING_UD(NULL, ZEUS_URING_TAG_IGNORE);
+    return 0;
+}
+
+int zeus_uring_cancel(zeus_uring_t *ring, uint64_t user_data) {
+    struct io_uring_sqe *sqe = zeus_uring_get_sqe(ring);
+    if (!sqe) {
+        return -1;
+    }
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = user_data;
+    sqe->user_data = ZEUS_URING_UD(NULL, ZEUS_URING_TAG_IGNORE);
+    return 0;
+}
+
+int zeus_uring_submit(zeus_uring_t *ring) {
+    unsigned ready;
+
+    while ((ready = zeus_uring_sq_ready(ring)) > 0) {
+        int ret = sys_io_uring_enter(ring->ring_fd, ready, 0, 0, NULL, 0);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (ret == 0) break;
+    }
+    return 0;
+}
+
+/**
+ * One io_uring_enter per loop iteration: everything queued by the
+ * callbacks (poll arm/modify/remove, receives, sends) goes out together
+ * with the wait.
+ */
+
+int zeus_uring_wait(zeus_uring_t *ring, int timeout_ms) {
+    unsigned flags = IORING_ENTER_GETEVENTS;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    void *argp = NULL;
+    size_t argsz = 0;
+
+    if (timeout_ms >= 0 && (ring->features & IORING_FEAT_EXT_ARG)) {
+        memset(&arg, 0, sizeof(arg));
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000LL;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+        argp = &arg;
+        argsz = sizeof(arg);
+        flags |= IORING_ENTER_EXT_ARG;
+    }
+
+    int ret = sys_io_uring_enter(ring->ring_fd, zeus_uring_sq_ready(ring), 1, flags, argp, argsz);
+    if (ret < 0) {
+        if (errno == ETIME || errno == EINTR) {
+            return 0;
+        }
+        return -1;
+    }
+
+    return 0;
+}
+
+struct io_uring_cqe *zeus_uring_peek_cqe(zeus_uring_t *ring) {
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+    if (head == tail) {
+        return NULL;
+    }
+
+    return &ring->cqes[head & *ring->cq_mask];
+}
+
+void zeus_uring_cqe_seen(zeus_uring_t *ring) {
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Receives and sends are left alone: a connection's event sits at its
+ * start, so they carry the same pointer, and their completions release
+ * the references the operations hold.
+ */
+
+void zeus_uring_forget(zeus_uring_t *ring, const void *ptr) {
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; head++) {
+        struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+        if (ZEUS_URING_UD_PTR(cqe->user_data) == ptr &&
+            ZEUS_URING_UD_TAG(cqe->user_data) == ZEUS_URING_TAG_POLL) {
+            cqe->user_data = ZEUS_URING_UD(NULL, ZEUS_URING_TAG_IGNORE);
+        }
+    }
+}
+
+#endif // __linux__
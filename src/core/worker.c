@@ -12,6 +12,8 @@
 #include "../../include/core/server.h"
 #include "../../include/core/worker_signals.h"
 #include "../../include/core/log.h"
+#include "../../include/core/metrics.h"
+#include "../../include/http/file_shared.h"
 #include "../../include/config/config.h" 
 #include <signal.h> 
 #include <stdio.h>
@@ -25,6 +27,7 @@
 extern int worker_main_loop(zeus_server_t *server);
 extern int zeus_worker_loop(zeus_server_t *server);
 extern int zeus_drop_privileges();
+extern int zeus_server_bind_worker(zeus_server_t *server, int worker_id);
 
 static void master_reload_workers(zeus_server_t *server);
 
@@ -57,25 +60,50 @@ static void master_signal_handler(int signo) {
  */
 
 static pid_t worker_spawn(zeus_server_t *server, int worker_id) {
+    int slot = zeus_metrics_claim(worker_id);
     pid_t pid = fork();
     
     if (pid < 0) {
         perror("Error during fork.");
         return -1;
     }
+    if (pid > 0) {
+        zeus_metrics_assign(slot, pid);
+    }
     if (pid == 0) {
-        ZLOG_INFO("Worker %d (PID %d) starting up.\n", worker_id, getpid());
+        if (zeus_log_start_async() < 0) {
+            ZLOG_WARN("Worker %d: cannot allocate the log ring, logging unbuffered.", worker_id);
+        }
+        ZLOG_INFO("Worker %d (PID %d) starting up.", worker_id, getpid());
+        if (slot < 0 && server->config.metrics) {
+            ZLOG_WARN("Worker %d: both metrics slots are still in use, running without counters.", worker_id);
+        }
+        zeus_metrics_attach(slot);
+        zeus_file_shared_attach(slot);
         if (zeus_drop_privileges() < 0) {
             ZLOG_FATAL("Worker Fatal: Cannot drop privileges. Exiting.");
             exit(EXIT_FAILURE);
         }
+
+        /**
+         * Pick this worker's listening socket (own SO_REUSEPORT socket
+         * or the shared one).
+         */
+
+        if (zeus_server_bind_worker(server, worker_id) < 0) {
+            ZLOG_ERROR("Worker %d: No listening socket available.", worker_id);
+            zeus_log_flush();
+            _exit(EXIT_FAILURE);
+        }
+
         /**
          * Run the main event loop (blocking call).
          */
 
         int rc = worker_process_run(server);
         if (rc == 0) {
-            ZLOG_INFO("Worker %d (PID %d) exiting normally.\n", worker_id, getpid());
+            ZLOG_INFO("Worker %d (PID %d) exiting normally.", worker_id, getpid());
+            zeus_log_flush();
             _exit(EXIT_SUCCESS);
         } else {
             ZLOG_FATAL("Worker %d (PID %d) exiting with error (rc=%d).", worker_id, getpid(), rc);
@@ -164,6 +192,45 @@ static void master_reload_workers(zeus_server_t *server) {
 int worker_master_start(zeus_server_t *server) {
     Num_Workers = server->config.num_workers;
 
+    if (server->config.metrics &&
+        register_route("GET", server->config.metrics_path, zeus_metrics_handler) < 0) {
+        ZLOG_ERROR("Master: Cannot register the metrics route %s.", server->config.metrics_path);
+    }
+
+    /**
+     * Routes are final from here on: the table is built once and the
+     * workers share its pages, never writing to them.
+     */
+
+    if (router_freeze() < 0) {
+        ZLOG_FATAL("Master: Cannot build the route table.");
+        return -1;
+    }
+    if (server->config.dump_routes) {
+        router_dump(stderr);
+    }
+
+    /**
+     * Counters and per-route histograms live in a region every worker
+     * inherits; each one writes only its own part.
+     */
+
+    if (zeus_metrics_init(server->config.num_workers, router_route_count()) < 0) {
+        ZLOG_ERROR("Master: Metrics disabled.");
+    }
+
+    /**
+     * Small-file snapshots for the file caches, one slot per cached
+     * entry; workers hold references under their metrics slot.
+     */
+
+    if (server->config.file_cache_size > 0 && server->config.file_cache_memory_max > 0 &&
+        zeus_file_shared_init((size_t)server->config.file_cache_size,
+                              (size_t)server->config.file_cache_memory_max,
+                              server->config.num_workers * ZEUS_METRICS_SLOTS_PER_WORKER) < 0) {
+        ZLOG_ERROR("Master: Small files are sent from disk only.");
+    }
+
     Workers = calloc(server->config.num_workers, sizeof(zeus_worker_t));
     if (!Workers) {
         ZLOG_FATAL("Master: Cannot allocate workers array.");
@@ -199,6 +266,7 @@ int worker_master_start(zeus_server_t *server) {
 
         if (dead_pid > 0) {
             ZLOG_INFO("Master: Worker (PID %d) died. Status: %d\n", dead_pid, status);
+            zeus_file_shared_release(zeus_metrics_release(dead_pid));
 
             for (int i = 0; i < Num_Workers; i++) {
                 if (Workers[i].pid == dead_pid) {
@@ -0,0 +1,187 @@
+/**
+ * compress.c
+ * Deflate stream pool and gzip helpers. Pools are per worker and
+ * single-threaded.
+ */
+
+#include "../../include/http/compress.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+/**
+ * windowBits 15 + 16: zlib writes a gzip header and trailer.
+ */
+
+#define ZEUS_GZIP_WINDOW (15 + 16)
+#define ZEUS_GZIP_MEMLEVEL 8
+
+void zeus_deflate_pool_init(zeus_deflate_pool_t *pool, int level) {
+    memset(pool, 0, sizeof(*pool));
+    pool->level = level;
+}
+
+void zeus_deflate_pool_destroy(zeus_deflate_pool_t *pool) {
+    for (size_t i = 0; i < pool->num_free; i++) {
+        deflateEnd(pool->free[i]);
+        free(pool->free[i]);
+    }
+    pool->num_free = 0;
+}
+
+z_stream *zeus_deflate_get(zeus_deflate_pool_t *pool) {
+    z_stream *zs;
+
+    if (pool->num_free > 0) {
+        zs = pool->free[--pool->num_free];
+        if (deflateReset(zs) != Z_OK) {
+            deflateEnd(zs);
+            free(zs);
+            return NULL;
+        }
+    } else {
+        zs = calloc(1, sizeof(*zs));
+        if (!zs) {
+            return NULL;
+        }
+        if (deflateInit2(zs, pool->level, Z_DEFLATED, ZEUS_GZIP_WINDOW, ZEUS_GZIP_MEMLEVEL,
+                         Z_DEFAULT_STRATEGY) != Z_OK) {
+            free(zs);
+            return NULL;
+        }
+        pool->created++;
+    }
+
+    if (++pool->in_use > pool->high_water) {
+        pool->high_water = pool->in_use;
+    }
+    return zs;
+}
+
+void zeus_deflate_put(zeus_deflate_pool_t *pool, z_stream *zs) {
+    if (!zs) {
+        return;
+    }
+
+    pool->in_use--;
+    if (pool->num_free == ZEUS_DEFLATE_POOL_MAX) {
+        deflateEnd(zs);
+        free(zs);
+        return;
+    }
+    pool->free[pool->num_free++] = zs;
+}
+
+int zeus_deflate_chain(z_stream *zs, zeus_buf_pool_t *bufs, zeus_chain_t *chain,
+                       const void *data, size_t len, int flush) {
+    zs->next_in = (Bytef *)data;
+    zs->avail_in = (uInt)len;
+
+    /**
+     * Run until the input is consumed and, for a flush, until zlib stops
+     * filling the whole output space it is given.
+     */
+
+    for (;;) {
+        size_t avail;
+        char *out = zeus_chain_reserve(bufs, chain, &avail);
+        if (!out) {
+            return -1;
+        }
+
+        zs->next_out = (Bytef *)out;
+        zs->avail_out = (uInt)avail;
+
+        int r = deflate(zs, flush);
+        if (r == Z_STREAM_ERROR) {
+            return -1;
+        }
+
+        zeus_chain_commit(bufs, chain, avail - zs->avail_out);
+
+        if (r == Z_STREAM_END || (zs->avail_in == 0 && zs->avail_out > 0)) {
+            return 0;
+        }
+    }
+}
+
+int zeus_compress_type_allowed(const char *content_type) {
+    static const char *const types[] = {
+        "application/json",
+        "application/javascript",
+        "application/xml",
+        "image/svg+xml",
+    };
+
+    size_t len = strcspn(content_type, "; \t");
+
+    if (len > 5 && strncasecmp(content_type, "text/", 5) == 0) {
+        return 1;
+    }
+
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+        if (len == strlen(types[i]) && strncasecmp(content_type, types[i], len) == 0) {
+            return 1;
+        }
+    }
+
+    /**
+     * Structured suffixes: application/problem+json, application/atom+xml...
+     */
+
+    if (len > 12 && strncasecmp(content_type, "application/", 12) == 0 &&
+        ((len > 5 && strncasecmp(content_type + len - 5, "+json", 5) == 0) ||
+         (len > 4 && strncasecmp(content_type + len - 4, "+xml", 4) == 0))) {
+        return 1;
+    }
+    return 0;
+}
+
+int zeus_encoding_accepted(const char *v, size_t len, const char *coding) {
+    const char *end = v + len;
+    size_t coding_len = strlen(coding);
+    int star = 0;
+
+    while (v < end) {
+        while (v < end && (*v == ' ' || *v == '\t' || *v == ',')) {
+            v++;
+        }
+
+        const char *token = v;
+        while (v < end && *v != ',' && *v != ';' && *v != ' ' && *v != '\t') {
+            v++;
+        }
+        size_t token_len = (size_t)(v - token);
+
+        /**
+         * Only the q parameter matters, and only whether it is zero.
+         */
+
+        int weight = 1;
+        while (v < end && *v != ',') {
+            if (*v++ != ';') {
+                continue;
+            }
+            while (v < end && (*v == ' ' || *v == '\t')) {
+                v++;
+            }
+            if (end - v >= 2 && (v[0] == 'q' || v[0] == 'Q') && v[1] == '=') {
+                weight = 0;
+                for (v += 2; v < end && *v != ',' && *v != ';'; v++) {
+                    if (*v >= '1' && *v <= '9') {
+                        weight = 1;
+                    }
+                }
+            }
+        }
+
+        if (token_len == coding_len && strncasecmp(token, coding, coding_len) == 0) {
+            return weight;
+        }
+        if (token_len == 1 && *token == '*') {
+            star = weight;
+        }
+    }
+    return star;
+}
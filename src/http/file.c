@@ -1,36 +1,387 @@
 /**
  * file.c
- * Implements zero-copy file serving (sendfile) and file metadata caching.
+ * Implements zero-copy file serving (sendfile) and file metadata caching,
+ * with byte ranges and conditional requests.
  */
 
 #include "../../include/zeushttp.h"
 #include "../../include/core/conn.h"
+#include "../../include/core/server.h"
+#include "../../include/http/file_cache.h"
+#include "../../include/http/compress.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <errno.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>
-#include <unistd.h>
-#include <sys/sendfile.h>
 
-extern void close_connection(zeus_conn_t *conn);
+extern void start_graceful_close(zeus_conn_t *conn);
 
+/**
+ * More ranges than this in one request are ignored and the whole file is
+ * sent, which bounds how much a single request can amplify.
+ */
+
+#define ZEUS_MAX_RANGES 16
+
+typedef struct {
+    off_t start;
+    off_t end;          /** Inclusive. */
+} zeus_range_t;
+
+static unsigned long long boundary_seq;
+
+static int parse_digits(const char *s, int n) {
+    int v = 0;
+    for (int i = 0; i < n; i++) {
+        if (s[i] < '0' || s[i] > '9') {
+            return -1;
+        }
+        v = v * 10 + (s[i] - '0');
+    }
+    return v;
+}
+
+/**
+ * Parses an IMF-fixdate ("Sun, 06 Nov 1994 08:49:37 GMT"), the format we
+ * send in Last-Modified and browsers echo back.
+ */
+
+static int parse_http_date(const char *s, size_t len, time_t *out) {
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+    if (len != 29 || s[3] != ',' || s[4] != ' ' || s[7] != ' ' || s[11] != ' ' ||
+        s[16] != ' ' || s[19] != ':' || s[22] != ':' || s[25] != ' ' || memcmp(s + 26, "GMT", 3) != 0) {
+        return -1;
+    }
+
+    int day = parse_digits(s + 5, 2);
+    int year = parse_digits(s + 12, 4);
+    int hour = parse_digits(s + 17, 2);
+    int min = parse_digits(s + 20, 2);
+    int sec = parse_digits(s + 23, 2);
+
+    int month = 0;
+    while (month < 12 && memcmp(months + month * 3, s + 8, 3) != 0) {
+        month++;
+    }
+
+    if (day < 1 || day > 31 || year < 1970 || month == 12 ||
+        hour < 0 || hour > 23 || min < 0 || min > 59 || sec < 0 || sec > 60) {
+        return -1;
+    }
+    month++;
+
+    /**
+     * Days since the epoch for a proleptic Gregorian date.
+     */
+
+    long y = year - (month <= 2);
+    long era = y / 400;
+    long yoe = y - era * 400;
+    long doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    long days = era * 146097 + doe - 719468;
+
+    *out = (time_t)days * 86400 + hour * 3600 + min * 60 + sec;
+    return 0;
+}
 
 /**
- * Sends a static file using zero-copy (sendfile).
+ * If-None-Match: "*" or a list of entity tags, compared weakly (a W/
+ * prefix is ignored).
+ */
+
+static int etag_list_matches(const char *v, size_t len, const char *etag) {
+    const char *end = v + len;
+    size_t etag_len = strlen(etag);
+
+    while (v < end) {
+        while (v < end && (*v == ' ' || *v == '\t' || *v == ',')) {
+            v++;
+        }
+
+        const char *item = v;
+        while (v < end && *v != ',') {
+            v++;
+        }
+
+        const char *item_end = v;
+        while (item_end > item && (item_end[-1] == ' ' || item_end[-1] == '\t')) {
+            item_end--;
+        }
+
+        if (item_end - item == 1 && *item == '*') {
+            return 1;
+        }
+        if (item_end - item > 2 && item[0] == 'W' && item[1] == '/') {
+            item += 2;
+        }
+        if ((size_t)(item_end - item) == etag_len && memcmp(item, etag, etag_len) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * If-None-Match wins over If-Modified-Since when both are present.
+ */
+
+static int file_not_modified(const zeus_request_t *req, const zeus_file_entry_t *file) {
+    size_t len;
+    const char *v = zeus_request_header(req, "If-None-Match", &len);
+    if (v) {
+        return etag_list_matches(v, len, file->etag);
+    }
+
+    time_t since;
+    v = zeus_request_header(req, "If-Modified-Since", &len);
+    if (v && parse_http_date(v, len, &since) == 0) {
+        return file->mtime <= since;
+    }
+    return 0;
+}
+
+/**
+ * If-Range: the range is honoured only when the client's copy is current,
+ * judged by strong ETag comparison or an exact Last-Modified date.
+ */
+
+static int file_range_allowed(const zeus_request_t *req, const zeus_file_entry_t *file) {
+    size_t len;
+    const char *v = zeus_request_header(req, "If-Range", &len);
+    if (!v) {
+        return 1;
+    }
+
+    if (len > 0 && (v[0] == '"' || v[0] == 'W')) {
+        return len == strlen(file->etag) && memcmp(v, file->etag, len) == 0;
+    }
+
+    time_t date;
+    return parse_http_date(v, len, &date) == 0 && date == file->mtime;
+}
+
+/**
+ * Parses "bytes=a-b, c-, -n" against a file of the given size. Returns
+ * the satisfiable ranges found (0: none, answer 416) or -1 when the
+ * header is malformed or asks for too many ranges, in which case it is
+ * ignored and the whole file is sent.
+ */
+
+static int parse_ranges(const char *v, size_t len, off_t size, zeus_range_t *ranges, int max) {
+    const char *end = v + len;
+    int count = 0;
+    int specs = 0;
+
+    if (len < 6 || strncasecmp(v, "bytes=", 6) != 0) {
+        return -1;
+    }
+    v += 6;
+
+    while (v < end) {
+        while (v < end && (*v == ' ' || *v == '\t' || *v == ',')) {
+            v++;
+        }
+        if (v == end) {
+            break;
+        }
+
+        uint64_t first = 0, last = 0;
+        int has_first = 0, has_last = 0;
+
+        for (; v < end && *v >= '0' && *v <= '9'; v++, has_first = 1) {
+            if (first > (UINT64_MAX - 9) / 10) {
+                return -1;
+            }
+            first = first * 10 + (uint64_t)(*v - '0');
+        }
+        if (v == end || *v != '-') {
+            return -1;
+        }
+        v++;
+        for (; v < end && *v >= '0' && *v <= '9'; v++, has_last = 1) {
+            if (last > (UINT64_MAX - 9) / 10) {
+                return -1;
+            }
+            last = last * 10 + (uint64_t)(*v - '0');
+        }
+
+        while (v < end && (*v == ' ' || *v == '\t')) {
+            v++;
+        }
+        if ((v < end && *v != ',') || (!has_first && !has_last) || (has_first && has_last && last < first)) {
+            return -1;
+        }
+        specs++;
+
+        uint64_t total = (uint64_t)size;
+        zeus_range_t r;
+
+        if (!has_first) {
+            if (last == 0 || total == 0) {
+                continue;
+            }
+            r.start = (off_t)(last >= total ? 0 : total - last);
+            r.end = (off_t)(total - 1);
+        } else {
+            if (first >= total) {
+                continue;
+            }
+            r.start = (off_t)first;
+            r.end = (off_t)(!has_last || last >= total ? total - 1 : last);
+        }
+
+        if (count == max) {
+            return -1;
+        }
+        ranges[count++] = r;
+    }
+
+    return specs > 0 ? count : -1;
+}
+
+/**
+ * Picks the preferred precompressed sibling the client accepts. A
+ * sibling older than the file is stale (not regenerated) and skipped.
+ */
+
+static zeus_file_entry_t *select_variant(zeus_server_t *server, const zeus_request_t *req,
+                                         const zeus_file_entry_t *file, const char *filepath,
+                                         const char **encoding) {
+    size_t len;
+    const char *accept = zeus_request_header(req, "Accept-Encoding", &len);
+    if (!accept) {
+        return NULL;
+    }
+
+    for (int i = 0; i < ZEUS_FILE_ENCODINGS; i++) {
+        if (!(file->variants & (1u << i)) || !zeus_encoding_accepted(accept, len, zeus_file_encodings[i].name)) {
+            continue;
+        }
+
+        zeus_file_entry_t *variant = zeus_file_cache_get_variant(server->files, filepath, i, server->timers->now_ms);
+        if (!variant) {
+            continue;
+        }
+        if (variant->mtime < file->mtime) {
+            zeus_file_entry_release(variant);
+            continue;
+        }
+
+        *encoding = zeus_file_encodings[i].name;
+        return variant;
+    }
+    return NULL;
+}
+
+/**
+ * Queues the representation headers in one piece: the file's
+ * Content-Type (left out for 304 and multipart), Content-Encoding and
+ * Vary when the file has variants, then the validators of rep, the
+ * entry actually sent.
+ */
+
+static int queue_file_headers(zeus_conn_t *conn, const zeus_file_entry_t *file, const zeus_file_entry_t *rep,
+                              const char *encoding, int with_type) {
+    char block[ZEUS_FILE_HEADERS_MAX * 2];
+    size_t n = 0;
+
+    if (with_type) {
+        memcpy(block, file->headers, file->type_len);
+        n = file->type_len;
+    }
+    if (encoding) {
+        n += (size_t)snprintf(block + n, sizeof(block) - n, "Content-Encoding: %s\r\n", encoding);
+    }
+    if (file->variants) {
+        n += (size_t)snprintf(block + n, sizeof(block) - n, "Vary: Accept-Encoding\r\n");
+    }
+
+    memcpy(block + n, rep->headers + rep->type_len, rep->headers_len - rep->type_len);
+    n += rep->headers_len - rep->type_len;
+
+    return zeus_conn_queue(conn, block, n);
+}
+
+/**
+ * Queues len bytes of the file at offset: from the in-memory copy for
+ * small files, as a sendfile range otherwise. The segment holds its own
+ * reference on the entry and drops it once sent or freed; the fd (or
+ * copy) stays in the cache.
+ */
+
+static int queue_file_range(zeus_buf_pool_t *pool, zeus_chain_t *chain, zeus_file_entry_t *file,
+                            off_t offset, size_t len) {
+    zeus_file_entry_ref(file);
+
+    if (file->data) {
+        return zeus_chain_append_ref_shared(pool, chain, file->data + offset, len,
+                                            zeus_file_entry_release, file);
+    }
+    return zeus_chain_append_file_shared(pool, chain, file->fd, offset, len,
+                                         zeus_file_entry_release, file);
+}
+
+/**
+ * multipart/byteranges body: each part carries the file's Content-Type
+ * and its own Content-Range; the bytes come from rep.
+ */
+
+static int queue_multipart(zeus_buf_pool_t *pool, zeus_chain_t *body, const zeus_file_entry_t *file,
+                           zeus_file_entry_t *rep, const zeus_range_t *ranges, int num_ranges,
+                           const char *boundary) {
+    char part[256];
+
+    for (int i = 0; i < num_ranges; i++) {
+        int n = snprintf(part, sizeof(part),
+            "\r\n--%s\r\n%.*sContent-Range: bytes %lld-%lld/%lld\r\n\r\n",
+            boundary, (int)file->type_len, file->headers,
+            (long long)ranges[i].start, (long long)ranges[i].end, (long long)rep->size);
+
+        if (n <= 0 || (size_t)n >= sizeof(part) ||
+            zeus_chain_append(pool, body, part, (size_t)n) < 0 ||
+            queue_file_range(pool, body, rep, ranges[i].start,
+                             (size_t)(ranges[i].end - ranges[i].start + 1)) < 0) {
+            return -1;
+        }
+    }
+
+    int n = snprintf(part, sizeof(part), "\r\n--%s--\r\n", boundary);
+    return zeus_chain_append(pool, body, part, (size_t)n);
+}
+
+/**
+ * Sends a static file. The fd, size and headers come from the worker's
+ * file cache, so a hot file costs no open/fstat/close per request. The
+ * file is queued as a range behind the headers and streamed as the
+ * socket accepts it: whatever does not fit in the send buffer now is
+ * resumed on EPOLLOUT from the last offset sent, so slow clients get
+ * the whole file without blocking the worker.
+ *
+ * When a precompressed sibling (.br / .zst / .gz) exists and the client
+ * accepts its coding, that file is sent instead, as is, with
+ * Content-Encoding set; nothing is compressed at request time.
+ *
+ * GET and HEAD requests are answered from the cached validators: 304
+ * when the client's copy is current (If-None-Match / If-Modified-Since).
+ * GET also gets 206 with only the requested bytes for Range (If-Range
+ * permitting), 416 when no requested range lies inside the file. HEAD
+ * gets the headers of the full response without the file.
  */
 
 
 int zeus_response_send_file(zeus_response_t *res, const char *filepath) {
     zeus_conn_t *conn = (zeus_conn_t*)((char*)res - offsetof(zeus_conn_t, res));
-    int total_bytes_sent = 0;
-    ssize_t headers_sent = 0;
+    zeus_server_t *server = conn->server;
+    zeus_buf_pool_t *pool = server->bufs;
+    zeus_request_t *req = &conn->req;
 
-    int file_fd = open(filepath, O_RDONLY);
-    if (file_fd < 0) {
+    zeus_file_entry_t *file = zeus_file_cache_get(server->files, filepath, server->timers->now_ms);
+    if (!file) {
         fprintf(stderr, "File not found: %s\n", filepath);
         zeus_response_set_status(res, 404);
         zeus_response_add_header(res, "Content-Type", "text/plain");
@@ -38,66 +389,119 @@ int zeus_response_send_file(zeus_response_t *res, const char *filepath) {
         return -1;
     }
 
-    struct stat stat_buf;
-    if (fstat(file_fd, &stat_buf) < 0) {
-        close(file_fd);
-        close_connection(conn);
-        return -1;
+    /**
+     * rep is the representation actually sent: the file itself or one of
+     * its precompressed variants. Validators, ranges and the body come
+     * from it; the Content-Type always comes from the file.
+     */
+
+    const char *encoding = NULL;
+    zeus_file_entry_t *rep = NULL;
+    if (file->variants) {
+        rep = select_variant(server, req, file, filepath, &encoding);
+    }
+    if (!rep) {
+        rep = zeus_file_entry_ref(file);
     }
-    off_t file_size = stat_buf.st_size;
+
+    int is_get = req->method && strcmp(req->method, "GET") == 0;
+    int rc;
 
     /**
-     * Generate HTTP headers.
+     * 304: only the validators, no body.
      */
-    zeus_response_set_status(res, 200);
-    zeus_response_add_header(res, "Content-Type", "application/octet-stream");
+
+    if ((is_get || conn->head_request) && file_not_modified(req, rep)) {
+        zeus_response_set_status(res, 304);
+
+        rc = queue_file_headers(conn, file, rep, encoding, 0);
+        zeus_file_entry_release(rep);
+        zeus_file_entry_release(file);
+
+        if (rc < 0 || zeus_response_queue_head(conn, 0) < 0) {
+            start_graceful_close(conn);
+            return -1;
+        }
+        return zeus_response_flush(conn);
+    }
+
+    zeus_range_t ranges[ZEUS_MAX_RANGES];
+    int num_ranges = -1;
+    size_t range_len;
+    const char *range = is_get ? zeus_request_header(req, "Range", &range_len) : NULL;
+
+    if (range && file_range_allowed(req, rep)) {
+        num_ranges = parse_ranges(range, range_len, rep->size, ranges, ZEUS_MAX_RANGES);
+    }
+
+    if (num_ranges == 0) {
+        char content_range[48];
+        snprintf(content_range, sizeof(content_range), "bytes */%lld", (long long)rep->size);
+        zeus_file_entry_release(rep);
+        zeus_file_entry_release(file);
+
+        zeus_response_set_status(res, 416);
+        zeus_response_add_header(res, "Content-Range", content_range);
+        return zeus_response_send_data(res, "", 0);
+    }
 
     /**
-     * Attach Content-Lenght and close headers in response buffer.
+     * The body is assembled on its own chain first so its length (file
+     * ranges included) is known when the head is written.
      */
 
-    size_t required_len = snprintf(
-        conn->response_buffer + conn->response_len,
-        MAX_RESPONSE_BUFFER - conn->response_len,
-        "Content-Lenght: %ld\r\n\r\n", (long)file_size);
-    conn->response_len += required_len;
-
-    char status_line_buf[128];
-    const char *status_msg = "OK";
-    int status_line_len = snprintf(status_line_buf, 128,
-        "HTTP/1.1 %u %s\r\n", res->status_code, status_msg);
-
-    memmove(conn->response_buffer + status_line_len,
-        conn->response_buffer, conn->response_len);
-    memcpy(conn->response_buffer, status_line_buf, (size_t)status_line_len);
-    conn->response_len += (size_t)status_line_len;
-
-    headers_sent = write(conn->event.fd, conn->response_buffer, conn->response_len);
-    if (headers_sent <= 0) {
-        close(file_fd);
-        close_connection(conn);
-        return -1;
-    }
-    total_bytes_sent += (int)headers_sent;
+    zeus_chain_t body = {0};
 
-    off_t offset = 0;
-    ssize_t bytes_transferred = sendfile(
-        conn->event.fd,
-        file_fd,
-        &offset,
-        file_size
-    );
+    if (num_ranges < 0) {
+        zeus_response_set_status(res, 200);
+        rc = queue_file_headers(conn, file, rep, encoding, 1);
+        if (rc == 0) {
+            rc = queue_file_range(pool, &body, rep, 0, (size_t)rep->size);
+        }
+    } else if (num_ranges == 1) {
+        char content_range[96];
+        snprintf(content_range, sizeof(content_range), "bytes %lld-%lld/%lld",
+            (long long)ranges[0].start, (long long)ranges[0].end, (long long)rep->size);
 
-   if (bytes_transferred < 0 || bytes_transferred != file_size) {
-        fprintf(stderr, "Error during sendfile: %ld/%ld bytes sent (Error: %d)\n", (long)bytes_transferred, (long)file_size, errno);
-        total_bytes_sent = -1;
+        zeus_response_set_status(res, 206);
+        rc = queue_file_headers(conn, file, rep, encoding, 1);
+        if (rc == 0) {
+            rc = zeus_response_add_header(res, "Content-Range", content_range);
+        }
+        if (rc == 0) {
+            rc = queue_file_range(pool, &body, rep, ranges[0].start,
+                                  (size_t)(ranges[0].end - ranges[0].start + 1));
+        }
     } else {
-        total_bytes_sent += (int)bytes_transferred;
+        char boundary[40];
+        char content_type[80];
+        snprintf(boundary, sizeof(boundary), "zeus%08llx%08llx",
+            (unsigned long long)(server->timers->now_ms & 0xffffffffu), ++boundary_seq);
+        snprintf(content_type, sizeof(content_type), "multipart/byteranges; boundary=%s", boundary);
+
+        zeus_response_set_status(res, 206);
+        rc = queue_file_headers(conn, file, rep, encoding, 0);
+        if (rc == 0) {
+            rc = zeus_response_add_header(res, "Content-Type", content_type);
+        }
+        if (rc == 0) {
+            rc = queue_multipart(pool, &body, file, rep, ranges, num_ranges, boundary);
+        }
     }
 
-    close(file_fd);
-    close_connection(conn);
+    zeus_file_entry_release(rep);
+    zeus_file_entry_release(file);
 
-    return total_bytes_sent;
-}
+    if (rc < 0 || zeus_response_queue_head(conn, (uint64_t)body.len) < 0) {
+        zeus_chain_free(pool, &body);
+        start_graceful_close(conn);
+        return -1;
+    }
 
+    if (conn->head_request) {
+        zeus_chain_free(pool, &body);
+    } else {
+        zeus_chain_concat(&conn->out, &body);
+    }
+    return zeus_response_flush(conn);
+}
@@ -0,0 +1,333 @@
+/**
+ * file_cache.c
+ * Open-file cache for static file serving. Caches are per worker and
+ * single-threaded.
+ */
+
+#define _XOPEN_SOURCE 700
+
+#include "../../include/http/file_cache.h"
+#include "../../include/http/file_shared.h"
+#include "../../include/http/mime.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <limits.h>
+
+const zeus_file_encoding_t zeus_file_encodings[ZEUS_FILE_ENCODINGS] = {
+    { "br",   ".br"  },
+    { "zstd", ".zst" },
+    { "gzip", ".gz"  },
+};
+
+/**
+ * FNV-1a over the path.
+ */
+
+static uint32_t zeus_file_hash(const char *path) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)path; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+int zeus_file_cache_init(zeus_file_cache_t *cache, size_t max_entries, unsigned ttl_sec, size_t memory_max,
+                         int precompressed) {
+    memset(cache, 0, sizeof(*cache));
+    cache->max_entries = max_entries;
+    cache->ttl_ms = (uint64_t)ttl_sec * 1000;
+    cache->memory_max = memory_max;
+    cache->precompressed = precompressed;
+
+    if (max_entries == 0) {
+        return 0;
+    }
+
+    /**
+     * Power-of-two table, about two buckets per entry.
+     */
+
+    size_t n = 16;
+    while (n < max_entries * 2) {
+        n <<= 1;
+    }
+
+    cache->buckets = calloc(n, sizeof(*cache->buckets));
+    if (!cache->buckets) {
+        cache->max_entries = 0;
+        return -1;
+    }
+    cache->num_buckets = n;
+    return 0;
+}
+
+void zeus_file_entry_release(void *arg) {
+    zeus_file_entry_t *entry = arg;
+
+    if (--entry->refs > 0) {
+        return;
+    }
+
+    if (entry->data) {
+        zeus_file_shared_put(entry->shared);
+    }
+    close(entry->fd);
+    free(entry->path);
+    free(entry);
+}
+
+static void zeus_lru_unlink(zeus_file_cache_t *cache, zeus_file_entry_t *entry) {
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        cache->lru_head = entry->next;
+    }
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        cache->lru_tail = entry->prev;
+    }
+    entry->prev = NULL;
+    entry->next = NULL;
+}
+
+static void zeus_lru_push(zeus_file_cache_t *cache, zeus_file_entry_t *entry) {
+    entry->prev = NULL;
+    entry->next = cache->lru_head;
+    if (cache->lru_head) {
+        cache->lru_head->prev = entry;
+    } else {
+        cache->lru_tail = entry;
+    }
+    cache->lru_head = entry;
+}
+
+/**
+ * Takes the entry out of the table and drops the cache's reference.
+ * Responses still sending it keep the fd open until they finish.
+ */
+
+static void zeus_file_cache_remove(zeus_file_cache_t *cache, zeus_file_entry_t *entry) {
+    zeus_file_entry_t **pp = &cache->buckets[entry->hash & (cache->num_buckets - 1)];
+    while (*pp != entry) {
+        pp = &(*pp)->hnext;
+    }
+    *pp = entry->hnext;
+
+    zeus_lru_unlink(cache, entry);
+    entry->cached = 0;
+    cache->count--;
+    zeus_file_entry_release(entry);
+}
+
+void zeus_file_cache_destroy(zeus_file_cache_t *cache) {
+    while (cache->lru_head) {
+        zeus_file_cache_remove(cache, cache->lru_head);
+    }
+    free(cache->buckets);
+    cache->buckets = NULL;
+    cache->num_buckets = 0;
+}
+
+/**
+ * Headers that only depend on the file, rendered once when it is opened.
+ */
+
+static void zeus_file_render_headers(zeus_file_entry_t *entry) {
+    struct tm tm;
+
+    snprintf(entry->etag, sizeof(entry->etag), "\"%llx-%llx\"",
+        (unsigned long long)entry->mtime, (unsigned long long)entry->size);
+
+    if (!gmtime_r(&entry->mtime, &tm) ||
+        strftime(entry->last_modified, sizeof(entry->last_modified), "%a, %d %b %Y %H:%M:%S GMT", &tm) == 0) {
+        entry->last_modified[0] = '\0';
+    }
+
+    int n = snprintf(entry->headers, sizeof(entry->headers),
+        "Content-Type: %s\r\n", zeus_mime_type(entry->path));
+    entry->type_len = (size_t)n;
+
+    n += snprintf(entry->headers + n, sizeof(entry->headers) - n,
+        "Accept-Ranges: bytes\r\n"
+        "ETag: %s\r\n",
+        entry->etag);
+
+    if (entry->last_modified[0] != '\0') {
+        n += snprintf(entry->headers + n, sizeof(entry->headers) - n,
+            "Last-Modified: %s\r\n", entry->last_modified);
+    }
+    entry->headers_len = (size_t)n;
+}
+
+/**
+ * Looks for path.br / path.zst / path.gz. A path that is itself one of
+ * those is not probed further.
+ */
+
+static unsigned zeus_file_probe_variants(const char *path) {
+    size_t len = strlen(path);
+    char sibling[PATH_MAX];
+    unsigned found = 0;
+
+    for (int i = 0; i < ZEUS_FILE_ENCODINGS; i++) {
+        size_t ext_len = strlen(zeus_file_encodings[i].ext);
+        if (len > ext_len && strcmp(path + len - ext_len, zeus_file_encodings[i].ext) == 0) {
+            return 0;
+        }
+    }
+
+    for (int i = 0; i < ZEUS_FILE_ENCODINGS; i++) {
+        struct stat st;
+
+        if (snprintf(sibling, sizeof(sibling), "%s%s", path, zeus_file_encodings[i].ext) >= (int)sizeof(sibling)) {
+            continue;
+        }
+        if (stat(sibling, &st) == 0 && S_ISREG(st.st_mode)) {
+            found |= 1u << i;
+        }
+    }
+    return found;
+}
+
+static zeus_file_entry_t *zeus_file_open(const char *path, uint32_t hash, size_t memory_max) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        errno = ENOENT;
+        return NULL;
+    }
+
+    zeus_file_entry_t *entry = calloc(1, sizeof(*entry));
+    if (!entry || !(entry->path = strdup(path))) {
+        free(entry);
+        close(fd);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    entry->hash = hash;
+    entry->fd = fd;
+    entry->size = st.st_size;
+    entry->mtime = st.st_mtime;
+    entry->ino = st.st_ino;
+    entry->dev = st.st_dev;
+    entry->refs = 1;
+
+    entry->shared = -1;
+
+    /**
+     * Small files are served from the shared snapshot, so the body always
+     * matches the Content-Length and ETag rendered here even if the file
+     * is rewritten in place; without one the file is sent as a range like
+     * any other.
+     */
+
+    if (st.st_size > 0 && (size_t)st.st_size <= memory_max) {
+        entry->data = zeus_file_shared_get(fd, &st, &entry->shared);
+    }
+
+    zeus_file_render_headers(entry);
+    return entry;
+}
+
+/**
+ * Checks a cached entry against the file currently at its path. Catches
+ * edits in place (size / mtime) and replacements (inode).
+ */
+
+static int zeus_file_still_valid(const zeus_file_entry_t *entry) {
+    struct stat st;
+
+    if (stat(entry->path, &st) < 0) {
+        return 0;
+    }
+    return st.st_ino == entry->ino && st.st_dev == entry->dev &&
+           st.st_size == entry->size && st.st_mtime == entry->mtime;
+}
+
+zeus_file_entry_t *zeus_file_cache_get(zeus_file_cache_t *cache, const char *path, uint64_t now_ms) {
+    uint32_t hash = zeus_file_hash(path);
+    zeus_file_entry_t *entry;
+
+    if (cache->max_entries == 0) {
+        cache->misses++;
+        entry = zeus_file_open(path, hash, 0);
+        if (entry && cache->precompressed) {
+            entry->variants = zeus_file_probe_variants(path);
+        }
+        return entry;
+    }
+
+    entry = cache->buckets[hash & (cache->num_buckets - 1)];
+    while (entry && (entry->hash != hash || strcmp(entry->path, path) != 0)) {
+        entry = entry->hnext;
+    }
+
+    if (entry && now_ms - entry->validated_ms >= cache->ttl_ms) {
+        if (zeus_file_still_valid(entry)) {
+            entry->validated_ms = now_ms;
+            if (cache->precompressed) {
+                entry->variants = zeus_file_probe_variants(path);
+            }
+        } else {
+            zeus_file_cache_remove(cache, entry);
+            entry = NULL;
+        }
+    }
+
+    if (entry) {
+        cache->hits++;
+        zeus_lru_unlink(cache, entry);
+        zeus_lru_push(cache, entry);
+        entry->refs++;
+        return entry;
+    }
+
+    cache->misses++;
+    entry = zeus_file_open(path, hash, cache->memory_max);
+    if (!entry) {
+        return NULL;
+    }
+    if (cache->precompressed) {
+        entry->variants = zeus_file_probe_variants(path);
+    }
+
+    if (cache->count >= cache->max_entries) {
+        zeus_file_cache_remove(cache, cache->lru_tail);
+        cache->evictions++;
+    }
+
+    size_t b = hash & (cache->num_buckets - 1);
+    entry->hnext = cache->buckets[b];
+    cache->buckets[b] = entry;
+    zeus_lru_push(cache, entry);
+    cache->count++;
+
+    entry->cached = 1;
+    entry->validated_ms = now_ms;
+    entry->refs++;              /** One for the cache, one for the caller. */
+    return entry;
+}
+
+zeus_file_entry_t *zeus_file_cache_get_variant(zeus_file_cache_t *cache, const char *path, int i, uint64_t now_ms) {
+    char sibling[PATH_MAX];
+
+    if (snprintf(sibling, sizeof(sibling), "%s%s", path, zeus_file_encodings[i].ext) >= (int)sizeof(sibling)) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+    return zeus_file_cache_get(cache, sibling, now_ms);
+}
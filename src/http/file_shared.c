@@ -0,0 +1,256 @@
+/**
+ * file_shared.c
+ * Shared small-file snapshots. One process-shared robust mutex guards
+ * the slot table; it is only taken when a worker opens a file or drops
+ * an entry, never while a response is sent.
+ */
+
+#define _GNU_SOURCE
+
+#include "../../include/http/file_shared.h"
+#include "../../include/core/log.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/**
+ * A slot holds one file as it was when read. It is matched on the key
+ * (dev, ino, size, mtime) once ready, and reused for another file,
+ * least recently handed out first, when no process holds a reference.
+ * A size of 0 marks a slot never used.
+ */
+
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    uint64_t used;              /** Clock of the last hand-out. */
+    int ready;                  /** Contents complete (else being read). */
+} zeus_shared_slot_t;
+
+/**
+ * Region layout: the header, the slot table, then for every slot one
+ * reference count per owner (each written by that owner only, and
+ * cleared by the master when the owner dies), then the data.
+ */
+
+typedef struct {
+    pthread_mutex_t lock;
+    uint64_t clock;
+} zeus_shared_head_t;
+
+static zeus_shared_head_t *shared_head;
+static zeus_shared_slot_t *shared_slots;
+static uint32_t *shared_refs;
+static char *shared_data;
+static size_t shared_num;
+static size_t shared_size_max;
+static int shared_owners;
+static int shared_self = -1;
+
+int zeus_file_shared_init(size_t num_slots, size_t size_max, int num_owners) {
+    pthread_mutexattr_t attr;
+
+    if (num_slots == 0 || size_max == 0 || num_owners <= 0) {
+        return 0;
+    }
+
+    size_max = (size_max + 63) & ~(size_t)63;
+
+    size_t meta = sizeof(zeus_shared_head_t) + sizeof(zeus_shared_slot_t) * num_slots +
+                  sizeof(uint32_t) * num_slots * (size_t)num_owners;
+    meta = (meta + 63) & ~(size_t)63;
+
+    void *region = mmap(NULL, meta + size_max * num_slots, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (region == MAP_FAILED) {
+        ZLOG_PERROR("File cache: cannot map the shared snapshot region");
+        return -1;
+    }
+
+    /**
+     * Robust: a worker killed while holding the lock does not wedge the
+     * others. The references it held are dropped by the master.
+     */
+
+    shared_head = region;
+    if (pthread_mutexattr_init(&attr) != 0 ||
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED) != 0 ||
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST) != 0 ||
+        pthread_mutex_init(&shared_head->lock, &attr) != 0) {
+        ZLOG_ERROR("File cache: cannot set up the shared snapshot lock.");
+        munmap(region, meta + size_max * num_slots);
+        shared_head = NULL;
+        return -1;
+    }
+    pthread_mutexattr_destroy(&attr);
+
+    shared_slots = (zeus_shared_slot_t *)(shared_head + 1);
+    shared_refs = (uint32_t *)(shared_slots + num_slots);
+    shared_data = (char *)region + meta;
+    shared_num = num_slots;
+    shared_size_max = size_max;
+    shared_owners = num_owners;
+    return 0;
+}
+
+void zeus_file_shared_attach(int owner) {
+    shared_self = shared_head && owner >= 0 && owner < shared_owners ? owner : -1;
+}
+
+static void zeus_shared_lock(void) {
+    if (pthread_mutex_lock(&shared_head->lock) == EOWNERDEAD) {
+        pthread_mutex_consistent(&shared_head->lock);
+    }
+}
+
+static void zeus_shared_unlock(void) {
+    pthread_mutex_unlock(&shared_head->lock);
+}
+
+static int zeus_shared_in_use(size_t i) {
+    const uint32_t *refs = &shared_refs[i * (size_t)shared_owners];
+
+    for (int owner = 0; owner < shared_owners; owner++) {
+        if (refs[owner]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int zeus_shared_matches(const zeus_shared_slot_t *s, const struct stat *st) {
+    return s->size == st->st_size && s->ino == st->st_ino && s->dev == st->st_dev &&
+           s->mtime.tv_sec == st->st_mtim.tv_sec && s->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+static void zeus_shared_take(size_t i) {
+    shared_refs[i * (size_t)shared_owners + (size_t)shared_self]++;
+    shared_slots[i].used = ++shared_head->clock;
+}
+
+/**
+ * Reads the file into slot i, which the caller holds and nobody else
+ * matches yet. Fails when it cannot be read whole or changed meanwhile.
+ */
+
+static int zeus_shared_fill(size_t i, int fd, const struct stat *st) {
+    char *data = shared_data + i * shared_size_max;
+    size_t size = (size_t)st->st_size;
+    size_t off = 0;
+    struct stat after;
+
+    while (off < size) {
+        ssize_t n = pread(fd, data + off, size - off, (off_t)off);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        off += (size_t)n;
+    }
+
+    if (fstat(fd, &after) < 0 || after.st_size != st->st_size ||
+        after.st_mtim.tv_sec != st->st_mtim.tv_sec || after.st_mtim.tv_nsec != st->st_mtim.tv_nsec) {
+        return -1;
+    }
+    return 0;
+}
+
+const char *zeus_file_shared_get(int fd, const struct stat *st, int *slot) {
+    size_t found = shared_num;
+    size_t victim = shared_num;
+
+    if (shared_self < 0 || st->st_size <= 0 || (size_t)st->st_size > shared_size_max) {
+        return NULL;
+    }
+
+    zeus_shared_lock();
+    for (size_t i = 0; i < shared_num; i++) {
+        zeus_shared_slot_t *s = &shared_slots[i];
+        int in_use = zeus_shared_in_use(i);
+
+        /**
+         * A slot still being read by another worker matches too, so the
+         * file is not read twice; this open then does without.
+         */
+
+        if (zeus_shared_matches(s, st) && (s->ready || in_use)) {
+            found = i;
+            break;
+        }
+        if (!in_use && (victim == shared_num || s->used < shared_slots[victim].used)) {
+            victim = i;
+        }
+    }
+
+    if (found < shared_num) {
+        if (!shared_slots[found].ready) {
+            zeus_shared_unlock();
+            return NULL;
+        }
+        zeus_shared_take(found);
+        zeus_shared_unlock();
+        *slot = (int)found;
+        return shared_data + found * shared_size_max;
+    }
+
+    if (victim == shared_num) {
+        zeus_shared_unlock();
+        return NULL;
+    }
+
+    zeus_shared_slot_t *s = &shared_slots[victim];
+    s->dev = st->st_dev;
+    s->ino = st->st_ino;
+    s->size = st->st_size;
+    s->mtime = st->st_mtim;
+    s->ready = 0;
+    zeus_shared_take(victim);
+    zeus_shared_unlock();
+
+    int rc = zeus_shared_fill(victim, fd, st);
+
+    zeus_shared_lock();
+    if (rc == 0) {
+        s->ready = 1;
+    } else {
+        s->size = 0;
+        shared_refs[victim * (size_t)shared_owners + (size_t)shared_self]--;
+    }
+    zeus_shared_unlock();
+
+    if (rc < 0) {
+        return NULL;
+    }
+    *slot = (int)victim;
+    return shared_data + victim * shared_size_max;
+}
+
+void zeus_file_shared_put(int slot) {
+    if (shared_self < 0 || slot < 0 || (size_t)slot >= shared_num) {
+        return;
+    }
+
+    zeus_shared_lock();
+    shared_refs[(size_t)slot * (size_t)shared_owners + (size_t)shared_self]--;
+    zeus_shared_unlock();
+}
+
+void zeus_file_shared_release(int owner) {
+    if (!shared_head || owner < 0 || owner >= shared_owners) {
+        return;
+    }
+
+    zeus_shared_lock();
+    for (size_t i = 0; i < shared_num; i++) {
+        shared_refs[i * (size_t)shared_owners + (size_t)owner] = 0;
+    }
+    zeus_shared_unlock();
+}
@@ -1,3 +1,5 @@
+#define _GNU_SOURCE
+
 #include "../../include/zeushttp.h"
 #include "../../include/core/conn.h"
 #include "../../include/core/log.h"
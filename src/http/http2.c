@@ -1,7 +1,10 @@
 #include "../../include/http/http2.h"
 #include "../../include/http/avl.h"
+#include "../../include/http/router.h"
 #include "../../include/core/conn.h"
 #include "../../include/core/log.h"
+#include "../../include/core/access_log.h"
+#include "../../include/core/metrics.h"
 
 #include <string.h>
 #include <arpa/inet.h>
@@ -39,7 +42,9 @@ static void zeus_h2_parse_settings(zeus_conn_t *conn, const uint8_t *payload, ui
 }
 
 /**
- * Outgoing frames
+ * Outgoing frames. Frames are only queued; the event loop flushes the
+ * connection once per batch of input, so the frames answering one read
+ * leave together (one TLS record when they fit).
  */
 
 void zeus_h2_send_initial_settings(zeus_conn_t *conn) {
@@ -58,59 +63,73 @@ void zeus_h2_send_initial_settings(zeus_conn_t *conn) {
         0x00, 0x04, 0x00, 0x00, 0xff, 0xff
     };
 
-    zeus_conn_send(conn, frame, sizeof(frame));
-    ZLOG_INFO("H2: Sent initial SETTINGS (MAX_STREAMS=100, WINDOW=65535)");
+    zeus_conn_queue(conn, frame, sizeof(frame));
+    ZLOG_DEBUG("H2: Sent initial SETTINGS (MAX_STREAMS=100, WINDOW=65535)");
 }
 
-void zeus_h2_send_response_simple(zeus_conn_t *conn, uint32_t sid) {
-    /**
-     * Header frames.
-     */
-    uint8_t headers_frame[] = {
-        0, 0, 1,      /** Payload length */
-        0x01,         /**  HEADERS */
-        0x04,         /** Flags: END_HEADERS */
-        0, 0, 0, 0,   /** SID */
-        0x88          /** HPACK: status 200  */
+/**
+ * Connection init
+ */
+
+/**
+ * Headers-only response with the given status, ending the stream.
+ * ":status" is sent as a literal with the static-table name (index 8).
+ */
+
+static void zeus_h2_send_status(zeus_conn_t *conn, uint32_t sid, uint16_t status) {
+    uint8_t frame[] = {
+        0, 0, 5,      /** Payload length */
+        0x01,         /** HEADERS */
+        0x05,         /** Flags: END_STREAM | END_HEADERS */
+        (sid >> 24) & 0x7F, (sid >> 16) & 0xFF, (sid >> 8) & 0xFF, sid & 0xFF,
+        0x08, 0x03,   /** Literal without indexing, name :status, 3 bytes */
+        '0' + status / 100, '0' + (status / 10) % 10, '0' + status % 10
     };
-    
-    /**
-     * Fill up the SID header.
-     */
 
-    headers_frame[5] = (sid >> 24) & 0xFF;
-    headers_frame[6] = (sid >> 16) & 0xFF;
-    headers_frame[7] = (sid >> 8) & 0xFF;
-    headers_frame[8] = sid & 0xFF;
+    zeus_conn_queue(conn, frame, sizeof(frame));
+}
 
-    zeus_conn_send(conn, headers_frame, sizeof(headers_frame));
+/**
+ * Routes a complete request through the same tree as HTTP/1.x. Handlers
+ * still write HTTP/1.x responses and cannot answer a stream, so a
+ * matched route gets 501 rather than a reply its handler never made.
+ * TLS does not offer h2 while this holds (tls.c).
+ */
+
+static void zeus_h2_dispatch(zeus_conn_t *conn, zeus_h2_stream_t *stream) {
+    uint16_t status;
+    uint32_t route;
+    size_t queued = conn->out.len;
+
+    ZEUS_METRIC_INC(requests_h2);
+    zeus_access_begin(conn, conn->h2_header_len);
 
     /**
-     * Data frame content.
+     * The stamp keeps route 0: no handler runs for the stream, so it
+     * stays out of the per-route latency histograms. Once handlers
+     * answer streams, set conn->access.route to route + 1 here and end
+     * the stamp when the stream's last frame is flushed, as
+     * router_dispatch and zeus_conn_finish_response do for HTTP/1.x.
      */
 
-    const char *msg = "Zeus Server: HTTP/2 Active\n";
-    uint32_t msg_len = strlen(msg);
-    
-    uint8_t data_header[9] = {
-        (msg_len >> 16) & 0xFF,
-        (msg_len >> 8) & 0xFF,
-        msg_len & 0xFF,
-        0x00,         
-        0x01,         
-        headers_frame[5], headers_frame[6], headers_frame[7], headers_frame[8]
-    };
+    if (router_match(stream->req.method, stream->req.path, &stream->req, &status, &route)) {
+        status = 501;
+    }
 
-    zeus_conn_send(conn, data_header, 9);
-    zeus_conn_send(conn, (uint8_t *)msg, msg_len);
-    
-    ZLOG_INFO("H2: Response sent to stream %u", sid);
-}
+    ZLOG_DEBUG("H2: %u for stream %u, path: %s", status, stream->id,
+        stream->req.path ? stream->req.path : "(none)");
+    zeus_h2_send_status(conn, stream->id, status);
 
+    /**
+     * Frames are only queued here; the record counts what was queued
+     * for this stream, and its latency ends at queueing.
+     */
 
-/**
- * Connection init
- */
+    conn->access.bytes_out = conn->out.len - queued;
+    zeus_access_end(conn);
+    zeus_metrics_request_done(conn, status);
+    zeus_access_record(conn, stream->req.method, stream->req.path, status, stream->id);
+}
 
 void zeus_conn_init_h2(zeus_conn_t *conn) {
     conn->h2_streams = NULL;
@@ -151,7 +170,7 @@ void zeus_h2_send_window_update(zeus_conn_t *conn, uint32_t sid, uint32_t increm
     frame[11] = (increment >> 8)  & 0xFF;
     frame[12] = increment & 0xFF;
 
-    zeus_conn_send(conn, frame, sizeof(frame));
+    zeus_conn_queue(conn, frame, sizeof(frame));
 }
 
 /**
@@ -181,7 +200,7 @@ int zeus_h2_handler(zeus_conn_t *conn)
         zeus_h2_send_initial_settings(conn);
         zeus_h2_send_window_update(conn, 0, 65535);
 
-        ZLOG_INFO("H2: Preface OK (FD %d)", conn->event.fd);
+        ZLOG_DEBUG("H2: Preface OK (FD %d)", conn->event.fd);
     }
 
     while (*len >= 9) {
@@ -206,11 +225,11 @@ int zeus_h2_handler(zeus_conn_t *conn)
 
         case 0x04:
             if (flags & 0x01) {
-                ZLOG_INFO("H2: SETTINGS ACK (FD %d)", conn->event.fd);
+                ZLOG_DEBUG("H2: SETTINGS ACK (FD %d)", conn->event.fd);
             } else {
 
                 uint8_t ack[9] = {0,0,0, 0x04, 0x01, 0,0,0,0};
-                zeus_conn_send(conn, ack, 9);
+                zeus_conn_queue(conn, ack, 9);
             }
             break;
 
@@ -266,7 +285,7 @@ decode_headers:
                                   &stream->req);
 
                 if (flags & 0x01) { /** END_STREAM */
-                    zeus_h2_send_response_simple(conn, sid);
+                    zeus_h2_dispatch(conn, stream);
                 }
             }
             break;
@@ -283,7 +302,7 @@ decode_headers:
                 uint8_t pong[17];
                 memcpy(pong, buf, 17);
                 pong[4] = 0x01;
-                zeus_conn_send(conn, pong, 17);
+                zeus_conn_queue(conn, pong, 17);
             }
             break;
 
@@ -1,84 +1,577 @@
 #include "../../include/zeushttp.h"
 #include "../../include/http/http.h"
+#include "../../include/http/http_scan.h"
 #include "../../include/core/conn.h"
+#include "../../include/core/server.h"
 #include "../../include/core/log.h"
+#include "../../include/core/access_log.h"
+#include "../../include/core/metrics.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <strings.h> 
+#include <strings.h>
+
+/**
+ * Finds the next complete line starting at parse_cursor and consumes it.
+ * The vector scanner stops at the first control character, so the line
+ * end is found and illegal bytes are rejected in a single pass;
+ * scan_cursor remembers how far it got, so the bytes of a partial line
+ * are never scanned twice. The line ends at line_end (CRLF excluded).
+ * Returns 1 with a line, 0 when more data is needed and -1 on error.
+ */
+
+static int next_line(zeus_conn_t *conn, char **line, char **line_end) {
+    char *end = conn->read_buffer + conn->buffer_used;
+    char *from = conn->scan_cursor > conn->parse_cursor ? conn->scan_cursor : conn->parse_cursor;
+    char *ctl = from + zeus_http_scan_field(from, (size_t)(end - from));
+
+    conn->scan_cursor = ctl;
+    if (ctl == end) {
+        return 0;
+    }
+
+    char *lf = ctl;
+    if (*ctl == '\r') {
+        if (ctl + 1 == end) {
+            return 0;       /** CR seen, LF not received yet. */
+        }
+        lf = ctl + 1;
+    }
+
+    if (*lf != '\n') {
+        return -1;          /** Bare CR or control character. */
+    }
+
+    *line = conn->parse_cursor;
+    *line_end = ctl;
+    conn->parse_cursor = lf + 1;
+    conn->scan_cursor = conn->parse_cursor;
+    return 1;
+}
 
 /**
  * Attempts to parse the start line (method, path, version).
+ * Returns 1 when parsed, 0 when more data is needed and -1 on error.
  */
 
 static int parse_start_line(zeus_conn_t *conn) {
-    char *buffer = conn->read_buffer;
-    char *end_of_line = strstr(buffer, "\r\n");
-    char *start = buffer;
+    char *start, *end_of_line;
     char *space_one, *space_two;
 
-    if (!end_of_line) {
-        return -1;      /** Need more data or malformed. */
+    int result = next_line(conn, &start, &end_of_line);
+    if (result <= 0) {
+        return result;      /** Need more data or malformed. */
     }
 
     /**
-     * Find the first space (end of METHOD)
+     * The METHOD is a token ended by the first space.
      */
 
-    space_one = strchr(start, ' ');
-    if (!space_one) {
+    space_one = start + zeus_http_scan_token(start, (size_t)(end_of_line - start));
+    if (space_one == start || space_one == end_of_line || *space_one != ' ') {
         return -1;
     }
-    *space_one = '\0';  // end of METHOD.
 
     /**
      * Find the second space (end of PATH).
      */
 
-     space_two = strchr(space_one + 1, ' ');
+     space_two = memchr(space_one + 1, ' ', (size_t)(end_of_line - space_one - 1));
      if (!space_two) {
         return -1;
      }
+
+     *space_one = '\0';     /** end of METHOD */
      *space_two = '\0';     /** end of PATH */
+     *end_of_line = '\0';   /** end of VERSION */
 
      /**
-      * Verify and assign the METHOD.
+      * Verify and assign the METHOD. Any token is accepted; the router
+      * answers 405 for methods a route does not handle.
       */
 
-     if (strncasecmp(start, "GET", 3) != 0 && strncasecmp(start, "POST", 4) != 0) {
+     size_t method_len = (size_t)(space_one - start);
+     if (method_len == 0 || zeus_http_scan_token(start, method_len) != method_len) {
         return -1;
      }
      conn->req.method = start;
+     conn->head_request = method_len == 4 && memcmp(start, "HEAD", 4) == 0;
 
      /**
       * Verify and assign PATH.
       */
 
      conn->req.path = space_one + 1;
-     if (strstr(conn->req.path, "../")) {
+     if (conn->req.path[0] == '\0' || strstr(conn->req.path, "../")) {
         return -1;
      }
 
      /**
-      * Verify the version
+      * Verify the version (HTTP/1.0 or HTTP/1.1).
       */
 
      char *version = space_two + 1;
-     if (strncasecmp(version, "HTTP/1.", 7) != 0) {
+     if (end_of_line - version != 8 || strncasecmp(version, "HTTP/1.", 7) != 0 ||
+         (version[7] != '0' && version[7] != '1')) {
         return -1;
      }
+     conn->req.version = version;
+     conn->http_minor = version[7] - '0';
 
-     conn->parse_cursor = end_of_line + 2;
      return 1;
 }
 
 /**
- * The core HTTP State Machine entry point.
+ * Parses the header lines available in the buffer into req.headers.
+ * Returns 1 at the end of the header section, 0 when more data is
+ * needed and -1 on error.
  */
 
-void http_parser_run(zeus_conn_t *conn) {
-    if (conn->parser_state == PS_ERROR) {
+static int parse_headers(zeus_conn_t *conn) {
+    zeus_request_t *req = &conn->req;
+    char *line, *end_of_line;
+    int result;
+
+    while ((result = next_line(conn, &line, &end_of_line)) == 1) {
+        if (line == end_of_line) {
+            return 1;       /** Empty line: end of headers. */
+        }
+
+        /**
+         * The field name is a token ended by ':'. This also rejects
+         * obsolete line folding and whitespace before the colon.
+         */
+
+        char *colon = line + zeus_http_scan_token(line, (size_t)(end_of_line - line));
+        if (colon == line || colon == end_of_line || *colon != ':') {
+            return -1;
+        }
+
+        if (req->num_headers >= MAX_HEADERS) {
+            ZLOG_WARN("Security: too many headers on FD %d", conn->event.fd);
+            return -1;
+        }
+
+        char *value = colon + 1;
+        char *value_end = end_of_line;
+
+        while (value < value_end && (*value == ' ' || *value == '\t')) {
+            value++;
+        }
+        while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t')) {
+            value_end--;
+        }
+
+        http_header_t *h = &req->headers[req->num_headers++];
+        h->name = line;
+        h->name_len = (size_t)(colon - line);
+        h->value = value;
+        h->value_len = (size_t)(value_end - value);
+
+        /**
+         * Views are NUL-terminated as well, for handlers using C strings.
+         */
+
+        *colon = '\0';
+        *value_end = '\0';
+    }
+
+    if (result < 0) {
+        return -1;
+    }
+
+    if ((size_t)(conn->scan_cursor - conn->read_buffer) > MAX_HEADERS_LEN) {
+        ZLOG_INFO("Security Limit: Headers too long. FD %d", conn->event.fd);
+        return -1;
+    }
+
+    return 0;
+}
+
+const char *zeus_request_header(const zeus_request_t *req, const char *name, size_t *len) {
+    size_t name_len = strlen(name);
+
+    for (size_t i = 0; i < req->num_headers; i++) {
+        const http_header_t *h = &req->headers[i];
+
+        if (h->name_len == name_len && strncasecmp(h->name, name, name_len) == 0) {
+            if (len) {
+                *len = h->value_len;
+            }
+            return h->value;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Returns 1 when the header value contains the given token
+ * (comma separated, case-insensitive).
+ */
+
+static int header_has_token(const char *value, size_t len, const char *token) {
+    const char *end = value + len;
+    size_t token_len = strlen(token);
+
+    while (value < end) {
+        while (value < end && (*value == ' ' || *value == '\t' || *value == ',')) {
+            value++;
+        }
+
+        const char *item = value;
+        while (value < end && *value != ',') {
+            value++;
+        }
+
+        const char *item_end = value;
+        while (item_end > item && (item_end[-1] == ' ' || item_end[-1] == '\t')) {
+            item_end--;
+        }
+
+        if ((size_t)(item_end - item) == token_len && strncasecmp(item, token, token_len) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Decides whether the connection survives the current request:
+ * HTTP/1.1 is persistent unless "Connection: close" is sent, HTTP/1.0
+ * only with "Connection: keep-alive".
+ */
+
+static int http_request_keep_alive(zeus_conn_t *conn) {
+    zeus_request_t *req = &conn->req;
+    int keep_alive = conn->http_minor >= 1;
+    int max_requests = conn->server->config.max_keepalive_requests;
+
+    for (size_t i = 0; i < req->num_headers; i++) {
+        const http_header_t *h = &req->headers[i];
+
+        if (h->name_len == 10 && strncasecmp(h->name, "Connection", 10) == 0) {
+            if (header_has_token(h->value, h->value_len, "close")) {
+                keep_alive = 0;
+            } else if (header_has_token(h->value, h->value_len, "keep-alive")) {
+                keep_alive = 1;
+            }
+        }
+    }
+
+    if (max_requests > 0 && conn->requests_served + 1 >= (unsigned)max_requests) {
+        return 0;
+    }
+
+    return keep_alive;
+}
+
+/**
+ * Works out the body framing from Content-Length / Transfer-Encoding.
+ * Ambiguous framing (both headers, conflicting lengths, codings other
+ * than chunked) is rejected, as it is the usual request smuggling vector.
+ */
+
+static int http_request_body_init(zeus_conn_t *conn) {
+    zeus_request_t *req = &conn->req;
+    int has_length = 0;
+    uint64_t length = 0;
+
+    req->content_length = -1;
+    req->chunked = 0;
+
+    for (size_t i = 0; i < req->num_headers; i++) {
+        const http_header_t *h = &req->headers[i];
+
+        if (h->name_len == 17 && strncasecmp(h->name, "Transfer-Encoding", 17) == 0) {
+            if (req->chunked || conn->http_minor == 0 ||
+                h->value_len != 7 || strncasecmp(h->value, "chunked", 7) != 0) {
+                return -1;
+            }
+            req->chunked = 1;
+        } else if (h->name_len == 14 && strncasecmp(h->name, "Content-Length", 14) == 0) {
+            uint64_t value = 0;
+
+            if (h->value_len == 0 || h->value_len > 18) {
+                return -1;
+            }
+            for (size_t j = 0; j < h->value_len; j++) {
+                if (h->value[j] < '0' || h->value[j] > '9') {
+                    return -1;
+                }
+                value = value * 10 + (uint64_t)(h->value[j] - '0');
+            }
+
+            if (has_length && value != length) {
+                return -1;
+            }
+            has_length = 1;
+            length = value;
+        }
+    }
+
+    if (req->chunked && has_length) {
+        return -1;
+    }
+
+    if (has_length) {
+        req->content_length = (int64_t)length;
+    }
+
+    conn->body_start = conn->parse_cursor;
+    conn->body_remaining = length;
+    conn->chunk_state = CHUNK_SIZE;
+    conn->body_mode = BODY_DISCARD;
+    return 0;
+}
+
+void http_request_reset_body(zeus_conn_t *conn) {
+    free(conn->req.body);
+    conn->req.body = NULL;
+    conn->req.body_len = 0;
+
+    conn->body_start = NULL;
+    conn->body_remaining = 0;
+    conn->chunk_state = CHUNK_SIZE;
+    conn->body_mode = BODY_DISCARD;
+    conn->body_cb = NULL;
+    conn->body_done_cb = NULL;
+    conn->body_max = 0;
+}
+
+static int http_body_pending(zeus_conn_t *conn) {
+    return conn->parser_state == PS_BODY_IDENTITY || conn->parser_state == PS_BODY_CHUNKED;
+}
+
+/**
+ * Answers with an error while the body is still arriving; the rest of
+ * the body is discarded until the connection closes.
+ */
+
+static void http_body_reject(zeus_conn_t *conn, uint16_t status, const char *msg) {
+    free(conn->req.body);
+    conn->req.body = NULL;
+    conn->req.body_len = 0;
+    conn->body_mode = BODY_DISCARD;
+
+    conn->res.status_code = status;
+    zeus_response_send_data(&conn->res, msg, strlen(msg));
+}
+
+int zeus_request_on_body(zeus_conn_t *conn, zeus_body_cb cb) {
+    if (!conn || !cb || !http_body_pending(conn)) {
+        return -1;
+    }
+
+    conn->body_mode = BODY_STREAM;
+    conn->body_cb = cb;
+    return 0;
+}
+
+int zeus_request_buffer_body(zeus_conn_t *conn, size_t max_len, zeus_handler_cb done) {
+    if (!conn || !done) {
+        return -1;
+    }
+
+    /**
+     * No body at all: the request is already complete.
+     */
+
+    if (!http_body_pending(conn)) {
+        if (conn->parser_state != PS_COMPLETED) {
+            return -1;
+        }
+        done(conn, &conn->req);
+        return 0;
+    }
+
+    if (conn->req.content_length >= 0 && (uint64_t)conn->req.content_length > max_len) {
+        http_body_reject(conn, 413, "Payload Too Large\n");
+        return -1;
+    }
+
+    conn->body_mode = BODY_BUFFER;
+    conn->body_done_cb = done;
+    conn->body_max = max_len;
+    return 0;
+}
+
+/**
+ * Hands decoded body bytes to the consumer chosen by the handler.
+ */
+
+static void http_body_deliver(zeus_conn_t *conn, const char *data, size_t len) {
+    zeus_request_t *req = &conn->req;
+
+    if (conn->body_mode == BODY_STREAM) {
+        conn->body_cb(conn, req, data, len);
+        return;
+    }
+
+    if (conn->body_mode != BODY_BUFFER) {
         return;
     }
+
+    if (req->body_len + len > conn->body_max) {
+        http_body_reject(conn, 413, "Payload Too Large\n");
+        return;
+    }
+
+    char *body = realloc(req->body, req->body_len + len + 1);
+    if (!body) {
+        http_body_reject(conn, 500, "Internal Server Error\n");
+        return;
+    }
+
+    memcpy(body + req->body_len, data, len);
+    req->body = body;
+    req->body_len += len;
+    req->body[req->body_len] = '\0';
+}
+
+/**
+ * Called once the last body byte has been decoded.
+ */
+
+static void http_body_complete(zeus_conn_t *conn) {
+    conn->parser_state = PS_COMPLETED;
+
+    if (conn->body_mode == BODY_STREAM) {
+        conn->body_cb(conn, &conn->req, NULL, 0);
+    } else if (conn->body_mode == BODY_BUFFER) {
+        if (!conn->req.body) {
+            conn->req.body = calloc(1, 1);
+        }
+        conn->body_done_cb(conn, &conn->req);
+    }
+}
+
+/**
+ * Parses a chunk-size line (hex size, optional extensions).
+ */
+
+static int parse_chunk_size(const char *line, const char *end, uint64_t *size) {
+    uint64_t value = 0;
+    const char *p = line;
+
+    for (; p < end; p++) {
+        int digit;
+
+        if (*p >= '0' && *p <= '9') digit = *p - '0';
+        else if (*p >= 'a' && *p <= 'f') digit = *p - 'a' + 10;
+        else if (*p >= 'A' && *p <= 'F') digit = *p - 'A' + 10;
+        else break;
+
+        if (p - line >= 15) {
+            return -1;      /** Larger than any sane upload. */
+        }
+        value = (value << 4) | (uint64_t)digit;
+    }
+
+    if (p == line || (p < end && *p != ';' && *p != ' ' && *p != '\t')) {
+        return -1;
+    }
+
+    *size = value;
+    return 0;
+}
+
+/**
+ * Decodes the body bytes available in the buffer. Returns 1 when the
+ * body is complete, 0 when more data is needed and -1 on error.
+ */
+
+static int parse_body(zeus_conn_t *conn) {
+    char *end = conn->read_buffer + conn->buffer_used;
+    char *line, *end_of_line;
+    int result;
+
+    while (!conn->closing) {
+        if (conn->parser_state == PS_BODY_IDENTITY || conn->chunk_state == CHUNK_DATA) {
+            size_t avail = (size_t)(end - conn->parse_cursor);
+            if (avail > conn->body_remaining) {
+                avail = (size_t)conn->body_remaining;
+            }
+
+            if (avail > 0) {
+                char *data = conn->parse_cursor;
+
+                conn->parse_cursor += avail;
+                conn->scan_cursor = conn->parse_cursor;
+                conn->body_remaining -= avail;
+                conn->access.bytes_in += avail;
+                http_body_deliver(conn, data, avail);
+            }
+
+            if (conn->body_remaining > 0) {
+                return 0;
+            }
+            if (conn->parser_state == PS_BODY_IDENTITY) {
+                return 1;
+            }
+
+            conn->chunk_state = CHUNK_DATA_END;
+            continue;
+        }
+
+        result = next_line(conn, &line, &end_of_line);
+        if (result <= 0) {
+            return result;
+        }
+
+        if (conn->chunk_state == CHUNK_SIZE) {
+            if (parse_chunk_size(line, end_of_line, &conn->body_remaining) < 0) {
+                return -1;
+            }
+            conn->chunk_state = conn->body_remaining > 0 ? CHUNK_DATA : CHUNK_TRAILER;
+        } else if (conn->chunk_state == CHUNK_DATA_END) {
+            if (line != end_of_line) {
+                return -1;
+            }
+            conn->chunk_state = CHUNK_SIZE;
+        } else if (line == end_of_line) {
+            return 1;       /** End of trailer section. */
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Drops the body bytes already decoded so the buffer can take the next
+ * ones. Everything before body_start (start line and header views) is
+ * kept, so memory per connection stays at read_buffer whatever the
+ * upload size.
+ */
+
+static void http_body_compact(zeus_conn_t *conn) {
+    size_t consumed = (size_t)(conn->parse_cursor - conn->body_start);
+    if (consumed == 0) {
+        return;
+    }
+
+    size_t leftover = (size_t)(conn->read_buffer + conn->buffer_used - conn->parse_cursor);
+    memmove(conn->body_start, conn->parse_cursor, leftover);
+
+    conn->buffer_used -= consumed;
+    conn->read_buffer[conn->buffer_used] = '\0';
+    conn->scan_cursor -= consumed;
+    conn->parse_cursor = conn->body_start;
+}
+
+/**
+ * The core HTTP State Machine entry point. Resumes from parse_cursor,
+ * so each call only looks at the bytes received since the last one.
+ */
+
+void http_parser_run(zeus_conn_t *conn) {
+    if (conn->parser_state == PS_ERROR || conn->parser_state == PS_COMPLETED) {
+        return;     /** Current request is still being answered. */
+    }
+
+    if (!conn->parse_cursor) {
+        conn->parse_cursor = conn->read_buffer;
+    }
+
     if (conn->parser_state == PS_START_LINE) {
 
         int result = parse_start_line(conn);
@@ -93,66 +586,66 @@ void http_parser_run(zeus_conn_t *conn) {
         }
     }
 
-    /** 
-     * PS_HEADERS 
+    /**
+     * PS_HEADERS
      */
 
     if (conn->parser_state == PS_HEADERS) {
-        char *end_of_headers = strstr(conn->parse_cursor, "\r\n\r\n");
-        if (!end_of_headers) {
+        int result = parse_headers(conn);
+
+        if (result == -1) {
+            conn->parser_state = PS_ERROR;
+            return;
+        }
+        if (result == 0) {
             return;
         }
+
+        if (http_request_body_init(conn) < 0) {
+            ZLOG_WARN("HTTP Parse: invalid body framing on FD %d", conn->event.fd);
+            conn->parser_state = PS_ERROR;
+            return;
+        }
+
+        conn->keep_alive = http_request_keep_alive(conn);
         conn->parser_state = PS_HEADERS_FINISHED;
-        conn->parse_cursor = end_of_headers + 4;
     }
-    /** 
-     * PS_HEADERS_FINISHED 
+
+    /**
+     * PS_HEADERS_FINISHED (Dispatch Handler). The handler runs as soon as
+     * the headers are in, so it can ask for the body as it streams in.
      */
 
     if (conn->parser_state == PS_HEADERS_FINISHED) {
-        conn->parser_state = PS_COMPLETED;
-    }
+        if (conn->req.chunked) {
+            conn->parser_state = PS_BODY_CHUNKED;
+        } else if (conn->req.content_length > 0) {
+            conn->parser_state = PS_BODY_IDENTITY;
+        } else {
+            conn->parser_state = PS_COMPLETED;
+        }
 
-    /**
-     * PS_COMPLETE (Dispatch Handler)
-     */
-    if (conn->parser_state == PS_COMPLETED) {
-        printf("Parser: Dispatching. Method: %s, Path: %s\n",
+        ZLOG_DEBUG("Parser: Dispatching. Method: %s, Path: %s",
             conn->req.method, conn->req.path);
-        
+
+        ZEUS_METRIC_INC(requests_h1);
+        zeus_access_begin(conn, (uint64_t)(conn->parse_cursor - conn->read_buffer));
         router_dispatch(conn);
     }
-}
 
-/** 
- * Implements the HTTP parser extracting the start line and headers.
- */
-
-int parse_http_request(zeus_conn_t *conn, zeus_request_t *req) {
-    if (!conn || !req || conn->buffer_used == 0) {
-        return -1;
-    }
+    /**
+     * PS_BODY_IDENTITY / PS_BODY_CHUNKED
+     */
 
-    char *buf = conn->read_buffer;
-    size_t len = conn->buffer_used;
+    if (!conn->closing && http_body_pending(conn)) {
+        int result = parse_body(conn);
 
-    char *eol = memmem(buf, len, "\r\n", 2);
-    if (!eol) {
-        return -1;
+        if (result == -1) {
+            conn->parser_state = PS_ERROR;
+        } else if (result == 1) {
+            http_body_complete(conn);
+        } else if (!conn->closing) {
+            http_body_compact(conn);
+        }
     }
-
-    char *sp1 = memchr(buf, ' ', eol - buf);
-    if (!sp1) return -1;
-
-    char *sp2 = memchr(sp1 + 1, ' ', eol - (sp1 + 1));
-    if (!sp2) return -1;
-
-    *sp1 = *sp2 = *eol = '\0';
-
-    req->method  = buf;
-    req->path    = sp1 + 1;
-    req->version = sp2 + 1;
-
-    return 0;
 }
-
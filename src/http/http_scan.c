@@ -0,0 +1,221 @@
+/**
+ * http_scan.c
+ * Vectorized HTTP/1.x tokenizer primitives (AVX2 / SSE4.2) with a
+ * portable scalar fallback, selected at runtime.
+ */
+
+#include "../../include/http/http_scan.h"
+#include "../../include/core/log.h"
+
+#include <stdint.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ZEUS_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+typedef size_t (*zeus_scan_fn)(const char *p, size_t len);
+
+/**
+ * tchar = "!" / "#" / "$" / "%" / "&" / "'" / "*" / "+" / "-" / "." /
+ *         "^" / "_" / "`" / "|" / "~" / DIGIT / ALPHA
+ */
+
+static int is_tchar(unsigned char c) {
+    if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+        return 1;
+    }
+
+    switch (c) {
+        case '!': case '#': case '$': case '%': case '&': case '\'':
+        case '*': case '+': case '-': case '.': case '^': case '_':
+        case '`': case '|': case '~':
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static uint8_t token_table[256];
+
+/**
+ * Nibble lookup tables for the vector token check: byte c is a tchar
+ * when token_lo[c & 15] & token_hi[c >> 4] is non-zero. Every tchar is
+ * ASCII, so one bit per high nibble (0..7) is enough.
+ */
+
+static uint8_t token_lo[16];
+static uint8_t token_hi[16];
+
+static size_t scan_token_scalar(const char *p, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (!token_table[(unsigned char)p[i]]) {
+            return i;
+        }
+    }
+    return len;
+}
+
+static size_t scan_field_scalar(const char *p, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)p[i];
+        if ((c < 0x20 && c != '\t') || c == 0x7f) {
+            return i;
+        }
+    }
+    return len;
+}
+
+#ifdef ZEUS_SCAN_X86
+
+__attribute__((target("sse4.2")))
+static size_t scan_token_sse42(const char *p, size_t len) {
+    const __m128i lo_tbl = _mm_loadu_si128((const __m128i *)token_lo);
+    const __m128i hi_tbl = _mm_loadu_si128((const __m128i *)token_hi);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i b = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i lo = _mm_shuffle_epi8(lo_tbl, _mm_and_si128(b, nibble));
+        __m128i hi = _mm_shuffle_epi8(hi_tbl, _mm_and_si128(_mm_srli_epi16(b, 4), nibble));
+        int bad = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), zero));
+
+        if (bad) {
+            return i + (size_t)__builtin_ctz((unsigned)bad);
+        }
+    }
+
+    return i + scan_token_scalar(p + i, len - i);
+}
+
+/**
+ * PCMPESTRI in range mode: 0x00-0x08, 0x0a-0x1f and 0x7f.
+ */
+
+__attribute__((target("sse4.2")))
+static size_t scan_field_sse42(const char *p, size_t len) {
+    static const char ranges[16] = "\x00\x08" "\x0a\x1f" "\x7f\x7f";
+    const __m128i r = _mm_loadu_si128((const __m128i *)ranges);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i b = _mm_loadu_si128((const __m128i *)(p + i));
+        int idx = _mm_cmpestri(r, 6, b, 16,
+            _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+
+        if (idx != 16) {
+            return i + (size_t)idx;
+        }
+    }
+
+    return i + scan_field_scalar(p + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_token_avx2(const char *p, size_t len) {
+    const __m256i lo_tbl = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)token_lo));
+    const __m256i hi_tbl = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)token_hi));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i b = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i lo = _mm256_shuffle_epi8(lo_tbl, _mm256_and_si256(b, nibble));
+        __m256i hi = _mm256_shuffle_epi8(hi_tbl, _mm256_and_si256(_mm256_srli_epi16(b, 4), nibble));
+        unsigned bad = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), zero));
+
+        if (bad) {
+            return i + (size_t)__builtin_ctz(bad);
+        }
+    }
+
+    return i + scan_token_scalar(p + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_field_avx2(const char *p, size_t len) {
+    const __m256i ctl_max = _mm256_set1_epi8(0x1f);
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i del = _mm256_set1_epi8(0x7f);
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i b = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(b, ctl_max), b);   /** b <= 0x1f */
+        ctl = _mm256_andnot_si256(_mm256_cmpeq_epi8(b, tab), ctl);
+        ctl = _mm256_or_si256(ctl, _mm256_cmpeq_epi8(b, del));
+
+        unsigned bad = (unsigned)_mm256_movemask_epi8(ctl);
+        if (bad) {
+            return i + (size_t)__builtin_ctz(bad);
+        }
+    }
+
+    return i + scan_field_scalar(p + i, len - i);
+}
+
+#endif // ZEUS_SCAN_X86
+
+static size_t scan_token_resolve(const char *p, size_t len);
+static size_t scan_field_resolve(const char *p, size_t len);
+
+static zeus_scan_fn scan_token_impl = scan_token_resolve;
+static zeus_scan_fn scan_field_impl = scan_field_resolve;
+static const char *scan_impl_name = "scalar";
+
+void zeus_http_scan_init(void) {
+    for (int c = 0; c < 256; c++) {
+        token_table[c] = (uint8_t)is_tchar((unsigned char)c);
+        if (token_table[c]) {
+            token_lo[c & 0x0f] |= (uint8_t)(1u << (c >> 4));
+        }
+    }
+    for (int h = 0; h < 8; h++) {
+        token_hi[h] = (uint8_t)(1u << h);
+    }
+
+    scan_token_impl = scan_token_scalar;
+    scan_field_impl = scan_field_scalar;
+    scan_impl_name = "scalar";
+
+#ifdef ZEUS_SCAN_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2")) {
+        scan_token_impl = scan_token_avx2;
+        scan_field_impl = scan_field_avx2;
+        scan_impl_name = "avx2";
+    } else if (__builtin_cpu_supports("sse4.2")) {
+        scan_token_impl = scan_token_sse42;
+        scan_field_impl = scan_field_sse42;
+        scan_impl_name = "sse4.2";
+    }
+#endif
+
+    ZLOG_INFO("HTTP scanner: using %s implementation.", scan_impl_name);
+}
+
+static size_t scan_token_resolve(const char *p, size_t len) {
+    zeus_http_scan_init();
+    return scan_token_impl(p, len);
+}
+
+static size_t scan_field_resolve(const char *p, size_t len) {
+    zeus_http_scan_init();
+    return scan_field_impl(p, len);
+}
+
+const char *zeus_http_scan_impl(void) {
+    return scan_impl_name;
+}
+
+size_t zeus_http_scan_token(const char *p, size_t len) {
+    return scan_token_impl(p, len);
+}
+
+size_t zeus_http_scan_field(const char *p, size_t len) {
+    return scan_field_impl(p, len);
+}
@@ -0,0 +1,305 @@
+/**
+ * mime.c
+ * Extension to Content-Type table, built as a minimal perfect hash
+ * (hash and displace): keys are spread over buckets by a first hash,
+ * and each bucket gets the seed that sends all of its keys to free
+ * slots. Lookups hash the bucket, then hash again with its seed.
+ */
+
+#include "../../include/http/mime.h"
+#include "../../include/core/log.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define ZEUS_MIME_MAX_SEED (1u << 20)
+
+typedef struct zeus_mime_entry {
+    char ext[ZEUS_MIME_EXT_MAX];
+    char type[ZEUS_MIME_TYPE_MAX];
+} zeus_mime_entry_t;
+
+static const char *const zeus_mime_builtin[][2] = {
+    { "html",        "text/html" },
+    { "htm",         "text/html" },
+    { "css",         "text/css" },
+    { "js",          "text/javascript" },
+    { "mjs",         "text/javascript" },
+    { "json",        "application/json" },
+    { "map",         "application/json" },
+    { "jsonld",      "application/ld+json" },
+    { "webmanifest", "application/manifest+json" },
+    { "xml",         "application/xml" },
+    { "xhtml",       "application/xhtml+xml" },
+    { "rss",         "application/rss+xml" },
+    { "atom",        "application/atom+xml" },
+    { "txt",         "text/plain" },
+    { "md",          "text/markdown" },
+    { "csv",         "text/csv" },
+    { "ics",         "text/calendar" },
+    { "vtt",         "text/vtt" },
+    { "yaml",        "application/yaml" },
+    { "yml",         "application/yaml" },
+    { "svg",         "image/svg+xml" },
+    { "png",         "image/png" },
+    { "jpg",         "image/jpeg" },
+    { "jpeg",        "image/jpeg" },
+    { "gif",         "image/gif" },
+    { "webp",        "image/webp" },
+    { "avif",        "image/avif" },
+    { "ico",         "image/x-icon" },
+    { "bmp",         "image/bmp" },
+    { "tif",         "image/tiff" },
+    { "tiff",        "image/tiff" },
+    { "woff",        "font/woff" },
+    { "woff2",       "font/woff2" },
+    { "ttf",         "font/ttf" },
+    { "otf",         "font/otf" },
+    { "eot",         "application/vnd.ms-fontobject" },
+    { "wasm",        "application/wasm" },
+    { "pdf",         "application/pdf" },
+    { "rtf",         "application/rtf" },
+    { "epub",        "application/epub+zip" },
+    { "zip",         "application/zip" },
+    { "gz",          "application/gzip" },
+    { "tar",         "application/x-tar" },
+    { "bz2",         "application/x-bzip2" },
+    { "xz",          "application/x-xz" },
+    { "zst",         "application/zstd" },
+    { "7z",          "application/x-7z-compressed" },
+    { "rar",         "application/vnd.rar" },
+    { "jar",         "application/java-archive" },
+    { "doc",         "application/msword" },
+    { "docx",        "application/vnd.openxmlformats-officedocument.wordprocessingml.document" },
+    { "xls",         "application/vnd.ms-excel" },
+    { "xlsx",        "application/vnd.openxmlformats-officedocument.spreadsheetml.sheet" },
+    { "ppt",         "application/vnd.ms-powerpoint" },
+    { "pptx",        "application/vnd.openxmlformats-officedocument.presentationml.presentation" },
+    { "mp3",         "audio/mpeg" },
+    { "ogg",         "audio/ogg" },
+    { "oga",         "audio/ogg" },
+    { "opus",        "audio/ogg" },
+    { "wav",         "audio/wav" },
+    { "flac",        "audio/flac" },
+    { "aac",         "audio/aac" },
+    { "m4a",         "audio/mp4" },
+    { "mp4",         "video/mp4" },
+    { "m4v",         "video/mp4" },
+    { "webm",        "video/webm" },
+    { "ogv",         "video/ogg" },
+    { "mov",         "video/quicktime" },
+    { "avi",         "video/x-msvideo" },
+    { "mkv",         "video/x-matroska" },
+    { "m3u8",        "application/vnd.apple.mpegurl" },
+    { "ts",          "video/mp2t" },
+    { "bin",         "application/octet-stream" },
+    { "iso",         "application/octet-stream" },
+};
+
+#define ZEUS_MIME_BUILTIN (sizeof(zeus_mime_builtin) / sizeof(zeus_mime_builtin[0]))
+
+static zeus_mime_entry_t *mime_slots;
+static uint32_t *mime_seeds;
+static uint32_t mime_count;
+static uint32_t mime_buckets;
+
+/**
+ * FNV-1a with a seed, then a final mix so that nearby seeds give
+ * unrelated slots.
+ */
+
+static uint32_t zeus_mime_hash(const char *ext, uint32_t seed) {
+    uint32_t h = 2166136261u ^ (seed * 0x9e3779b9u);
+    for (const unsigned char *p = (const unsigned char *)ext; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 12;
+    return h;
+}
+
+/**
+ * Lower-cases the extension of path into ext. Returns 0 when there is
+ * none or it does not fit.
+ */
+
+static int zeus_mime_ext(const char *path, char ext[ZEUS_MIME_EXT_MAX]) {
+    const char *base = strrchr(path, '/');
+    const char *dot = strrchr(base ? base + 1 : path, '.');
+
+    if (!dot || dot[1] == '\0') {
+        return 0;
+    }
+
+    size_t i = 0;
+    for (const char *p = dot + 1; *p; p++) {
+        if (i == ZEUS_MIME_EXT_MAX - 1) {
+            return 0;
+        }
+        ext[i++] = (char)tolower((unsigned char)*p);
+    }
+    ext[i] = '\0';
+    return 1;
+}
+
+static void zeus_mime_set(zeus_mime_entry_t *entries, uint32_t *count, const char *ext, const char *type) {
+    uint32_t i = 0;
+    while (i < *count && strcmp(entries[i].ext, ext) != 0) {
+        i++;
+    }
+    if (i == *count) {
+        (*count)++;
+    }
+
+    snprintf(entries[i].ext, sizeof(entries[i].ext), "%s", ext);
+    snprintf(entries[i].type, sizeof(entries[i].type), "%s", type);
+}
+
+/**
+ * Places every key: buckets are handled largest first, each one trying
+ * seeds until all of its keys land on distinct free slots.
+ */
+
+static int zeus_mime_place(const zeus_mime_entry_t *entries, uint32_t n, uint32_t r,
+                           zeus_mime_entry_t *slots, uint32_t *seeds) {
+    uint32_t *bucket_of = malloc(sizeof(uint32_t) * n);
+    uint32_t *size = calloc(r, sizeof(uint32_t));
+    uint8_t *taken = calloc(n, 1);
+    uint32_t *trial = malloc(sizeof(uint32_t) * n);
+    int rc = -1;
+
+    if (!bucket_of || !size || !taken || !trial) {
+        goto out;
+    }
+
+    uint32_t largest = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        bucket_of[i] = zeus_mime_hash(entries[i].ext, 0) % r;
+        if (++size[bucket_of[i]] > largest) {
+            largest = size[bucket_of[i]];
+        }
+    }
+
+    for (uint32_t want = largest; want > 0; want--) {
+        for (uint32_t b = 0; b < r; b++) {
+            if (size[b] != want) {
+                continue;
+            }
+
+            uint32_t seed;
+            for (seed = 1; seed < ZEUS_MIME_MAX_SEED; seed++) {
+                uint32_t k = 0;
+                uint32_t i;
+
+                for (i = 0; i < n; i++) {
+                    if (bucket_of[i] != b) {
+                        continue;
+                    }
+
+                    uint32_t slot = zeus_mime_hash(entries[i].ext, seed) % n;
+                    uint32_t j = 0;
+                    while (j < k && trial[j] != slot) {
+                        j++;
+                    }
+                    if (taken[slot] || j < k) {
+                        break;
+                    }
+                    trial[k++] = slot;
+                }
+
+                if (i == n) {
+                    break;
+                }
+            }
+
+            if (seed == ZEUS_MIME_MAX_SEED) {
+                goto out;
+            }
+
+            seeds[b] = seed;
+            for (uint32_t i = 0; i < n; i++) {
+                if (bucket_of[i] == b) {
+                    uint32_t slot = zeus_mime_hash(entries[i].ext, seed) % n;
+                    slots[slot] = entries[i];
+                    taken[slot] = 1;
+                }
+            }
+        }
+    }
+    rc = 0;
+
+out:
+    free(bucket_of);
+    free(size);
+    free(taken);
+    free(trial);
+    return rc;
+}
+
+int zeus_mime_init(const zeus_config_t *config) {
+    uint32_t capacity = (uint32_t)(ZEUS_MIME_BUILTIN + config->num_mime_types);
+    zeus_mime_entry_t *entries = calloc(capacity, sizeof(*entries));
+    uint32_t n = 0;
+
+    if (!entries) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < ZEUS_MIME_BUILTIN; i++) {
+        zeus_mime_set(entries, &n, zeus_mime_builtin[i][0], zeus_mime_builtin[i][1]);
+    }
+    for (int i = 0; i < config->num_mime_types; i++) {
+        zeus_mime_set(entries, &n, config->mime_types[i].ext, config->mime_types[i].type);
+    }
+
+    /**
+     * About two keys per bucket. The slot array has exactly one slot per
+     * key, so the hash is minimal.
+     */
+
+    uint32_t r = n / 2 + 1;
+
+    zeus_mime_destroy();
+    mime_slots = calloc(n, sizeof(*mime_slots));
+    mime_seeds = calloc(r, sizeof(*mime_seeds));
+
+    if (!mime_slots || !mime_seeds || zeus_mime_place(entries, n, r, mime_slots, mime_seeds) < 0) {
+        free(entries);
+        zeus_mime_destroy();
+        return -1;
+    }
+
+    mime_count = n;
+    mime_buckets = r;
+    free(entries);
+
+    ZLOG_INFO("MIME: %u types (%d from the configuration).", n, config->num_mime_types);
+    return 0;
+}
+
+void zeus_mime_destroy(void) {
+    free(mime_slots);
+    free(mime_seeds);
+    mime_slots = NULL;
+    mime_seeds = NULL;
+    mime_count = 0;
+    mime_buckets = 0;
+}
+
+const char *zeus_mime_type(const char *path) {
+    char ext[ZEUS_MIME_EXT_MAX];
+
+    if (mime_count == 0 || !zeus_mime_ext(path, ext)) {
+        return ZEUS_MIME_DEFAULT;
+    }
+
+    uint32_t seed = mime_seeds[zeus_mime_hash(ext, 0) % mime_buckets];
+    const zeus_mime_entry_t *entry = &mime_slots[zeus_mime_hash(ext, seed) % mime_count];
+
+    return strcmp(entry->ext, ext) == 0 ? entry->type : ZEUS_MIME_DEFAULT;
+}
@@ -6,11 +6,17 @@
 #include "../../include/zeushttp.h"
 #include "../../include/core/log.h"
 #include "../../include/core/conn.h"
+#include "../../include/core/server.h"
+#include "../../include/http/compress.h"
+#include "../../include/core/metrics.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
+#include <errno.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <stddef.h> /* For offsetof */
 
 #include <sys/types.h>
@@ -18,9 +24,38 @@
 #include <fcntl.h>
 
 #include <sys/epoll.h>
+#include <sys/sendfile.h>
 
 extern void close_connection(zeus_conn_t *conn);
 extern void start_graceful_close(zeus_conn_t *conn);
+extern void zeus_conn_finish_response(zeus_conn_t *conn);
+extern int zeus_event_ctl(zeus_server_t *server, zeus_io_event_t *ev, int op, uint32_t events);
+
+/**
+ * Segments gathered by one writev in plaintext mode.
+ */
+
+#define ZEUS_MAX_IOV 64
+
+/**
+ * Staging area where small segments are coalesced into one full TLS
+ * record. Workers are single-threaded, so one per process is enough.
+ */
+
+static char tls_record[ZEUS_BUF_SIZE];
+
+/**
+ * Logs a failed socket write. A client that went away (EPIPE,
+ * ECONNRESET) is routine and only shows at debug level.
+ */
+
+static void zeus_conn_write_error(zeus_conn_t *conn, const char *op) {
+    if (errno == EPIPE || errno == ECONNRESET) {
+        ZLOG_DEBUG("%s on FD %d: %s", op, conn->event.fd, strerror(errno));
+    } else {
+        ZLOG_PERROR("%s failed on FD %d", op, conn->event.fd);
+    }
+}
 
 /**
  * Sends bytes to a connection, using SSL_write when TLS is active.
@@ -53,48 +88,255 @@ ssize_t zeus_conn_send(zeus_conn_t *conn, const void *buf, size_t len) {
         if (errno == EAGAIN || errno == EWOULDBLOCK) {
             return 0;
         }
-        
-        perror("write");
+
+        zeus_conn_write_error(conn, "write");
         return -1;
     }
 }
 
+/**
+ * Sends a file range with kTLS: the kernel reads the page cache and
+ * encrypts, nothing is copied through userspace.
+ */
+
+static ssize_t zeus_conn_sendfile_ktls(zeus_conn_t *conn, zeus_seg_t *seg) {
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+    ossl_ssize_t r = SSL_sendfile(conn->ssl_conn, seg->fd, seg->offset, seg->len, 0);
+    if (r > 0) {
+        return (ssize_t)r;
+    }
+
+    int err = SSL_get_error(conn->ssl_conn, (int)r);
+    if (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ) {
+        return 0;
+    }
+    ERR_print_errors_fp(stderr);
+#else
+    (void)conn;
+    (void)seg;
+#endif
+    return -1;
+}
+
+/**
+ * One TLS write from the front of the chain. A segment holding at least
+ * a full record is written in place; anything smaller is coalesced with
+ * the segments behind it into one record, so a response made of
+ * headers, frame headers and a short body costs one record and one
+ * syscall. On a retry the record is rebuilt from the same bytes,
+ * possibly longer, which SSL_write accepts.
+ *
+ * File ranges are pulled into records with pread, unless the kernel
+ * does the encryption (kTLS): then they go out with SSL_sendfile and the
+ * memory segments in front of them are flushed on their own.
+ */
+
+static ssize_t zeus_conn_send_tls(zeus_conn_t *conn) {
+    zeus_seg_t *head = conn->out.head;
+
+    if (head->type == ZEUS_SEG_FILE && conn->ktls_send) {
+        return zeus_conn_sendfile_ktls(conn, head);
+    }
+
+    if (head->type != ZEUS_SEG_FILE && zeus_seg_len(head) >= ZEUS_BUF_SIZE) {
+        const char *p = head->type == ZEUS_SEG_BUF ? head->buf->data + head->buf->start : head->ref;
+        return zeus_conn_send(conn, p, ZEUS_BUF_SIZE);
+    }
+
+    ssize_t n = zeus_chain_copy_out(&conn->out, tls_record, sizeof(tls_record), !conn->ktls_send);
+    if (n <= 0) {
+        ZLOG_ERROR("Failed to read queued file data for FD %d", conn->event.fd);
+        return -1;
+    }
+    return zeus_conn_send(conn, tls_record, (size_t)n);
+}
+
+/**
+ * One plaintext write: writev over the memory segments at the front, or
+ * sendfile when the chain starts with a file range.
+ */
+
+static ssize_t zeus_conn_send_plain(zeus_conn_t *conn) {
+    zeus_seg_t *head = conn->out.head;
+    ssize_t sent;
+
+    if (head->type == ZEUS_SEG_FILE) {
+        off_t offset = head->offset;
+        sent = sendfile(conn->event.fd, head->fd, &offset, head->len);
+        if (sent == 0) {
+            return -1;  /** File shrank under us. */
+        }
+    } else {
+        struct iovec iov[ZEUS_MAX_IOV];
+        int count = zeus_chain_iov(&conn->out, iov, ZEUS_MAX_IOV);
+        sent = writev(conn->event.fd, iov, count);
+    }
+
+    if (sent >= 0) {
+        return sent;
+    }
+
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return 0;
+    }
+
+    zeus_conn_write_error(conn, head->type == ZEUS_SEG_FILE ? "sendfile" : "writev");
+    return -1;
+}
+
+/**
+ * Writes as much of the output chain as the socket accepts. Sent
+ * segments go back to the pool. Returns 1 once the chain is empty, 0
+ * when the socket would block and -1 on error.
+ */
+
+static int zeus_conn_flush_chain(zeus_conn_t *conn) {
+    zeus_buf_pool_t *pool = conn->server->bufs;
+
+    while (!zeus_chain_empty(&conn->out)) {
+        ssize_t sent = conn->is_ssl ? zeus_conn_send_tls(conn) : zeus_conn_send_plain(conn);
+
+        if (sent < 0) {
+            return -1;
+        }
+        if (sent == 0) {
+            return 0;
+        }
+
+        zeus_chain_consume(pool, &conn->out, (size_t)sent);
+        if (conn->access.first_ns == 0 && conn->access.start_ns) {
+            conn->access.first_ns = zeus_access_now();
+        }
+        conn->access.bytes_out += (uint64_t)sent;
+        ZEUS_METRIC_ADD(bytes_out, sent);
+    }
+
+    return 1;
+}
+
 static void handle_response_write_cb(zeus_io_event_t *ev) {
     zeus_conn_t *conn = (zeus_conn_t *)ev->data;
     if (!conn) return;
 
     conn_ref(conn);
-    
-    ZLOG_DEBUG("Write CB: Offset %zu / Total %zu", conn->write_offset, conn->response_len);
-
-    while (conn->write_offset < conn->response_len) {
-        ssize_t sent = zeus_conn_send(
-            conn,
-            conn->response_buffer + conn->write_offset,
-            conn->response_len - conn->write_offset
-        );
-
-        if (sent > 0) {
-            conn->write_offset += (size_t)sent;
-            continue;
-        }
+    size_t pending = conn->out.len;
 
-        if (sent == 0) { 
-            conn_unref(conn);
-            return;
-        }
+    ZLOG_DEBUG("Write CB: %zu bytes pending", pending);
 
+    int r = zeus_conn_flush_chain(conn);
+
+    if (r < 0) {
+        ZEUS_METRIC_INC(errors_io);
         ZLOG_WARN("Write error on FD %d", conn->event.fd);
         start_graceful_close(conn);
         conn_unref(conn);
         return;
     }
 
-    ZLOG_INFO("Response sent fully. Initiating close.");
-    start_graceful_close(conn); 
+    if (r == 0) {
+        if (conn->out.len != pending) {
+            zeus_conn_set_timeout(conn, CONN_TIMEOUT_WRITE);     /** Progress: push the stall deadline. */
+        }
+        conn_unref(conn);
+        return;
+    }
+
+    if (conn->protocol == PROTO_HTTP2) {
+        conn->event.write_cb = NULL;
+        zeus_event_ctl(conn->server, &conn->event, EPOLL_CTL_MOD, EPOLLIN | EPOLLET);
+        zeus_conn_set_timeout(conn, CONN_TIMEOUT_KEEPALIVE);
+        conn_unref(conn);
+        return;
+    }
+
+    /**
+     * A streamed response caught up with its producer: stop polling until
+     * the next zeus_response_write. The request is still being answered,
+     * so reading stays off; the write deadline bounds an idle producer.
+     */
+
+    if (conn->res.streaming) {
+        conn->event.write_cb = NULL;
+        zeus_event_ctl(conn->server, &conn->event, EPOLL_CTL_MOD, EPOLLET);
+        conn_unref(conn);
+        return;
+    }
+
+    ZLOG_DEBUG("Response sent fully on FD %d.", conn->event.fd);
+    zeus_conn_finish_response(conn);
     conn_unref(conn);
 }
 
+/**
+ * Parks the rest of the output chain until the socket is writable.
+ * HTTP/1.x stops reading meanwhile; HTTP/2 keeps reading frames.
+ */
+
+static void zeus_conn_wait_writable(zeus_conn_t *conn) {
+    uint32_t events = EPOLLOUT | EPOLLET;
+
+    if (conn->protocol == PROTO_HTTP2) {
+        events |= EPOLLIN;
+    }
+
+    conn->event.write_cb = handle_response_write_cb;
+    zeus_event_ctl(conn->server, &conn->event, EPOLL_CTL_MOD, events);
+    zeus_conn_set_timeout(conn, CONN_TIMEOUT_WRITE);
+}
+
+int zeus_conn_queue(zeus_conn_t *conn, const void *data, size_t len) {
+    if (!conn || conn->closing) {
+        return -1;
+    }
+    return zeus_chain_append(conn->server->bufs, &conn->out, data, len);
+}
+
+int zeus_conn_queue_ref(zeus_conn_t *conn, const void *data, size_t len) {
+    if (!conn || conn->closing) {
+        return -1;
+    }
+    return zeus_chain_append_ref(conn->server->bufs, &conn->out, data, len, 0);
+}
+
+int zeus_conn_queue_file(zeus_conn_t *conn, int fd, off_t offset, size_t len) {
+    if (!conn || conn->closing) {
+        close(fd);
+        return -1;
+    }
+    return zeus_chain_append_file(conn->server->bufs, &conn->out, fd, offset, len);
+}
+
+int zeus_conn_flush(zeus_conn_t *conn) {
+    if (!conn || conn->closing) {
+        return -1;
+    }
+
+    /**
+     * A flush is already waiting for EPOLLOUT: keep the order.
+     */
+
+    if (conn->event.write_cb == handle_response_write_cb || zeus_chain_empty(&conn->out)) {
+        return 0;
+    }
+
+    int r = zeus_conn_flush_chain(conn);
+    if (r < 0) {
+        ZEUS_METRIC_INC(errors_io);
+        start_graceful_close(conn);
+        return -1;
+    }
+    if (r == 0) {
+        zeus_conn_wait_writable(conn);
+    }
+    return 0;
+}
+
+int zeus_conn_write(zeus_conn_t *conn, const void *data, size_t len) {
+    if (zeus_conn_queue(conn, data, len) < 0) {
+        return -1;
+    }
+    return zeus_conn_flush(conn);
+}
 
 /**
  * Finds the connection structure from the response pointer using
@@ -113,12 +355,26 @@ static const char* get_status_message(uint16_t code) {
     switch (code) {
         case 200:
             return "OK";
+        case 206:
+            return "Partial Content";
+        case 304:
+            return "Not Modified";
+        case 400:
+            return "Bad Request";
         case 404:
             return "Not Found";
+        case 405:
+            return "Method Not Allowed";
+        case 413:
+            return "Payload Too Large";
+        case 416:
+            return "Range Not Satisfiable";
         case 431:
             return "Request Header Fields Too Large";
         case 500:
             return "Internal Server Error";
+        case 503:
+            return "Service Unavailable";
         default:
             return "Unknown";
     }
@@ -139,121 +395,367 @@ void zeus_response_set_status(zeus_response_t *res, uint16_t status_code) {
 
 int zeus_response_add_header(zeus_response_t *res, const char *key, const char *value) {
     zeus_conn_t *conn = get_conn_from_res(res);
-    int remaining_space = MAX_RESPONSE_BUFFER - conn->response_len;
-    int written;
+    zeus_buf_pool_t *pool = conn->server->bufs;
+
+    /**
+     * Remembered for the gzip decision: what the body is, and whether
+     * the handler already encoded it.
+     */
 
-    written = snprintf(conn->response_buffer + conn->response_len, remaining_space,
-        "%s: %s\r\n", key, value);
+    if (strcasecmp(key, "Content-Type") == 0) {
+        res->compressible = (uint8_t)zeus_compress_type_allowed(value);
+    } else if (strcasecmp(key, "Content-Encoding") == 0) {
+        res->encoded = 1;
+    }
 
-    if (written < 0 || written >= remaining_space) {
-        fprintf(stderr, "Error: Response header buffer overflow.\n");
+    if (zeus_chain_append(pool, &conn->out, key, strlen(key)) < 0 ||
+        zeus_chain_append(pool, &conn->out, ": ", 2) < 0 ||
+        zeus_chain_append(pool, &conn->out, value, strlen(value)) < 0 ||
+        zeus_chain_append(pool, &conn->out, "\r\n", 2) < 0) {
+        ZLOG_ERROR("Out of response buffers on FD %d.", conn->event.fd);
         return -1;
     }
-    conn->response_len += written;
     return 0;
 }
 
 /**
- * Sends the response headers and data, then close the connection
- * (non-keep-alive).
+ * Queues the status line and the framing headers in front of the
+ * headers added by the handler, then the blank line. Also settles
+ * whether the connection survives this response. Callers queue the
+ * body behind it only when the request is not HEAD; the head still
+ * carries the body's length.
  */
 
-int zeus_response_send_data(zeus_response_t *res, const char *data, size_t len) {
-    zeus_conn_t *conn = get_conn_from_res(res);
-    if (!conn || !conn->response_buffer) return -1;
+int zeus_response_queue_head(zeus_conn_t *conn, uint64_t content_length) {
+    zeus_response_t *res = &conn->res;
+    zeus_buf_pool_t *pool = conn->server->bufs;
 
-    conn_ref(conn);
+    if (res->status_code == 0) {
+        res->status_code = 200;
+    }
 
-    conn->response_len = 0;
-    conn->write_offset = 0;
+    /**
+     * Answering before the request body was read: the rest of the body
+     * is never consumed, so the connection cannot be reused.
+     */
+
+    if (conn->parser_state == PS_BODY_IDENTITY || conn->parser_state == PS_BODY_CHUNKED) {
+        conn->keep_alive = 0;
+    }
+
+    /**
+     * Body framing. A streamed body is chunked on HTTP/1.1 and ends with
+     * the connection on HTTP/1.0. A 304 has no body; its Content-Length
+     * would describe the full representation, so it is left out.
+     */
+
+    char length_header[48] = "";
+    if (content_length == ZEUS_LENGTH_UNKNOWN) {
+        if (conn->http_minor >= 1) {
+            snprintf(length_header, sizeof(length_header), "Transfer-Encoding: chunked\r\n");
+            res->chunked = 1;
+        } else {
+            conn->keep_alive = 0;
+        }
+    } else if (res->status_code != 304) {
+        snprintf(length_header, sizeof(length_header), "Content-Length: %llu\r\n",
+            (unsigned long long)content_length);
+    }
+
+    /**
+     * HTTP/1.1 is persistent by default, HTTP/1.0 only when asked for.
+     */
+
+    const char *connection_header = "Connection: close\r\n";
+    if (conn->keep_alive) {
+        connection_header = conn->http_minor == 0 ? "Connection: keep-alive\r\n" : "";
+    }
 
     /** Status line */
+    char status_line[256];
     int n = snprintf(
-        conn->response_buffer,
-        MAX_RESPONSE_BUFFER,
+        status_line,
+        sizeof(status_line),
         "HTTP/1.1 %u %s\r\n"
-        "Content-Length: %zu\r\n"
-        "\r\n",
+        "%s"
+        "%s",
         res->status_code,
         get_status_message(res->status_code),
-        len
+        length_header,
+        connection_header
     );
 
-    if (n <= 0 || (size_t)n >= MAX_RESPONSE_BUFFER) {
-        conn_unref(conn);
+    if (n <= 0 || (size_t)n >= sizeof(status_line)) {
         return -1;
     }
 
-    conn->response_len = (size_t)n;
+    if (zeus_chain_prepend(pool, &conn->out, status_line, (size_t)n) < 0 ||
+        zeus_chain_append(pool, &conn->out, "\r\n", 2) < 0) {
+        return -1;
+    }
+    return 0;
+}
 
-    /** Append body */
-    if (len > 0) {
-        if (conn->response_len + len > MAX_RESPONSE_BUFFER) {
-            conn_unref(conn);
-            return -1;
-        }
+/**
+ * Writes the queued response. Done: the connection moves on to the next
+ * request (or closes). Otherwise the caller's buffers are copied and the
+ * rest goes out on EPOLLOUT, from wherever the socket stopped.
+ */
 
-        memcpy(conn->response_buffer + conn->response_len, data, len);
-        conn->response_len += len;
-    }
+int zeus_response_flush(zeus_conn_t *conn) {
+    conn_ref(conn);
 
-    /** Try send */
-    ssize_t sent = zeus_conn_send(conn, conn->response_buffer, conn->response_len);
-    if (sent < 0) {
+    int r = zeus_conn_flush_chain(conn);
+    if (r < 0) {
         start_graceful_close(conn);
         conn_unref(conn);
         return -1;
     }
 
-    conn->event.write_cb = handle_response_write_cb;
+    if (r == 1) {
+        zeus_conn_finish_response(conn);
+        conn_unref(conn);
+        return 0;
+    }
 
-    zeus_event_ctl(
-        conn->server,
-        &conn->event, 
-        EPOLL_CTL_MOD,
-        EPOLLOUT | EPOLLET
-    );
+    if (zeus_chain_pin(conn->server->bufs, &conn->out) < 0) {
+        start_graceful_close(conn);
+        conn_unref(conn);
+        return -1;
+    }
+
+    zeus_conn_wait_writable(conn);
 
     conn_unref(conn);
     return 0;
 }
 
 /**
+ * Whether a dynamic body is gzipped: gzip enabled, a compressible type
+ * the handler has not encoded itself, a status with a full body, at
+ * least gzip_min_length bytes (streams always qualify) and a client
+ * that accepts it. vary is set when the answer depends on the client's
+ * Accept-Encoding.
+ */
 
-int zeus_response_send_file(zeus_response_t *res, const char *filepath) {
-    zeus_conn_t *conn = get_conn_from_res(res);
-    if (!conn) {
+static int zeus_response_use_gzip(zeus_conn_t *conn, uint64_t len, int *vary) {
+    zeus_response_t *res = &conn->res;
+    const zeus_config_t *config = &conn->server->config;
+    uint64_t min_length = config->gzip_min_length > 0 ? (uint64_t)config->gzip_min_length : 0;
+
+    *vary = 0;
+
+    if (!config->gzip || !res->compressible || res->encoded || conn->protocol == PROTO_HTTP2 ||
+        res->status_code == 204 || res->status_code == 206 || res->status_code == 304) {
+        return 0;
+    }
+    if (len != ZEUS_LENGTH_UNKNOWN && len < min_length) {
+        return 0;
+    }
+    *vary = 1;
+
+    size_t accept_len;
+    const char *accept = zeus_request_header(&conn->req, "Accept-Encoding", &accept_len);
+    return accept && zeus_encoding_accepted(accept, accept_len, "gzip");
+}
+
+/**
+ * Compresses the whole body into pool chunks before the head is
+ * written, so Content-Length is exact. The caller's buffer is not
+ * needed once this returns.
+ */
+
+static int zeus_response_send_gzip(zeus_conn_t *conn, z_stream *zs, const char *data, size_t len) {
+    static const char headers[] = "Content-Encoding: gzip\r\nVary: Accept-Encoding\r\n";
+    zeus_buf_pool_t *pool = conn->server->bufs;
+    zeus_chain_t body = {0};
+
+    int rc = zeus_deflate_chain(zs, pool, &body, data, len, Z_FINISH);
+    zeus_deflate_put(conn->server->deflate, zs);
+
+    if (rc < 0 ||
+        zeus_chain_append(pool, &conn->out, headers, sizeof(headers) - 1) < 0 ||
+        zeus_response_queue_head(conn, body.len) < 0) {
+        zeus_chain_free(pool, &body);
+        zeus_chain_free(pool, &conn->out);
         return -1;
     }
 
-    int file_fd = open(filepath, O_RDONLY);
-    if (file_fd < 0) {
-        ZLOG_PERROR("Response: Failed to open file '%s'", filepath);
+    if (conn->head_request) {
+        zeus_chain_free(pool, &body);
+    } else {
+        zeus_chain_concat(&conn->out, &body);
+    }
+    return zeus_response_flush(conn);
+}
+
+/**
+ * Sends the response headers and data. Headers queued with
+ * zeus_response_add_header are kept; the connection is either
+ * recycled for the next request (keep-alive) or closed once the
+ * response is flushed. The body is sent from the caller's buffer and
+ * only copied if the socket does not take it right away, unless it is
+ * gzipped on the way.
+ */
+
+int zeus_response_send_data(zeus_response_t *res, const char *data, size_t len) {
+    zeus_conn_t *conn = get_conn_from_res(res);
+    if (!conn) return -1;
+
+    zeus_buf_pool_t *pool = conn->server->bufs;
+
+    int vary;
+    if (zeus_response_use_gzip(conn, len, &vary)) {
+        z_stream *zs = zeus_deflate_get(conn->server->deflate);
+        if (zs) {
+            return zeus_response_send_gzip(conn, zs, data, len);
+        }
+    }
+
+    if ((vary && zeus_chain_append(pool, &conn->out, "Vary: Accept-Encoding\r\n", 23) < 0) ||
+        zeus_response_queue_head(conn, len) < 0 ||
+        (!conn->head_request && zeus_chain_append_ref(pool, &conn->out, data, len, 1) < 0)) {
+        zeus_chain_free(pool, &conn->out);
         return -1;
     }
 
+    return zeus_response_flush(conn);
+}
+
+/**
+ * Queues one piece of a streamed body: compressed when the stream is
+ * gzipped (zlib may hold it back until it has a block), framed as a
+ * chunk on HTTP/1.1. last closes the gzip member and the chunked body.
+ */
+
+static int zeus_response_stream_out(zeus_conn_t *conn, const char *data, size_t len, int last) {
+    zeus_response_t *res = &conn->res;
+    zeus_buf_pool_t *pool = conn->server->bufs;
+    zeus_chain_t piece = {0};
+
+    if (conn->head_request) {
+        return 0;
+    }
 
-    struct stat st;
-    if (fstat(file_fd, &st) < 0) {
-        ZLOG_PERROR("Response: Failed to stat file '%s'", filepath);
-        close(file_fd);
+    if (res->deflate) {
+        if (zeus_deflate_chain(res->deflate, pool, &piece, data, len, last ? Z_FINISH : Z_NO_FLUSH) < 0) {
+            zeus_chain_free(pool, &piece);
+            return -1;
+        }
+    } else if (zeus_chain_append(pool, &piece, data, len) < 0) {
+        zeus_chain_free(pool, &piece);
         return -1;
     }
 
-    conn->sendfile_fd = file_fd;
-    conn->sendfile_size = st.st_size;
-    conn->sendfile_offset = 0;
-    conn->is_sending_file = 1;
+    if (!res->chunked) {
+        zeus_chain_concat(&conn->out, &piece);
+        return 0;
+    }
 
+    /**
+     * An empty chunk would end the body: pieces zlib kept to itself are
+     * skipped.
+     */
 
-    conn->event.write_cb = handle_response_write_cb;
-    if (zeus_event_ctl(conn->server, &conn->event, EPOLL_CTL_MOD, EPOLLOUT | EPOLLET) == -1) {
-        ZLOG_PERROR("epoll_ctl (sendfile start) failed.");
-        close(file_fd);
+    if (piece.len > 0) {
+        char size_line[24];
+        int n = snprintf(size_line, sizeof(size_line), "%zx\r\n", piece.len);
+
+        if (zeus_chain_append(pool, &conn->out, size_line, (size_t)n) < 0) {
+            zeus_chain_free(pool, &piece);
+            return -1;
+        }
+        zeus_chain_concat(&conn->out, &piece);
+
+        if (zeus_chain_append(pool, &conn->out, "\r\n", 2) < 0) {
+            return -1;
+        }
+    }
+
+    if (last && zeus_chain_append(pool, &conn->out, "0\r\n\r\n", 5) < 0) {
         return -1;
     }
     return 0;
 }
-*/
 
+int zeus_response_begin(zeus_response_t *res) {
+    zeus_conn_t *conn = get_conn_from_res(res);
+    zeus_buf_pool_t *pool = conn->server->bufs;
+
+    if (conn->closing || res->streaming || conn->protocol == PROTO_HTTP2) {
+        return -1;
+    }
+
+    if (res->status_code == 0) {
+        res->status_code = 200;
+    }
+
+    int vary;
+    if (zeus_response_use_gzip(conn, ZEUS_LENGTH_UNKNOWN, &vary)) {
+        res->deflate = zeus_deflate_get(conn->server->deflate);
+    }
+
+    const char *headers = "";
+    if (res->deflate) {
+        headers = "Content-Encoding: gzip\r\nVary: Accept-Encoding\r\n";
+    } else if (vary) {
+        headers = "Vary: Accept-Encoding\r\n";
+    }
+
+    if (zeus_chain_append(pool, &conn->out, headers, strlen(headers)) < 0 ||
+        zeus_response_queue_head(conn, ZEUS_LENGTH_UNKNOWN) < 0) {
+        zeus_deflate_put(conn->server->deflate, res->deflate);
+        res->deflate = NULL;
+        zeus_chain_free(pool, &conn->out);
+        return -1;
+    }
+
+    res->streaming = 1;
+    return zeus_conn_flush(conn);
+}
+
+int zeus_response_write(zeus_response_t *res, const char *data, size_t len) {
+    zeus_conn_t *conn = get_conn_from_res(res);
+
+    if (!res->streaming || conn->closing) {
+        return -1;
+    }
+    if (len == 0) {
+        return 0;
+    }
+
+    if (zeus_response_stream_out(conn, data, len, 0) < 0) {
+        start_graceful_close(conn);
+        return -1;
+    }
+    return zeus_conn_flush(conn);
+}
+
+int zeus_response_end(zeus_response_t *res) {
+    zeus_conn_t *conn = get_conn_from_res(res);
+
+    if (!res->streaming) {
+        return -1;
+    }
+
+    int rc = conn->closing ? -1 : zeus_response_stream_out(conn, NULL, 0, 1);
+
+    zeus_deflate_put(conn->server->deflate, res->deflate);
+    res->deflate = NULL;
+    res->streaming = 0;
 
+    if (rc < 0) {
+        start_graceful_close(conn);
+        return -1;
+    }
+
+    /**
+     * Still draining on EPOLLOUT: the write callback finishes the
+     * response once the last chunk is out.
+     */
+
+    if (conn->event.write_cb == handle_response_write_cb) {
+        return 0;
+    }
+    return zeus_response_flush(conn);
+}
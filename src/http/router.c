@@ -1,8 +1,16 @@
 /**
  * router.c
  * Implements the routing table and request dispatch logic.
+ *
+ * Routes live in one compressed radix tree shared by HTTP/1.x and
+ * HTTP/2. register_route collects them in a malloc'ed tree; before the
+ * workers fork, router_freeze flattens it into one read-only mapping
+ * that every worker shares. Matching walks the path once, backtracking
+ * only out of a :param or *wildcard branch that leads nowhere.
  */
 
+#define _GNU_SOURCE
+
 #include "../../include/zeushttp.h"
 #include "../../include/http/http.h"
 #include "../../include/http/router.h"
@@ -13,155 +21,735 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
 extern int zeus_response_send_data(zeus_response_t *res, const char *data, size_t len);
+extern int zeus_response_add_header(zeus_response_t *res, const char *name, const char *value);
+
+enum {
+    ROUTE_STATIC,
+    ROUTE_PARAM,
+    ROUTE_WILDCARD
+};
+
+static const char *const METHOD_NAMES[ZEUS_METHOD_COUNT] = {
+    "GET", "HEAD", "POST", "PUT", "DELETE", "PATCH", "OPTIONS", "CONNECT", "TRACE"
+};
+
+#define ALL_METHODS ((uint16_t)((1u << ZEUS_METHOD_COUNT) - 1))
+
+/**
+ * Node of the registration tree. Static children are found by their
+ * first byte in indices; a node has at most one :param and one
+ * *wildcard child, tried after the static ones.
+ */
+
+typedef struct zeus_route_node {
+    char *label;                /** Static prefix, or the parameter name. */
+    size_t label_len;
+    uint8_t kind;
+
+    uint16_t methods;           /** Bit per zeus_method_t with a handler here. */
+    zeus_handler_cb handlers[ZEUS_METHOD_COUNT];
+    char *pattern;              /** Route as registered, for logs. */
+
+    char *indices;              /** First byte of each static child. */
+    struct zeus_route_node **children;
+    size_t num_children;
+    struct zeus_route_node *param;
+    struct zeus_route_node *wildcard;
+} zeus_route_node_t;
+
+/**
+ * Node of the frozen table. Nodes refer to each other, to handlers and
+ * to strings by index; the static children of a node are contiguous
+ * (breadth-first layout), their first label bytes side by side in
+ * ROUTE_FIRST. Handlers are stored only for the methods a node has, in
+ * bit order.
+ */
+
+typedef struct {
+    uint32_t label;             /** Offset in ROUTE_STRINGS. */
+    uint32_t pattern;           /** Offset in ROUTE_STRINGS ("" for inner nodes). */
+    uint32_t children;          /** Index of the first static child. */
+    uint32_t param;             /** Node index, 0 when none: the root is nobody's child. */
+    uint32_t wildcard;
+    uint32_t handlers;          /** Index of the first handler. */
+    uint16_t label_len;
+    uint16_t num_children;
+    uint16_t methods;
+    uint8_t kind;
+} zeus_route_flat_t;
 
 /**
- * Global list of routes. 
+ * Root of the registration tree: a static node with an empty label.
+ * Emptied by router_freeze.
  */
 
+static zeus_route_node_t ROUTE_ROOT;
 static size_t ROUTE_COUNT = 0;
 
 /**
- * Defines a route (path + handler).
+ * The frozen table: one mapping, read-only once built. These pointers
+ * are set in the master and inherited by the workers.
  */
-#define MAX_ROUTES 64
-static zeus_route_t ROUTE_TABLE[MAX_ROUTES];
+
+static void *ROUTE_TABLE;
+static size_t ROUTE_TABLE_SIZE;
+static uint32_t ROUTE_NODES_COUNT;
+static const zeus_route_flat_t *ROUTE_NODES;
+static const zeus_handler_cb *ROUTE_HANDLERS;
+static uint32_t ROUTE_HANDLERS_COUNT;
+static const char *ROUTE_FIRST;
+static const char *ROUTE_STRINGS;
 
 static void not_found_handler(zeus_conn_t *conn, zeus_request_t *req) {
-    const char *response_404 = 
-        "HTTP/1.1 404 Not Found\r\n"
-        "Content-Length: 10\r\n"
-        "Connection: close\r\n"
-        "\r\n"
-        "Not Found\n";
+    const char *body = "Not Found\n";
 
-    zeus_response_send_data(&conn->res, response_404, strlen(response_404));
+    (void)req;
+    conn->res.status_code = 404;
+    zeus_response_send_data(&conn->res, body, strlen(body));
 }
 
 /**
- * Adds a user handler to the routing table.
+ * Answers a method the route has no handler for, listing the ones it
+ * has in Allow.
  */
 
-int router_add_handler(zeus_server_t *server, const char *path, zeus_handler_cb handler) {
-    if (ROUTE_COUNT >= MAX_ROUTES) {
-        fprintf(stderr, "Error: Max routes reached.\n");
+static void method_not_allowed_handler(zeus_conn_t *conn, uint16_t methods) {
+    const char *body = "Method Not Allowed\n";
+    char allow[64];
+    size_t n = 0;
+
+    allow[0] = '\0';
+    for (int i = 0; i < ZEUS_METHOD_COUNT; i++) {
+        if (methods & (1u << i)) {
+            n += (size_t)snprintf(allow + n, sizeof(allow) - n, "%s%s", n ? ", " : "", METHOD_NAMES[i]);
+        }
+    }
+
+    conn->res.status_code = 405;
+    zeus_response_add_header(&conn->res, "Allow", allow);
+    zeus_response_send_data(&conn->res, body, strlen(body));
+}
+
+/**
+ * Method bit for a request method, 0 for unknown ones.
+ */
+
+static uint16_t method_bit(const char *method) {
+    for (int i = 0; i < ZEUS_METHOD_COUNT; i++) {
+        if (strcmp(method, METHOD_NAMES[i]) == 0) {
+            return (uint16_t)(1u << i);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Methods a node answers: HEAD is served by the GET handler when the
+ * route has none of its own (the response then drops the body).
+ */
+
+static uint16_t node_methods(const zeus_route_flat_t *node) {
+    uint16_t methods = node->methods;
+
+    if (methods & (1u << ZEUS_METHOD_GET)) {
+        methods |= 1u << ZEUS_METHOD_HEAD;
+    }
+    return methods;
+}
+
+/**
+ * The bit of the handler method runs on the node, 0 when it has none.
+ */
+
+static uint16_t node_method_bit(const zeus_route_flat_t *node, const char *method) {
+    uint16_t bit = method_bit(method);
+
+    if (bit == (1u << ZEUS_METHOD_HEAD) && !(node->methods & bit)) {
+        bit = 1u << ZEUS_METHOD_GET;
+    }
+    return node->methods & bit;
+}
+
+static zeus_route_node_t *route_node_new(const char *label, size_t len, uint8_t kind) {
+    zeus_route_node_t *node = calloc(1, sizeof(*node));
+    if (!node) {
+        return NULL;
+    }
+
+    node->label = strndup(label, len);
+    if (!node->label) {
+        free(node);
+        return NULL;
+    }
+    node->label_len = len;
+    node->kind = kind;
+    return node;
+}
+
+static int route_add_child(zeus_route_node_t *parent, zeus_route_node_t *child) {
+    size_t n = parent->num_children;
+
+    char *indices = realloc(parent->indices, n + 2);
+    if (!indices) {
         return -1;
     }
+    parent->indices = indices;
 
-    /**
-     * Safe copy from path.
-     */
-    strncpy(ROUTE_TABLE[ROUTE_COUNT].path, path, sizeof(ROUTE_TABLE[ROUTE_COUNT].path) - 1);
-    ROUTE_TABLE[ROUTE_COUNT].path[sizeof(ROUTE_TABLE[ROUTE_COUNT].path) - 1] = '\0';
-    ROUTE_TABLE[ROUTE_COUNT].handler = handler;
-    ROUTE_COUNT++;
+    zeus_route_node_t **children = realloc(parent->children, sizeof(*children) * (n + 1));
+    if (!children) {
+        return -1;
+    }
+    parent->children = children;
 
+    indices[n] = child->label[0];
+    indices[n + 1] = '\0';
+    children[n] = child;
+    parent->num_children = n + 1;
     return 0;
 }
 
 /**
- * The main dispatcher: Finds the corresponding route and calls
- * its handler.
+ * Splits child after its first len bytes: the head keeps the prefix and
+ * takes the old node, with the rest of the label, as its only child.
  */
 
-void router_dispatch(zeus_conn_t *conn) {
-    if (!conn || !conn->req.method || !conn->req.path) {
-        not_found_handler(conn, NULL);
-        return;
+static zeus_route_node_t *route_split(zeus_route_node_t *parent, size_t i, size_t len) {
+    zeus_route_node_t *child = parent->children[i];
+    zeus_route_node_t *head = route_node_new(child->label, len, ROUTE_STATIC);
+    if (!head) {
+        return NULL;
     }
 
-    const char *req_method = conn->req.method;
-    const char *req_path = conn->req.path;
+    char *rest = strdup(child->label + len);
+    if (!rest || route_add_child(head, child) < 0) {
+        free(rest);
+        free(head->label);
+        free(head);
+        return NULL;
+    }
+
+    /**
+     * route_add_child indexed the child by its old first byte.
+     */
+
+    free(child->label);
+    child->label = rest;
+    child->label_len -= len;
+    head->indices[0] = rest[0];
+
+    parent->children[i] = head;
+    return head;
+}
 
-    for (size_t i = 0; i < ROUTE_COUNT; i++) {
-        zeus_route_t *route = &ROUTE_TABLE[i];
+/**
+ * Finds or creates the node for pattern below node. Errors are logged
+ * here, with the full route in route.
+ */
+
+static zeus_route_node_t *route_insert(zeus_route_node_t *node, const char *pattern, const char *route) {
+    while (*pattern) {
+        if (*pattern == ':' || *pattern == '*') {
+            uint8_t kind = *pattern == ':' ? ROUTE_PARAM : ROUTE_WILDCARD;
+            const char *name = pattern + 1;
+            size_t len = strcspn(name, "/");
+
+            if (pattern[-1] != '/' || len == 0 || memchr(name, ':', len) || memchr(name, '*', len)) {
+                ZLOG_ERROR("Router: Invalid parameter in route '%s'.", route);
+                return NULL;
+            }
+            if (kind == ROUTE_WILDCARD && name[len] != '\0') {
+                ZLOG_ERROR("Router: Wildcard must end route '%s'.", route);
+                return NULL;
+            }
+
+            zeus_route_node_t **slot = kind == ROUTE_PARAM ? &node->param : &node->wildcard;
+            if (*slot && ((*slot)->label_len != len || memcmp((*slot)->label, name, len) != 0)) {
+                ZLOG_ERROR("Router: Route '%s' renames parameter '%s' at the same position.",
+                    route, (*slot)->label);
+                return NULL;
+            }
+            if (!*slot && !(*slot = route_node_new(name, len, kind))) {
+                return NULL;
+            }
+
+            node = *slot;
+            pattern = name + len;
+            continue;
+        }
 
         /**
-         * Compare the method and path (exactly correspondence).
+         * Static run up to the next parameter: follow the child sharing
+         * its first byte, splitting it where they diverge.
          */
 
-        if (strcmp(req_method, route->method) ==  0 && 
-            strcmp(req_path, route->path) == 0) {
-            
-            ZLOG_INFO("Router: Matched route %s %s. Dispatching handler.",
-                route->method, route->path);
+        size_t len = strcspn(pattern, ":*");
+        const char *idx = node->indices ? strchr(node->indices, pattern[0]) : NULL;
+
+        if (!idx) {
+            zeus_route_node_t *child = route_node_new(pattern, len, ROUTE_STATIC);
+            if (!child || route_add_child(node, child) < 0) {
+                if (child) {
+                    free(child->label);
+                    free(child);
+                }
+                return NULL;
+            }
+            node = child;
+            pattern += len;
+            continue;
+        }
+
+        size_t i = (size_t)(idx - node->indices);
+        zeus_route_node_t *child = node->children[i];
+        size_t common = 0;
+        while (common < len && common < child->label_len && child->label[common] == pattern[common]) {
+            common++;
+        }
+
+        if (common < child->label_len && !(child = route_split(node, i, common))) {
+            return NULL;
+        }
+        node = child;
+        pattern += common;
+    }
+
+    return node;
+}
+
+/**
+ * Matches path[0..end) below node i, whose label is already consumed.
+ * Returns the node of the route (it has at least one method) or NULL.
+ */
+
+static const zeus_route_flat_t *route_lookup(uint32_t i, const char *path, const char *end,
+                                             zeus_request_t *req) {
+    const zeus_route_flat_t *node = &ROUTE_NODES[i];
+
+    if (path == end && node->methods) {
+        return node;
+    }
+
+    if (path < end && node->num_children) {
+        const char *idx = memchr(ROUTE_FIRST + node->children, *path, node->num_children);
+        if (idx) {
+            uint32_t c = (uint32_t)(idx - ROUTE_FIRST);
+            const zeus_route_flat_t *child = &ROUTE_NODES[c];
+
+            if ((size_t)(end - path) >= child->label_len &&
+                memcmp(path, ROUTE_STRINGS + child->label, child->label_len) == 0) {
+                const zeus_route_flat_t *found = route_lookup(c, path + child->label_len, end, req);
+                if (found) {
+                    return found;
+                }
+            }
+        }
+    }
+
+    if (node->param && path < end && *path != '/') {
+        const zeus_route_flat_t *param = &ROUTE_NODES[node->param];
+        const char *seg_end = memchr(path, '/', (size_t)(end - path));
+        if (!seg_end) {
+            seg_end = end;
+        }
+
+        size_t saved = req->num_params;
+        zeus_param_t *p = &req->params[req->num_params++];
+        p->name = ROUTE_STRINGS + param->label;
+        p->name_len = param->label_len;
+        p->value = path;
+        p->value_len = (size_t)(seg_end - path);
+
+        const zeus_route_flat_t *found = route_lookup(node->param, seg_end, end, req);
+        if (found) {
+            return found;
+        }
+        req->num_params = saved;
+    }
+
+    if (node->wildcard) {
+        const zeus_route_flat_t *wildcard = &ROUTE_NODES[node->wildcard];
+        zeus_param_t *p = &req->params[req->num_params++];
+        p->name = ROUTE_STRINGS + wildcard->label;
+        p->name_len = wildcard->label_len;
+        p->value = path;
+        p->value_len = (size_t)(end - path);
+        return wildcard;
+    }
+
+    return NULL;
+}
+
+/**
+ * Route node for path (query string excluded), with the parameters
+ * captured into req. Nothing matches before router_freeze.
+ */
+
+static const zeus_route_flat_t *route_find(const char *path, zeus_request_t *req) {
+    const char *end = path + strcspn(path, "?");
+
+    req->num_params = 0;
+    if (!ROUTE_NODES) {
+        return NULL;
+    }
+
+    const zeus_route_flat_t *node = route_lookup(0, path, end, req);
+    if (!node) {
+        req->num_params = 0;
+    }
+    return node;
+}
+
+/**
+ * Index of the handler for bit in ROUTE_HANDLERS, which is also the
+ * route id.
+ */
+
+static uint32_t route_index(const zeus_route_flat_t *node, uint16_t bit) {
+    return node->handlers + (uint32_t)__builtin_popcount(node->methods & (bit - 1u));
+}
+
+zeus_handler_cb router_match(const char *method, const char *path, zeus_request_t *req,
+                             uint16_t *status, uint32_t *route) {
+    const zeus_route_flat_t *node = method && path ? route_find(path, req) : NULL;
+
+    if (!node) {
+        *status = 404;
+        return NULL;
+    }
+
+    uint16_t bit = node_method_bit(node, method);
+    if (!bit) {
+        *status = 405;
+        return NULL;
+    }
+
+    *route = route_index(node, bit);
+    return ROUTE_HANDLERS[*route];
+}
+
+uint32_t router_route_count(void) {
+    return ROUTE_HANDLERS_COUNT;
+}
+
+int router_route_info(uint32_t route, const char **method, const char **pattern) {
+    for (uint32_t i = 0; i < ROUTE_NODES_COUNT; i++) {
+        const zeus_route_flat_t *node = &ROUTE_NODES[i];
+        uint32_t n = (uint32_t)__builtin_popcount(node->methods);
 
-            route->handler(conn, &conn->req);
-            return;
+        if (route < node->handlers || route >= node->handlers + n) {
+            continue;
         }
+
+        for (int m = 0, k = 0; m < ZEUS_METHOD_COUNT; m++) {
+            if ((node->methods & (1u << m)) && node->handlers + (uint32_t)k++ == route) {
+                *method = METHOD_NAMES[m];
+                *pattern = ROUTE_STRINGS + node->pattern;
+                return 0;
+            }
+        }
+    }
+    return -1;
+}
+
+/**
+ * Adds a user handler to the routing table, for every method.
+ */
+
+int router_add_handler(zeus_server_t *server, const char *path, zeus_handler_cb handler) {
+    (void)server;
+    return register_route("*", path, handler);
+}
+
+/**
+ * The main dispatcher: Finds the corresponding route and calls
+ * its handler.
+ */
+
+void router_dispatch(zeus_conn_t *conn) {
+    zeus_request_t *req = &conn->req;
+
+    if (!req->method || !req->path) {
+        not_found_handler(conn, req);
+        return;
+    }
+
+    const zeus_route_flat_t *node = route_find(req->path, req);
+    if (!node) {
+        ZLOG_DEBUG("Router: No handler found for %s %s.", req->method, req->path);
+        not_found_handler(conn, req);
+        return;
+    }
+
+    uint16_t bit = node_method_bit(node, req->method);
+    if (!bit) {
+        ZLOG_DEBUG("Router: Method %s not allowed for %s.", req->method, ROUTE_STRINGS + node->pattern);
+        method_not_allowed_handler(conn, node_methods(node));
+        return;
     }
 
-    ZLOG_INFO("Router: No handler found for %s %s.", req_method, req_path);
-    not_found_handler(conn, &conn->req);
+    ZLOG_DEBUG("Router: Matched route %s %s.", req->method, ROUTE_STRINGS + node->pattern);
+
+    uint32_t route = route_index(node, bit);
+    conn->access.route = route + 1;
+    ROUTE_HANDLERS[route](conn, req);
 }
 
 int register_route(const char *method, const char *path, zeus_handler_cb handler) {
-    if (!method || !path || !handler) {
-        ZLOG_FATAL("Router: Invalid route registration (method=%p, path=%p, handler=%p)", 
+    if (!method || !path || !handler || path[0] != '/') {
+        ZLOG_FATAL("Router: Invalid route registration (method=%p, path=%p, handler=%p)",
             method, path, handler);
 
         return -1;
     }
 
-    if (ROUTE_COUNT >= MAX_ROUTES) {
-        ZLOG_FATAL("Router: Cannot register route '%s %s'. Route limit (%d) reached.",
-            method, path, MAX_ROUTES);
-    
+    if (ROUTE_NODES) {
+        ZLOG_ERROR("Router: Routes are frozen, '%s %s' not registered.", method, path);
+        return -1;
+    }
+
+    if (strlen(path) > UINT16_MAX) {
+        ZLOG_ERROR("Router: Route '%.64s...' is too long.", path);
+        return -1;
+    }
+
+    uint16_t bits = strcmp(method, "*") == 0 ? ALL_METHODS : method_bit(method);
+    if (!bits) {
+        ZLOG_ERROR("Router: Unknown method '%s' for route '%s'.", method, path);
+        return -1;
+    }
+
+    size_t params = 0;
+    for (const char *p = path; *p; p++) {
+        if ((*p == ':' || *p == '*') && p[-1] == '/') {
+            params++;
+        }
+    }
+    if (params > MAX_PARAMS) {
+        ZLOG_ERROR("Router: Route '%s' has more than %d parameters.", path, MAX_PARAMS);
+        return -1;
+    }
+
+    zeus_route_node_t *node = route_insert(&ROUTE_ROOT, path, path);
+    if (!node) {
         return -1;
     }
 
-    zeus_route_t *new_route = &ROUTE_TABLE[ROUTE_COUNT];
-    memset(new_route, 0, sizeof(*new_route));
+    if (node->methods & bits) {
+        ZLOG_ERROR("Router: Route %s %s is already registered.", method, path);
+        return -1;
+    }
 
-    strncpy(new_route->method, method, sizeof(new_route->method) - 1);
-    strncpy(new_route->path, path, sizeof(new_route->path) - 1);
-    new_route->handler = handler;
+    if (!node->pattern && !(node->pattern = strdup(path))) {
+        return -1;
+    }
+
+    for (int i = 0; i < ZEUS_METHOD_COUNT; i++) {
+        if (bits & (1u << i)) {
+            node->handlers[i] = handler;
+        }
+    }
+    node->methods |= bits;
 
     ROUTE_COUNT++;
-    ZLOG_INFO("Router: Registered route %s %s.", method, path);
+    ZLOG_INFO("Router: Registered route %s %s (%zu routes).", method, path, ROUTE_COUNT);
     return 0;
 }
 
+static void route_count(const zeus_route_node_t *node, uint32_t *nodes, uint32_t *handlers, size_t *strings) {
+    (*nodes)++;
+    *handlers += (uint32_t)__builtin_popcount(node->methods);
+    *strings += node->label_len + 1 + (node->pattern ? strlen(node->pattern) + 1 : 0);
 
-zeus_handler_cb router_find_handler(zeus_route_node_t *root, const char *path) {
-    zeus_route_node_t *curr = root;
+    for (size_t i = 0; i < node->num_children; i++) {
+        route_count(node->children[i], nodes, handlers, strings);
+    }
+    if (node->param) {
+        route_count(node->param, nodes, handlers, strings);
+    }
+    if (node->wildcard) {
+        route_count(node->wildcard, nodes, handlers, strings);
+    }
+}
 
-    while (curr) {
-        int cmp = strcmp(path, curr->path);
-        if (cmp == 0) {
-            return curr->handler;
-        }
+static void route_free(zeus_route_node_t *node) {
+    for (size_t i = 0; i < node->num_children; i++) {
+        route_free(node->children[i]);
+    }
+    if (node->param) {
+        route_free(node->param);
+    }
+    if (node->wildcard) {
+        route_free(node->wildcard);
+    }
 
-        if (cmp < 0) {
-            curr = curr->left;
-        } else {
-            curr = curr->right;
-        }
+    free(node->label);
+    free(node->pattern);
+    free(node->indices);
+    free(node->children);
+    if (node != &ROUTE_ROOT) {
+        free(node);
     }
-    return NULL;
 }
 
-/**
- * Dispatch a response for HTTP/2 to correct handler.
- */
+static uint32_t route_string(char *strings, size_t *len, const char *s, size_t n) {
+    uint32_t off = (uint32_t)*len;
+    memcpy(strings + off, s, n);
+    strings[off + n] = '\0';
+    *len += n + 1;
+    return off;
+}
 
-void router_dispatch_h2(zeus_conn_t *conn, zeus_h2_stream_t *stream) {
-    if (!conn || !stream) {
-        return;
+#define ROUTE_ALIGN(n) (((n) + 15) & ~(size_t)15)
+
+int router_freeze(void) {
+    if (ROUTE_NODES) {
+        return 0;
+    }
+
+    uint32_t num_nodes = 0;
+    uint32_t num_handlers = 0;
+    size_t strings_len = 1;         /** Offset 0 is the empty string. */
+    route_count(&ROUTE_ROOT, &num_nodes, &num_handlers, &strings_len);
+
+    if (strings_len > UINT32_MAX) {
+        ZLOG_ERROR("Router: Route table too large.");
+        return -1;
     }
 
-    ZLOG_INFO("Router H2: Dispatching stream %u, path: %s", stream->id, stream->req.path);
+    size_t nodes_off = 0;
+    size_t handlers_off = ROUTE_ALIGN(nodes_off + sizeof(zeus_route_flat_t) * num_nodes);
+    size_t first_off = ROUTE_ALIGN(handlers_off + sizeof(zeus_handler_cb) * num_handlers);
+    size_t strings_off = ROUTE_ALIGN(first_off + num_nodes);
+    size_t size = strings_off + strings_len;
+
+    zeus_route_node_t **order = malloc(sizeof(*order) * num_nodes);
+    unsigned char *table = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (!order || table == MAP_FAILED) {
+        free(order);
+        if (table != MAP_FAILED) {
+            munmap(table, size);
+        }
+        return -1;
+    }
+
+    zeus_route_flat_t *nodes = (zeus_route_flat_t *)(table + nodes_off);
+    zeus_handler_cb *handlers = (zeus_handler_cb *)(table + handlers_off);
+    char *first = (char *)(table + first_off);
+    char *strings = (char *)(table + strings_off);
+    size_t used = 1;
+    uint32_t next_handler = 0;
+    uint32_t n = 1;
 
     /**
-     * Search for handler.
+     * Breadth-first: a node's children are appended together when the
+     * node itself is laid out, so they end up contiguous.
      */
 
-    zeus_handler_cb handler = router_find_handler(conn->server->router_root, stream->req.path);
+    order[0] = &ROUTE_ROOT;
+    for (uint32_t i = 0; i < n; i++) {
+        const zeus_route_node_t *t = order[i];
+        zeus_route_flat_t *f = &nodes[i];
+
+        f->label = t->label_len ? route_string(strings, &used, t->label, t->label_len) : 0;
+        f->label_len = (uint16_t)t->label_len;
+        f->kind = t->kind;
+        f->methods = t->methods;
+        f->pattern = t->pattern ? route_string(strings, &used, t->pattern, strlen(t->pattern)) : 0;
+
+        f->handlers = next_handler;
+        for (int m = 0; m < ZEUS_METHOD_COUNT; m++) {
+            if (t->methods & (1u << m)) {
+                handlers[next_handler++] = t->handlers[m];
+            }
+        }
 
-    if (handler) {
-        zeus_h2_send_response_simple(conn, stream->id); 
-    } else {
-        ZLOG_WARN("Router H2: 404 Not Found for path: %s", stream->req.path);
+        f->children = n;
+        f->num_children = (uint16_t)t->num_children;
+        for (size_t c = 0; c < t->num_children; c++) {
+            first[n] = t->children[c]->label[0];
+            order[n++] = t->children[c];
+        }
+        if (t->param) {
+            f->param = n;
+            order[n++] = t->param;
+        }
+        if (t->wildcard) {
+            f->wildcard = n;
+            order[n++] = t->wildcard;
+        }
+    }
+
+    free(order);
+    route_free(&ROUTE_ROOT);
+    memset(&ROUTE_ROOT, 0, sizeof(ROUTE_ROOT));
+
+    if (mprotect(table, size, PROT_READ) < 0) {
+        ZLOG_PERROR("Router: mprotect");
+    }
+
+    ROUTE_TABLE = table;
+    ROUTE_TABLE_SIZE = size;
+    ROUTE_NODES_COUNT = num_nodes;
+    ROUTE_NODES = nodes;
+    ROUTE_HANDLERS = handlers;
+    ROUTE_HANDLERS_COUNT = num_handlers;
+    ROUTE_FIRST = first;
+    ROUTE_STRINGS = strings;
+
+    ZLOG_INFO("Router: Froze %zu routes into %u nodes (%zu bytes).", ROUTE_COUNT, num_nodes, size);
+    return 0;
+}
+
+static void route_dump_node(FILE *out, uint32_t i, int depth) {
+    const zeus_route_flat_t *node = &ROUTE_NODES[i];
+    const char *sigil = node->kind == ROUTE_PARAM ? ":" : node->kind == ROUTE_WILDCARD ? "*" : "";
+    int width = fprintf(out, "%*s%s%s", depth * 2, "", sigil, i == 0 ? "(root)" : ROUTE_STRINGS + node->label);
+
+    if (node->methods) {
+        fprintf(out, "%*s", width < 40 ? 40 - width : 1, "");
+        for (int m = 0, sep = 0; m < ZEUS_METHOD_COUNT; m++) {
+            if (node->methods & (1u << m)) {
+                fprintf(out, "%s%s", sep++ ? "," : "", METHOD_NAMES[m]);
+            }
+        }
+        fprintf(out, "  %s", ROUTE_STRINGS + node->pattern);
+    }
+    fputc('\n', out);
+
+    for (uint32_t c = 0; c < node->num_children; c++) {
+        route_dump_node(out, node->children + c, depth + 1);
+    }
+    if (node->param) {
+        route_dump_node(out, node->param, depth + 1);
     }
-}
\ No newline at end of file
+    if (node->wildcard) {
+        route_dump_node(out, node->wildcard, depth + 1);
+    }
+}
+
+void router_dump(FILE *out) {
+    if (!ROUTE_NODES) {
+        fprintf(out, "routes: not frozen\n");
+        return;
+    }
+
+    fprintf(out, "routes: %zu, nodes: %u, table: %zu bytes at %p\n",
+        ROUTE_COUNT, ROUTE_NODES_COUNT, ROUTE_TABLE_SIZE, ROUTE_TABLE);
+    route_dump_node(out, 0, 0);
+}
+
+const char *zeus_request_param(const zeus_request_t *req, const char *name, size_t *len) {
+    size_t name_len = strlen(name);
+
+    for (size_t i = 0; i < req->num_params; i++) {
+        const zeus_param_t *p = &req->params[i];
+        if (p->name_len == name_len && memcmp(p->name, name, name_len) == 0) {
+            *len = p->value_len;
+            return p->value;
+        }
+    }
+    return NULL;
+}
@@ -3,6 +3,8 @@
 #include "../include/config/config.h"
 #include "../include/core/log.h"
 #include <stdio.h>
+#include <string.h>
+#include <stdint.h>
 
 extern int tls_context_init(zeus_server_t *server, const char *cert_file, const char *key_file);
 extern int zeus_config_load(zeus_config_t *config, const char *config_path);
@@ -10,8 +12,9 @@ extern zeus_server_t *zeus_server_init(zeus_config_t *config);
 extern int worker_master_start(zeus_server_t *server);
 
 void root_handler(zeus_conn_t *conn, zeus_request_t *req) {
-    const char *resp = "HTTP/1.1 200 OK\r\nContent-Length: 12\r\n\r\nHello, World";
-    zeus_response_send_data(conn, resp, strlen(resp));
+    const char *body = "Hello, World";
+    conn->res.status_code = 200;
+    zeus_response_send_data(&conn->res, body, strlen(body));
 }
 
 void status_handler(zeus_conn_t *conn, zeus_request_t *req) {
@@ -20,19 +23,58 @@ void status_handler(zeus_conn_t *conn, zeus_request_t *req) {
     zeus_response_send_data(&conn->res, body, strlen(body));
 }
 
-void init_routes() {
-    register_route("GET", "/", root_handler);
-    register_route("GET", "/status", status_handler);
-    
-    ZLOG_INFO("Application: Initialized all routes.");
+/**
+ * Streaming upload: counts the body bytes without keeping them.
+ */
+
+static void upload_body_cb(zeus_conn_t *conn, zeus_request_t *req, const char *data, size_t len) {
+    if (data) {
+        req->user_data = (void *)((uintptr_t)req->user_data + len);
+        return;
+    }
+
+    char body[64];
+    int n = snprintf(body, sizeof(body), "Received %zu bytes\n", (size_t)(uintptr_t)req->user_data);
+    conn->res.status_code = 200;
+    zeus_response_send_data(&conn->res, body, (size_t)n);
+}
+
+void upload_handler(zeus_conn_t *conn, zeus_request_t *req) {
+    if (zeus_request_on_body(conn, upload_body_cb) < 0) {
+        upload_body_cb(conn, req, NULL, 0);     /** No body. */
+    }
+}
+
+/**
+ * Buffered body: echoes back small payloads.
+ */
+
+static void echo_done(zeus_conn_t *conn, zeus_request_t *req) {
+    conn->res.status_code = 200;
+    zeus_response_send_data(&conn->res, req->body, req->body_len);
+}
+
+void echo_handler(zeus_conn_t *conn, zeus_request_t *req) {
+    (void)req;
+    zeus_request_buffer_body(conn, 2048, echo_done);
 }
 
 /**
  * Handler for static files.
  */
 
-void file_handler(zeus_request_t *req, zeus_response_t *res) {
-    zeus_response_send_file(res, "test.txt");
+void file_handler(zeus_conn_t *conn, zeus_request_t *req) {
+    zeus_response_send_file(&conn->res, "test.txt");
+}
+
+void init_routes() {
+    register_route("GET", "/", root_handler);
+    register_route("GET", "/status", status_handler);
+    register_route("POST", "/upload", upload_handler);
+    register_route("POST", "/echo", echo_handler);
+    register_route("GET", "/file", file_handler);
+    
+    ZLOG_INFO("Application: Initialized all routes.");
 }
 
 /** 
@@ -163,6 +163,8 @@ void handle_write_cb(zeus_io_event_t *ev) {
 
 /**
  * Initialize a graceful close for TLS connections.
+ * close_connection sends the TLS close_notify before closing the socket
+ * and releases the connection, so both paths share the same teardown.
  */
 
 void start_graceful_close(zeus_conn_t *conn) {
@@ -170,13 +172,5 @@ void start_graceful_close(zeus_conn_t *conn) {
         return;
     }
 
-    conn->closing = 1;
-
-#ifdef __linux__
-    zeus_event_ctl(conn->server, &conn->event, EPOLL_CTL_DEL, 0);
-#endif 
-
-    shutdown(conn->event.fd, SHUT_RDWR);
-    close(conn->event.fd);
-    conn_unref(conn);
-}
\ No newline at end of file
+    close_connection(conn);
+}
@@ -10,7 +10,13 @@
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 
-static const unsigned char ALPN_SERVER_PROTOS[] = "\x02h2\x08http/1.1";
+/**
+ * Only HTTP/1.1 is offered. The HTTP/2 code can route a stream but
+ * handlers cannot answer one yet (every matched route would get 501),
+ * so h2 is not advertised until they can.
+ */
+
+static const unsigned char ALPN_SERVER_PROTOS[] = "\x08http/1.1";
 static const unsigned int ALPN_SERVER_PROTOS_LEN = sizeof(ALPN_SERVER_PROTOS) - 1;
 
 /**
@@ -86,6 +92,20 @@ int tls_context_init(zeus_server_t *server, const char *cert_file, const char *k
 
     SSL_CTX_set_alpn_select_cb(server->ssl_ctx, alpn_select_cb, NULL);
 
+    /**
+     * kTLS is negotiated per connection after the handshake; connections
+     * whose kernel or cipher cannot do it keep userspace encryption.
+     */
+
+    if (server->config.ktls) {
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+        SSL_CTX_set_options(server->ssl_ctx, SSL_OP_ENABLE_KTLS);
+        ZLOG_INFO("TLS: Kernel TLS offload enabled (used where the kernel supports it).");
+#else
+        ZLOG_WARN("TLS: ktls = on, but OpenSSL was built without kTLS. Using userspace encryption.");
+#endif
+    }
+
     ZLOG_INFO("TLS: ALPN configured (h2, http/1.1) and callback registered.");
     ZLOG_INFO("TLS: SSL Context successfully initialized.");
     return 0;
@@ -0,0 +1,184 @@
+/**
+ * logcat.c
+ * zeus-logcat: decodes binary access log files to text or JSON lines.
+ *
+ *   zeus-logcat [-j] file...
+ *
+ * Text: time pid fd protocol "method path" status bytes-in bytes-out
+ * latency-us flags. JSON: one object per record. Files from several
+ * workers are printed one after the other, not merged by time.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../../include/core/access_log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Writes s with quotes, backslashes and control bytes escaped, so a
+ * request path cannot forge a line or a field.
+ */
+
+static void print_text_string(const char *s, size_t len) {
+    for (size_t i = 0; i < len && s[i]; i++) {
+        unsigned char c = (unsigned char)s[i];
+
+        if (c == '"' || c == '\\') {
+            printf("\\%c", c);
+        } else if (c < 0x20 || c == 0x7f) {
+            printf("\\x%02x", c);
+        } else {
+            putchar(c);
+        }
+    }
+}
+
+static void print_text(const zeus_access_record_t *rec, const char *path) {
+    time_t sec = (time_t)(rec->time_us / 1000000);
+    struct tm tm_info;
+    char when[32];
+    char proto[16];
+
+    localtime_r(&sec, &tm_info);
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm_info);
+
+    if (rec->flags & ZEUS_ACCESS_H2) {
+        snprintf(proto, sizeof(proto), "h2:%u", rec->stream_id);
+    } else {
+        snprintf(proto, sizeof(proto), "h1.%u", rec->http_minor);
+    }
+
+    printf("%s.%06u %u %d %s \"", when, (unsigned)(rec->time_us % 1000000),
+        rec->pid, rec->fd, proto);
+    print_text_string(rec->method, sizeof(rec->method));
+    putchar(' ');
+    print_text_string(path, rec->path_len);
+    printf("%s\" %u %llu %llu %uus%s%s\n",
+        (rec->flags & ZEUS_ACCESS_PATH_TRUNCATED) ? "..." : "",
+        rec->status,
+        (unsigned long long)rec->bytes_in, (unsigned long long)rec->bytes_out,
+        rec->latency_us,
+        (rec->flags & ZEUS_ACCESS_TLS_RESUMED) ? " resumed" : "",
+        (rec->flags & ZEUS_ACCESS_KEEPALIVE) ? " keepalive" : "");
+}
+
+/**
+ * Writes s as the body of a JSON string.
+ */
+
+static void print_json_string(const char *s, size_t len) {
+    for (size_t i = 0; i < len && s[i]; i++) {
+        unsigned char c = (unsigned char)s[i];
+
+        if (c == '"' || c == '\\') {
+            printf("\\%c", c);
+        } else if (c < 0x20 || c == 0x7f) {
+            printf("\\u%04x", c);
+        } else {
+            putchar(c);
+        }
+    }
+}
+
+static void print_json(const zeus_access_record_t *rec, const char *path) {
+    printf("{\"time_us\":%llu,\"pid\":%u,\"fd\":%d,\"proto\":\"%s\",\"stream\":%u,\"method\":\"",
+        (unsigned long long)rec->time_us, rec->pid, rec->fd,
+        (rec->flags & ZEUS_ACCESS_H2) ? "h2" : (rec->http_minor ? "http/1.1" : "http/1.0"),
+        rec->stream_id);
+    print_json_string(rec->method, sizeof(rec->method));
+    printf("\",\"path\":\"");
+    print_json_string(path, rec->path_len);
+    printf("\",\"path_truncated\":%s,\"status\":%u,\"bytes_in\":%llu,\"bytes_out\":%llu,"
+           "\"latency_us\":%u,\"tls_resumed\":%s,\"keepalive\":%s}\n",
+        (rec->flags & ZEUS_ACCESS_PATH_TRUNCATED) ? "true" : "false",
+        rec->status,
+        (unsigned long long)rec->bytes_in, (unsigned long long)rec->bytes_out,
+        rec->latency_us,
+        (rec->flags & ZEUS_ACCESS_TLS_RESUMED) ? "true" : "false",
+        (rec->flags & ZEUS_ACCESS_KEEPALIVE) ? "true" : "false");
+}
+
+/**
+ * Decodes one file. Returns 0, or -1 when it is not an access log or
+ * ends in the middle of a record.
+ */
+
+static int decode_file(const char *name, int json) {
+    zeus_access_file_t header;
+    zeus_access_record_t rec;
+    char path[ZEUS_ACCESS_PATH_MAX + 8];
+    int rc = 0;
+
+    FILE *fp = fopen(name, "rb");
+    if (!fp) {
+        perror(name);
+        return -1;
+    }
+
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        memcmp(header.magic, ZEUS_ACCESS_MAGIC, sizeof(header.magic)) != 0) {
+        fprintf(stderr, "%s: not a zeusHttp access log\n", name);
+        fclose(fp);
+        return -1;
+    }
+
+    if (header.byte_order != ZEUS_ACCESS_BYTE_ORDER || header.version != ZEUS_ACCESS_VERSION ||
+        header.record_size != sizeof(rec)) {
+        fprintf(stderr, "%s: unsupported format (version %u, written on another architecture?)\n",
+            name, header.version);
+        fclose(fp);
+        return -1;
+    }
+
+    while (fread(&rec, sizeof(rec), 1, fp) == 1) {
+        size_t rest = rec.size > sizeof(rec) ? rec.size - sizeof(rec) : 0;
+
+        if (rec.size < sizeof(rec) || rest > sizeof(path) || rec.path_len > rest ||
+            (rest > 0 && fread(path, rest, 1, fp) != 1)) {
+            fprintf(stderr, "%s: truncated or corrupt record\n", name);
+            rc = -1;
+            break;
+        }
+
+        if (json) {
+            print_json(&rec, path);
+        } else {
+            print_text(&rec, path);
+        }
+    }
+
+    fclose(fp);
+    return rc;
+}
+
+int main(int argc, char **argv) {
+    int json = 0;
+    int opt;
+    int rc = EXIT_SUCCESS;
+
+    while ((opt = getopt(argc, argv, "j")) != -1) {
+        if (opt == 'j') {
+            json = 1;
+        } else {
+            fprintf(stderr, "usage: %s [-j] file...\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (optind == argc) {
+        fprintf(stderr, "usage: %s [-j] file...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    for (int i = optind; i < argc; i++) {
+        if (decode_file(argv[i], json) < 0) {
+            rc = EXIT_FAILURE;
+        }
+    }
+    return rc;
+}